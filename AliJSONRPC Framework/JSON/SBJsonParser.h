@@ -75,8 +75,46 @@
     
 @private
     const char *c;
+    BOOL stringsReferenceFile;
+    CFAllocatorRef stringsDeallocator; // while parsing a file with stringsReferenceFile
 }
 
+/**
+ @brief Whether the strings parsed by -objectWithContentsOfFile: reference the bytes of the file instead of copying them.
+ 
+ Defaults to NO. If YES, the strings without escape sequences are immutable NSStrings made directly from the bytes of the
+ memory-mapped file (those with escape sequences are still copied): the file stays mapped as long as one of them exists.
+ 
+ This avoids a copy of most of the text. Note that CoreFoundation still converts the strings that are not ASCII to its
+ internal encoding, and that the mapped pages are kept for the whole file as long as any of its strings is alive:
+ copy the strings you keep for a long time.
+ */
+@property BOOL stringsReferenceFile;
+
+/**
+ @brief Return the object represented by the given UTF-8 bytes, parsed in place.
+ 
+ Same as -objectWithString:, without the copies needed to make an NSString and get back its UTF-8 bytes:
+ use it to parse a buffer or a memory-mapped file directly.
+ 
+ @param bytes the UTF-8 JSON text. It must be followed by a NUL byte (bytes[length] == 0), like the C string of an NSString.
+ @param length the length of the JSON text, not including the NUL byte
+ */
+- (id)objectWithUTF8Bytes:(const char *)bytes length:(NSUInteger)length;
+
+/**
+ @brief Return the object represented by the JSON file at the given path.
+ 
+ The file is memory-mapped and parsed in place, instead of being read into an NSData, converted to an NSString
+ and converted back to UTF-8 bytes: the memory used is the mapping (whose pages the system can reclaim, as they
+ are backed by the file) and the parsed objects. See also stringsReferenceFile.
+ 
+ Returns nil on error, with the reason in the errorTrace.
+ 
+ @param path the path of a UTF-8 JSON file
+ */
+- (id)objectWithContentsOfFile:(NSString *)path;
+
 @end
 
 // don't use - exists for backwards compatibility with 2.1.x only. Will be removed in 2.3.
@@ -28,6 +28,69 @@
  */
 
 #import "SBJsonParser.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ @internal A read-only memory mapping of a file, always followed by a NUL byte so that it can be scanned in place.
+ */
+@interface SBJsonMappedFile : NSObject {
+@public
+    const char *bytes;
+    size_t length;
+    size_t mappedLength;
+}
+- (id)initWithPath:(NSString *)path;
+@end
+
+@implementation SBJsonMappedFile
+
+- (id)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        int fd = open([path fileSystemRepresentation], O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) || (unsigned long long)st.st_size >= SIZE_MAX / 2) {
+            if (fd >= 0) close(fd);
+            [self release];
+            return nil;
+        }
+        
+        // Reserve room for one more byte, rounded to whole pages, then map the file at the beginning:
+        // the byte after the file is either in the zero-filled end of its last page or in the anonymous page after it.
+        size_t page = (size_t)getpagesize();
+        length = (size_t)st.st_size;
+        mappedLength = (length + 1 + page - 1) / page * page;
+        char *base = mmap(NULL, mappedLength, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (base != MAP_FAILED && length && mmap(base, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(base, mappedLength);
+            base = MAP_FAILED;
+        }
+        close(fd);
+        if (base == MAP_FAILED) {
+            [self release];
+            return nil;
+        }
+        madvise(base, mappedLength, MADV_SEQUENTIAL); // read once, front to back
+        bytes = base;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (bytes)
+        munmap((void *)bytes, mappedLength);
+    [super dealloc];
+}
+
+@end
+
+// The strings referencing a mapped file hold this allocator, which holds the file: nothing to free but the mapping.
+static void noDeallocate(void *ptr, void *info) {
+}
+
 
 @interface SBJsonParser ()
 
@@ -56,6 +119,8 @@
 
 @implementation SBJsonParser
 
+@synthesize stringsReferenceFile;
+
 static char ctrl[0x22];
 
 + (void)initialize
@@ -112,6 +177,59 @@ static char ctrl[0x22];
     return o;
 }
 
+- (id)objectWithUTF8Bytes:(const char *)bytes length:(NSUInteger)length {
+    [self clearErrorTrace];
+    
+    if (!bytes) {
+        [self addErrorWithCode:EINPUT description:@"Input was 'nil'"];
+        return nil;
+    }
+    
+    depth = 0;
+    c = bytes;
+    
+    id o;
+    if (![self scanValue:&o]) {
+        return nil;
+    }
+    
+    // The scan stops at the first NUL byte: it must be the one after the text.
+    if (![self scanIsAtEnd] || c != bytes + length) {
+        [self addErrorWithCode:ETRAILGARBAGE description:@"Garbage after JSON"];
+        return nil;
+    }
+    
+    // Check that the object we've found is a valid JSON container.
+    if (![o isKindOfClass:[NSDictionary class]] && ![o isKindOfClass:[NSArray class]]) {
+        [self addErrorWithCode:EFRAGMENT description:@"Valid fragment, but not JSON"];
+        return nil;
+    }
+
+    return o;
+}
+
+- (id)objectWithContentsOfFile:(NSString *)path {
+    [self clearErrorTrace];
+    
+    SBJsonMappedFile *file = path ? [[SBJsonMappedFile alloc] initWithPath:path] : nil;
+    if (!file) {
+        [self addErrorWithCode:EINPUT description:[NSString stringWithFormat:@"Cannot map file '%@': %s", path, strerror(errno)]];
+        return nil;
+    }
+    
+    if (stringsReferenceFile) {
+        CFAllocatorContext context = { 0, (void *)file, CFRetain, CFRelease, NULL, NULL, NULL, noDeallocate, NULL };
+        stringsDeallocator = CFAllocatorCreate(kCFAllocatorDefault, &context);
+    }
+    id o = [self objectWithUTF8Bytes:file->bytes length:file->length];
+    if (stringsDeallocator) {
+        CFRelease(stringsDeallocator); // the strings made from the file hold it
+        stringsDeallocator = NULL;
+    }
+    [file release];
+    return o;
+}
+
 /*
  In contrast to the public methods, it is an error to omit the error parameter here.
  */
@@ -285,6 +403,20 @@ static char ctrl[0x22];
 
 - (BOOL)scanRestOfString:(NSMutableString **)o 
 {
+    if (stringsDeallocator) {
+        // Without escape sequences, the string can be made from the bytes of the file as they are.
+        size_t len = strcspn(c, ctrl);
+        if (c[len] == '"') {
+            CFStringRef s = CFStringCreateWithBytesNoCopy(kCFAllocatorDefault, (const UInt8 *)c, len,
+                                                          kCFStringEncodingUTF8, false, stringsDeallocator);
+            if (s) {
+                *o = [(NSMutableString *)s autorelease];
+                c += len + 1;
+                return YES;
+            }
+        }
+    }
+    
     *o = [NSMutableString stringWithCapacity:16];
     do {
         // First see if there's a portion we can grab in one go. 
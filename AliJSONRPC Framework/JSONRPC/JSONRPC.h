@@ -31,6 +31,21 @@
 #import "JSONRPCMethodCall.h"
 #import "JSONRPCResponseHandler.h"
 #import "JSONRPC_Extensions.h"
+#import "JSONRPCCallScheduler.h"
+#import "JSONRPCHedgingPolicy.h"
+#import "JSONRPCLoadBalancing.h"
+#import "JSONRPCRetryPolicy.h"
+#import "JSONRPCCompression.h"
+#import "JSONRPCMessagePack.h"
+#import "JSONRPCMetrics.h"
+#import "JSONRPCTracer.h"
+#import "JSONRPCLoopback.h"
+#import "JSONRPCTrafficRecorder.h"
+#import "JSONRPCMappedObject.h"
+#import "JSONRPCBufferPool.h"
+#import "JSONRPCResultStreamParser.h"
+#import "JSONRPCResponseCache.h"
+#import "JSONRPCServer.h"
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -82,6 +97,17 @@
  * - @subpage ErrMgmt
  *    - @subpage ErrCatch
  *    - @subpage ErrCodes
+ * - @subpage Tuning
+ *    - @subpage TuningScheduling
+ *    - @subpage TuningDeadlines
+ *    - @subpage TuningHedging
+ *    - @subpage TuningLoadBalancing
+ *    - @subpage TuningRetries
+ *    - @subpage TuningCompression
+ *    - @subpage TuningMessagePack
+ *    - @subpage TuningMetrics
+ *    - @subpage TuningTracing
+ * - @subpage Server
  * - @subpage Example
  *
  ***** <hr>
@@ -219,6 +245,9 @@
  * For more complex objects, you can call initWithJson in the initWithJson method itself, and also use
  *  arrayWithJson:itemsClass: method of the NSArray(JSON) category (JSONRPC_Extensions.h). See @ref ResultConversionExample2
  *
+ * Instead of writing initWithJson: yourself, you can also subclass JSONRPCMappedObject and only declare your properties.
+ *  See @ref ResultConversionMapping
+ *
  * <hr>
  * @section ResultConversionExample1 Simple example
  *
@@ -310,6 +339,40 @@
  * }
  * @end
  * @endcode
+ *
+ * <hr>
+ *
+ * @section ResultConversionMapping Declarative mapping
+ * Writing initWithJson: by hand (or reading the JSON dictionary in each getter) is repetitive, and easy to get slow
+ *  when nested objects are rebuilt each time they are accessed. If your class inherits from JSONRPCMappedObject,
+ *  its properties are filled automatically, in one pass over the JSON object, using metadata computed once per class:
+ *  - each property is read from the key of the same name;
+ *  - properties whose class responds to initWithJson: (e.g. other JSONRPCMappedObject subclasses) are converted to this class;
+ *  - scalar properties (int, BOOL, double...) are read from numbers, NSURL properties from strings;
+ *  - +propertyMappings declares the exceptions: other keys, key aliases, and the class of the items of array properties.
+ *
+ * The Family class above then becomes:
+ * @code
+ * @interface Family : JSONRPCMappedObject {
+ *   Person* _father;
+ *   Person* _mother;
+ *   NSArray* _children;
+ * }
+ * @property(nonatomic, readonly) Person* father;
+ * @property(nonatomic, readonly) Person* mother;
+ * @property(nonatomic, readonly) NSArray* children;
+ * @end
+ * @endcode
+ * @code
+ * @implementation Family
+ * @synthesize father = _father, mother = _mother, children = _children;
+ * +(NSArray*)propertyMappings {
+ *   return [NSArray arrayWithObject:[JSONRPCPropertyMapping mappingForProperty:@"children" key:@"children" itemsClass:[Person class]]];
+ * }
+ * @end
+ * @endcode
+ * (no initWithJson: and no -dealloc: the mapped instance variables are released by JSONRPCMappedObject).
+ * The types of the example project (MyTypes.h) are written this way.
  */
 
 
@@ -360,9 +423,14 @@
  *   <li>key JSONRPCErrorJSONObjectKey : the JSON object we tried to convert/process</li>
  *   <li>key JSONRPCErrorClassNameKey : the name of the class we tried to convert to</li>
  * </ul>
- * For now, the JSONRPCInternalErrorDomain domain contains two error codes :<ul>
+ * For now, the JSONRPCInternalErrorDomain domain contains the following error codes :<ul>
  *   <li>JSONRPCFormatErrorCode: this code corresponds to an unexpected JSON received by the server, especially if the returned JSON does not conforms to the JSON-RPC specification</li>
  *   <li>JSONRPCConversionErrorCode: this code correspond to an error while converting the JSON object to the resultClass provided to the JSONRPCResponseHandler</li>
+ *   <li>JSONRPCCompressionErrorCode: the compressed response of the server is corrupted or truncated.</li>
+ *   <li>JSONRPCCircuitOpenErrorCode: the request was not sent because every endpoint has been failing recently (see @ref TuningRetries).</li>
+ *   <li>JSONRPCResponseTooLargeErrorCode: the response was larger than JSONRPCService#maxResponseSize.</li>
+ *   <li>JSONRPCTimeoutErrorCode: the method call did not complete before its deadline (see JSONRPCResponseHandler#timeout).
+ *       The NSUnderlyingErrorKey contains the network error that prevented a retry, if any.</li>
  * </ul></li>
  *
  * </ul>
@@ -391,6 +459,227 @@
 
 
 
+/**
+ * @page Tuning Performance tuning
+ *
+ * @section TuningScheduling Scheduling and cancelling method calls
+ * Method calls are not sent immediately: each JSONRPCService has a JSONRPCCallScheduler that queues them
+ * and limits the number of simultaneous connections to the WebService (see JSONRPCCallScheduler#maxConcurrentCalls).
+ *
+ * Set the JSONRPCResponseHandler#priority of the calls the user is waiting for to JSONRPCCallPriorityHigh, and the one of
+ * bulk traffic to JSONRPCCallPriorityBackground: high priority calls are always sent first, and calls of the same priority
+ * are sent in the order they were made. Background and Low priority calls can only use part of the connections
+ * (see JSONRPCCallScheduler#setMaxConcurrentCalls:forPriority:) so that interactive calls never wait behind them.
+ * @code
+ * JSONRPCResponseHandler* h = [service callMethodWithNameAndParams:@"syncAll",nil];
+ * h.priority = JSONRPCCallPriorityBackground;
+ * ...
+ * [h cancel]; // no longer needed: remove it from the queue or tear down the connection
+ * @endcode
+ *
+ * @section TuningDeadlines Deadlines
+ * Set JSONRPCService#defaultTimeout, or the JSONRPCResponseHandler#timeout of a given call, to bound the time a method call
+ * can take, including queueing, retries and parsing. An expired call fails immediately with the JSONRPCTimeoutErrorCode error code.
+ * If JSONRPCService#sendsTimeoutHeader is set, the remaining budget is sent to the server in the JSONRPCTimeoutHeaderField HTTP header
+ * so that it can drop the requests the client has already given up on.
+ *
+ * @section TuningHedging Hedged requests
+ * To cut the tail latency of idempotent methods, set a JSONRPCHedgingPolicy on JSONRPCService#hedgingPolicy:
+ * a call that did not answer within the given latency percentile is sent a second time, the first valid response wins
+ * and the other request is cancelled. Your delegate or completion block is still called only once.
+ * Hedged requests count against JSONRPCCallScheduler#maxConcurrentCalls, and are skipped while calls are waiting in the queue.
+ *
+ * @section TuningLoadBalancing Multiple endpoints
+ * If the WebService is replicated, create the JSONRPCService with the URLs of all the replicas, and choose how to spread
+ * the requests with JSONRPCService#loadBalancingStrategy (JSONRPCRoundRobinStrategy, JSONRPCLeastOutstandingStrategy or
+ * JSONRPCLatencyEWMAStrategy, or your own JSONRPCLoadBalancingStrategy):
+ * @code
+ * JSONRPCService* service = [JSONRPCService serviceWithURLs:mkArray(url1,url2,url3) version:JSONRPCVersion_2_0];
+ * service.loadBalancingStrategy = [[[JSONRPCLatencyEWMAStrategy alloc] init] autorelease];
+ * @endcode
+ * Endpoints failing repeatedly can be ejected for a while (see JSONRPCEndpoint#ejectionThreshold and @ref TuningRetries).
+ * Nothing else changes: method calls, proxies and response handlers work the same as with a single URL.
+ * When hedging without a JSONRPCHedgingPolicy#hedgeURL, the hedged request goes to another endpoint.
+ *
+ * @section TuningRetries Retries and circuit breaking
+ * Method calls failing because of a network error are retried automatically, up to JSONRPCResponseHandler#maxRetryAttempts times.
+ * The JSONRPCService#retryPolicy spaces the retries with an exponential backoff and random jitter, so that clients
+ * don't retry in lockstep, and limits the retries to a fraction of the recent method calls (the retry budget)
+ * so that an outage does not multiply the load on the server:
+ * @code
+ * service.retryPolicy.initialDelay = 0.2;
+ * service.retryPolicy.retryBudgetRatio = 0.1;
+ * @endcode
+ * Each JSONRPCEndpoint can also act as a circuit breaker: after JSONRPCEndpoint#ejectionThreshold consecutive failures, no request
+ * is sent to it until JSONRPCEndpoint#ejectionDuration has elapsed, then a single probe request decides whether it is healthy again.
+ * While the circuit of every endpoint is open, method calls fail immediately with the JSONRPCCircuitOpenErrorCode error code.
+ * Circuit breaking is opt-in, as it is mostly useful when other endpoints can take over:
+ * @code
+ * for(JSONRPCEndpoint* ep in service.endpoints) ep.ejectionThreshold = 3;
+ * @endcode
+ *
+ * @section TuningCompression Compression
+ * JSON compresses very well. By default, the service accepts gzip and deflate responses (Accept-Encoding header),
+ * and inflates them as their chunks are received, so that the compressed and inflated responses are never both in memory.
+ * If your server accepts compressed request bodies, set JSONRPCService#requestCompressionThreshold to compress the bodies
+ * larger than this size:
+ * @code
+ * service.requestCompressionThreshold = 1024;
+ * service.requestContentEncoding = JSONRPCContentEncodingGzip;
+ * ...
+ * NSLog(@"%@", service.compressionStats); // compression ratios and CPU time
+ * @endcode
+ * The framework must be linked with libz (libz.dylib).
+ *
+ * @section TuningMessagePack Binary encoding
+ * Parsing and formatting numbers in JSON text is costly. If your server supports MessagePack, set
+ * JSONRPCService#contentType to JSONRPCContentTypeMessagePack: requests are then sent in MessagePack, and the server is asked
+ * to respond in MessagePack too (JSON responses are still accepted). The decoded objects are the same as with JSON
+ * (NSDictionary, NSArray, NSString, NSNumber, NSNull), so your resultClass and JSONInitializer code is unchanged.
+ * In addition, NSData parameters and results are transferred as raw bytes, without base64 encoding.
+ *
+ * See Benchmarks/MessagePackBenchmark.m for a comparison with SBJsonWriter/SBJsonParser on your own payloads.
+ *
+ * @section TuningMetrics Measuring the method calls
+ * To know where the time of a slow call goes, set a JSONRPCService#metricsObserver. It receives a JSONRPCCallMetrics
+ * for every method call, with the timestamps of each phase (serialization, queueing, retries, connection, first and last byte,
+ * parsing, resultClass conversion and delegate dispatch), the request and response sizes and the number of retries.
+ *
+ * JSONRPCMetricsAggregator is an observer that aggregates these records into per-method latency histograms,
+ * whose snapshot can be taken at any time from any thread:
+ * @code
+ * JSONRPCMetricsAggregator* metrics = [[[JSONRPCMetricsAggregator alloc] init] autorelease];
+ * service.metricsObserver = metrics;
+ * ...
+ * for(JSONRPCLatencyHistogram* h in [[metrics snapshot] allValues]) NSLog(@"%@",h);
+ * @endcode
+ * When no observer is set, nothing is measured.
+ *
+ * @section TuningTracing Tracing
+ * To see how concurrent calls overlap, queue and retry over time, set a JSONRPCService#tracer. Every stage of each method call
+ * is recorded as a span in a ring buffer, which you can dump as Chrome trace-event JSON and open in chrome://tracing or Perfetto:
+ * @code
+ * service.tracer = [JSONRPCTracer tracer];
+ * ...
+ * [service.tracer writeToFile:[NSTemporaryDirectory() stringByAppendingPathComponent:@"jsonrpc-trace.json"] error:NULL];
+ * @endcode
+ *
+ * @section TuningLoopback Measuring without the network
+ * To measure the cost of the framework alone (serialization, parsing, conversion and dispatch), or to test without a server,
+ * set a JSONRPCService#loopbackHandler: the requests are answered in-process by the block, and the replies follow the same
+ * path as responses from the network.
+ * @code
+ * service.loopbackHandler = ^NSData*(NSURLRequest* request, NSString** MIMEType) {
+ *     return [@"{\"id\":\"1\",\"result\":42,\"error\":null}" dataUsingEncoding:NSUTF8StringEncoding];
+ * };
+ * @endcode
+ * Benchmarks/LoadGenerator.m uses it with the --loopback option.
+ *
+ * @section TuningReplay Benchmarking with real payloads
+ * Synthetic payloads miss the shape of real responses. Set a JSONRPCService#trafficRecorder to capture the request/response
+ * pairs of the method calls, with their timing, to an append-only file:
+ * @code
+ * service.trafficRecorder = [JSONRPCTrafficRecorder recorderWithFile:capturePath error:NULL];
+ * @endcode
+ * Benchmarks/ReplayBenchmark replays a capture offline: it pushes the responses through the parser and the resultClass conversion,
+ * or through a JSONRPCService with a loopback handler at the original or an accelerated pace.
+ *
+ * @section TuningLazyConversion Converting large results
+ * When the result is a large array of which only a few rows are displayed, set JSONRPCResponseHandler#lazyResultConversion
+ * so that the objects are converted to the resultClass only when they are accessed (see JSONRPCLazyArray):
+ * @code
+ * JSONRPCResponseHandler* h = [service callMethodWithName:@"getAllUsers" parameters:nil];
+ * [h setDelegate:self callback:@selector(methodCall:didReturnUsers:error:) resultClass:[Person class]];
+ * h.lazyResultConversion = YES;
+ * @endcode
+ *
+ * When the whole result is needed, a large array is instead converted on all the cores: the objects are split in chunks
+ *  converted in parallel on GCD's global queue, and the order is preserved (see NSArray(JSON)).
+ * This requires the initWithJson: method of the resultClass to be thread-safe, which is the case of JSONRPCMappedObject subclasses.
+ * If yours is not, set JSONRPCResponseHandler#concurrentResultConversion to NO, or implement it in the class:
+ * @code
+ * +(BOOL)allowsConcurrentJsonConversion { return NO; } // initWithJson: uses a shared NSDateFormatter
+ * @endcode
+ *
+ * @section TuningBuffers Receive buffers and response size limit
+ * The responses are received into buffers presized from their Content-Length and taken from JSONRPCService#bufferPool,
+ *  to which they are given back once parsed: a large response is not grown through repeated reallocations, and
+ *  the following calls reuse the buffers instead of allocating new ones. The pool counters show how well this works:
+ * @code
+ * JSONRPCBufferPool* pool = service.bufferPool;
+ * NSLog(@"%lu buffers allocated, %lu reused, peak %llu bytes", (unsigned long)pool.allocationsCount, (unsigned long)pool.reusesCount, pool.peakOutstandingBytes);
+ * @endcode
+ * To protect the application against unexpectedly large responses, set JSONRPCService#maxResponseSize: the responses
+ *  whose Content-Length (or received size) exceeds it are aborted right away instead of being downloaded and parsed.
+ * Call -[JSONRPCBufferPool drain] on memory warnings to release the free buffers.
+ *
+ * @section TuningStreaming Streaming huge result arrays
+ * For methods returning millions of rows, even lazyResultConversion needs the whole response and the whole parsed array
+ *  in memory. With -[JSONRPCResponseHandler streamResultElements:], the response is parsed as it is received, and each
+ *  element of the result array is converted and handed to a block, then released (see JSONRPCResultStreamParser):
+ * @code
+ * JSONRPCResponseHandler* h = [service callMethodWithName:@"exportContacts" parameters:nil];
+ * h.resultClass = [Person class];
+ * [h streamResultElements:^BOOL(JSONRPCMethodCall* call, id person, NSUInteger index) {
+ *   [database insertPerson:person];
+ *   return YES; // NO to stop the export
+ * }];
+ * [h completion:^(JSONRPCMethodCall* call, id result, NSError* error) {
+ *   // result is nil: the persons have been inserted already
+ * }];
+ * @endcode
+ * The block runs as the bytes arrive and the connection does not read further while it runs, so a slow consumer slows
+ *  the download down instead of accumulating rows. JSONRPCService#maxResponseSize then limits the size of each element.
+ *
+ * @section TuningCache Caching the responses of read-only methods
+ * Methods without side effects can be answered from a JSONRPCResponseCache instead of the network, for a time to live
+ *  chosen per method. Give the cache a directory to also keep the responses on disk, so that they survive the restarts
+ *  of the process:
+ * @code
+ * JSONRPCResponseCache* cache = [JSONRPCResponseCache cacheWithDirectory:cachesPath maxDiskBytes:32*1024*1024 error:NULL];
+ * [cache setTimeToLive:600 forMethodName:@"getCountries"];
+ * service.responseCache = cache;
+ * @endcode
+ * The responses on disk are memory-mapped and parsed in place with SBJsonParser's objectWithUTF8Bytes:length:, so a warm
+ *  start reads them without copying them to the heap. The JSONRPCCallMetrics of a cached call have JSONRPCCallMetrics#fromCache set.
+ */
+
+
+
+/**
+ * @page Server Serving JSON-RPC
+ *
+ * JSONRPCServer serves JSON-RPC methods over HTTP, on a TCP port or a unix domain socket, so that the same code base
+ *  and data model (e.g. JSONRPCMappedObject subclasses, which can be both created from and converted to JSON) can be used
+ *  on both sides. Register the methods, then start the server:
+ * @code
+ * JSONRPCServer* server = [[JSONRPCServer alloc] init];
+ * [server registerMethod:@"getPerson" block:^id(id params, NSError** error) {
+ *   Person* p = [directory personWithID:[params objectAtIndex:0]];
+ *   if (!p) *error = [NSError errorWithDomain:JSONRPCServerErrorDomain code:404
+ *                                    userInfo:[NSDictionary dictionaryWithObject:@"No such person" forKey:NSLocalizedDescriptionKey]];
+ *   return p; // converted to JSON with -proxyForJson
+ * }];
+ * [server registerMethod:@"addPerson" target:directory selector:@selector(addPerson:error:)];
+ * [server startOnPort:8080 error:NULL];
+ * @endcode
+ *
+ * Each connection is read by its own thread; the method handlers run on a pool of JSONRPCServer#maxConcurrentHandlers
+ *  worker threads, so they must be thread-safe. Requests are answered in the JSON-RPC version they use (1.0, 1.1 or 2.0,
+ *  including 2.0 batches and notifications), with the standard error codes (JSONRPCServerErrorCode) for invalid requests.
+ *
+ * The elements of a batch are independent calls: they run concurrently on the worker pool, at most
+ *  JSONRPCServer#maxBatchConcurrency at a time, and batches larger than JSONRPCServer#maxBatchSize are rejected before
+ *  any element is executed. The batch response has no entry for the notifications; clients match the others by "id".
+ *
+ * Request bodies are framed by their Content-Length and limited to JSONRPCServer#maxRequestSize: a larger request is
+ *  answered with an HTTP 413 error before its body is read, and the connection is closed.
+ *
+ * The Benchmarks/LoadGenerator tool measures the throughput of the server with <tt>--server jsonrpc</tt>.
+ */
+
+
+
 /**
  * @page Example Example
  *
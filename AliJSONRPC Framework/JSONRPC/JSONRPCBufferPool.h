@@ -0,0 +1,79 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+#include <pthread.h>
+
+//! @file JSONRPCBufferPool.h
+//! @brief Reusable, size-classed receive buffers (see JSONRPCService#bufferPool)
+
+#define JSONRPCBufferPoolSizeClasses 9 //!< number of size classes: 4KB, 8KB, ... 1MB
+
+/** @brief A pool of NSMutableData buffers, used by the response handlers of a JSONRPCService to receive the responses
+ *
+ * Buffers are requested with the expected size of the response (the Content-Length when the server sends it), rounded up
+ * to a power of two between 4KB and 1MB, so that a large response is not grown through repeated reallocations.
+ * They are given back once the response has been parsed, and kept (up to maxBuffersPerSizeClass of each size)
+ * for the next responses of the same size. Buffers larger than 1MB are not kept.
+ *
+ * The counters let you measure the allocations saved and the memory held by the responses being received.
+ * This class is thread-safe.
+ */
+@interface JSONRPCBufferPool : NSObject
+{
+	//! @privatesection
+	pthread_mutex_t _lock;
+	NSMutableArray* _freeBuffers[JSONRPCBufferPoolSizeClasses];
+	CFMutableDictionaryRef _bufferSizes; // buffers handed out -> their size class in bytes
+	NSUInteger _maxBuffersPerSizeClass;
+	NSUInteger _allocationsCount;
+	NSUInteger _reusesCount;
+	unsigned long long _outstandingBytes;
+	unsigned long long _peakOutstandingBytes;
+	unsigned long long _pooledBytes;
+}
+@property(nonatomic, assign) NSUInteger maxBuffersPerSizeClass; //!< number of free buffers kept for each size. Defaults to 4. 0 disables the pooling.
+@property(nonatomic, readonly) NSUInteger allocationsCount; //!< number of buffers that had to be allocated
+@property(nonatomic, readonly) NSUInteger reusesCount; //!< number of buffers taken from the pool instead of being allocated
+@property(nonatomic, readonly) unsigned long long outstandingBytes; //!< capacity of the buffers currently in use
+@property(nonatomic, readonly) unsigned long long peakOutstandingBytes; //!< the largest outstandingBytes since the last resetCounters
+@property(nonatomic, readonly) unsigned long long pooledBytes; //!< capacity of the free buffers kept in the pool
+/** @brief Get an empty buffer able to hold at least capacity bytes without reallocating
+ * @param capacity the expected size, or 0 if unknown
+ * @return a retained, empty NSMutableData, to give back with recycleBuffer: once done (instead of releasing it)
+ */
+-(NSMutableData*)newBufferWithCapacity:(NSUInteger)capacity;
+/** @brief Give back a buffer obtained from newBufferWithCapacity:, with the reference you got from it
+ * The pool takes over your reference: don't release the buffer afterwards. As it may be handed out again for another
+ * response, nobody must keep a reference to it either: copy the bytes you need to keep.
+ */
+-(void)recycleBuffer:(NSMutableData*)buffer;
+-(void)drain; //!< release the free buffers (e.g. on memory warnings)
+-(void)resetCounters; //!< reset allocationsCount, reusesCount and peakOutstandingBytes
+@end
@@ -0,0 +1,127 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCBufferPool.h"
+
+static const NSUInteger kSmallestSizeClass = 4096;
+
+// Index of the smallest size class able to hold capacity bytes, or JSONRPCBufferPoolSizeClasses if it is too large to be pooled
+static NSUInteger sizeClassIndex(NSUInteger capacity) {
+	NSUInteger index = 0;
+	NSUInteger size = kSmallestSizeClass;
+	while (size < capacity && index < JSONRPCBufferPoolSizeClasses) {
+		size <<= 1;
+		++index;
+	}
+	return index;
+}
+
+@implementation JSONRPCBufferPool
+@synthesize maxBuffersPerSizeClass = _maxBuffersPerSizeClass;
+@synthesize allocationsCount = _allocationsCount, reusesCount = _reusesCount;
+@synthesize outstandingBytes = _outstandingBytes, peakOutstandingBytes = _peakOutstandingBytes, pooledBytes = _pooledBytes;
+
+- (id) init
+{
+	self = [super init];
+	if (self != nil) {
+		pthread_mutex_init(&_lock, NULL);
+		for(NSUInteger i=0; i<JSONRPCBufferPoolSizeClasses; ++i) _freeBuffers[i] = [[NSMutableArray alloc] init];
+		_bufferSizes = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+		_maxBuffersPerSizeClass = 4;
+	}
+	return self;
+}
+
+-(NSMutableData*)newBufferWithCapacity:(NSUInteger)capacity {
+	NSUInteger index = sizeClassIndex(capacity);
+	NSUInteger size = (index < JSONRPCBufferPoolSizeClasses) ? (kSmallestSizeClass << index) : capacity;
+	NSMutableData* buffer = nil;
+	
+	pthread_mutex_lock(&_lock);
+	if (index < JSONRPCBufferPoolSizeClasses && [_freeBuffers[index] count]) {
+		buffer = [[_freeBuffers[index] lastObject] retain];
+		[_freeBuffers[index] removeLastObject];
+		_pooledBytes -= size;
+		++_reusesCount;
+	} else {
+		++_allocationsCount;
+	}
+	_outstandingBytes += size;
+	_peakOutstandingBytes = MAX(_peakOutstandingBytes, _outstandingBytes);
+	pthread_mutex_unlock(&_lock);
+	
+	if (!buffer) buffer = [[NSMutableData alloc] initWithCapacity:size];
+	pthread_mutex_lock(&_lock);
+	CFDictionarySetValue(_bufferSizes, buffer, (const void*)size);
+	pthread_mutex_unlock(&_lock);
+	return buffer;
+}
+
+-(void)recycleBuffer:(NSMutableData*)buffer {
+	if (!buffer) return;
+	pthread_mutex_lock(&_lock);
+	NSUInteger size = (NSUInteger)CFDictionaryGetValue(_bufferSizes, buffer);
+	if (size) {
+		CFDictionaryRemoveValue(_bufferSizes, buffer);
+		_outstandingBytes -= size;
+		NSUInteger index = sizeClassIndex(size); // its capacity is at least that, even if it has not grown
+		if (index < JSONRPCBufferPoolSizeClasses && [_freeBuffers[index] count] < _maxBuffersPerSizeClass) {
+			[buffer setLength:0];
+			[_freeBuffers[index] addObject:buffer];
+			_pooledBytes += (kSmallestSizeClass << index);
+		}
+	}
+	pthread_mutex_unlock(&_lock);
+	[buffer release]; // the caller's reference, kept by _freeBuffers if pooled
+}
+
+-(void)drain {
+	pthread_mutex_lock(&_lock);
+	for(NSUInteger i=0; i<JSONRPCBufferPoolSizeClasses; ++i) [_freeBuffers[i] removeAllObjects];
+	_pooledBytes = 0;
+	pthread_mutex_unlock(&_lock);
+}
+
+-(void)resetCounters {
+	pthread_mutex_lock(&_lock);
+	_allocationsCount = 0;
+	_reusesCount = 0;
+	_peakOutstandingBytes = _outstandingBytes;
+	pthread_mutex_unlock(&_lock);
+}
+
+-(void)dealloc {
+	for(NSUInteger i=0; i<JSONRPCBufferPoolSizeClasses; ++i) [_freeBuffers[i] release];
+	CFRelease(_bufferSizes);
+	pthread_mutex_destroy(&_lock);
+	[super dealloc];
+}
+
+@end
@@ -0,0 +1,102 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCCallScheduler.h
+//! @brief Queue that orders and throttles the method calls sent by a JSONRPCService.
+
+@class JSONRPCResponseHandler;
+
+//! Priority classes used to order pending method calls. Higher values are served first.
+typedef enum {
+	JSONRPCCallPriorityBackground, //!< bulk traffic (sync, prefetch, ...) that can wait
+	JSONRPCCallPriorityLow,
+	JSONRPCCallPriorityNormal,     //!< default priority of a method call
+	JSONRPCCallPriorityHigh,       //!< user-facing calls, served before anything else
+	JSONRPCCallPriorityCount       //!< @private number of priority classes
+} JSONRPCCallPriority;
+
+
+
+/** @brief Scheduler sitting between JSONRPCService#callMethod: and the network.
+ *
+ * Each JSONRPCService owns a scheduler (see JSONRPCService#scheduler). Method calls are not sent immediately:
+ * their JSONRPCResponseHandler is enqueued in the FIFO queue of its JSONRPCResponseHandler#priority class, and
+ * the scheduler starts the pending calls, highest priority first, as long as the concurrency limits allow it.
+ *
+ * Pending calls are started on the next run loop iteration, so the JSONRPCResponseHandler returned by
+ * JSONRPCService#callMethod: can still be configured (priority, delegate, ...) before the request goes out.
+ *
+ * By default, Background and Low priority calls can only use part of the connections, so that interactive calls
+ * always find a free slot while bulk traffic absorbs the queueing:
+ * @code
+ * service.scheduler.maxConcurrentCalls = 6;
+ * [service.scheduler setMaxConcurrentCalls:2 forPriority:JSONRPCCallPriorityBackground];
+ * @endcode
+ */
+@interface JSONRPCCallScheduler : NSObject
+{
+	//! @privatesection
+	NSMutableArray* _pendingHandlers[JSONRPCCallPriorityCount];
+	NSMutableArray* _runningHandlers;
+	NSUInteger _runningCounts[JSONRPCCallPriorityCount];
+	NSUInteger _maxConcurrentCallsPerPriority[JSONRPCCallPriorityCount];
+	NSUInteger _maxConcurrentCalls;
+	NSUInteger _hedgesCount;
+	BOOL _drainScheduled;
+}
+/** @brief The maximum number of calls running at the same time on the service. 0 means unlimited.
+ * Defaults to 4, which is the number of connections NSURLConnection opens to the same host anyway.
+ * Hedged requests (see JSONRPCHedgingPolicy) use a slot too.
+ */
+@property(nonatomic, assign) NSUInteger maxConcurrentCalls;
+@property(nonatomic, readonly) NSUInteger runningCallsCount; //!< the number of calls currently waiting for their response
+@property(nonatomic, readonly) NSUInteger pendingCallsCount; //!< the number of calls waiting for a free slot
+
+/** @brief Limit the number of calls of the given priority that can run at the same time.
+ * @param max the maximum number of running calls of this priority class. 0 means only limited by maxConcurrentCalls.
+ * @param priority the priority class to limit
+ * @note Defaults to 1 for JSONRPCCallPriorityBackground, 2 for JSONRPCCallPriorityLow, and no limit for the other classes.
+ */
+-(void)setMaxConcurrentCalls:(NSUInteger)max forPriority:(JSONRPCCallPriority)priority;
+-(NSUInteger)maxConcurrentCallsForPriority:(JSONRPCCallPriority)priority; //!< @see setMaxConcurrentCalls:forPriority:
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Used by the framework
+/////////////////////////////////////////////////////////////////////////////
+
+-(void)enqueueResponseHandler:(JSONRPCResponseHandler*)handler; //!< @internal Queue the handler's request until a slot is free
+-(void)cancelResponseHandler:(JSONRPCResponseHandler*)handler; //!< @internal Remove the handler from the queue, or free its slot if running
+-(void)responseHandlerDidFinish:(JSONRPCResponseHandler*)handler; //!< @internal Free the slot used by the handler
+-(void)responseHandler:(JSONRPCResponseHandler*)handler didChangePriorityFrom:(JSONRPCCallPriority)oldPriority; //!< @internal Move the handler to its new priority class
+-(BOOL)reserveHedgeSlot; //!< @internal YES if a hedged request can be sent now: a slot is free and no call is waiting for one
+-(void)releaseHedgeSlot; //!< @internal Free the slot used by a hedged request
+@end
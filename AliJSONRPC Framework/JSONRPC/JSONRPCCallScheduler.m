@@ -0,0 +1,200 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCCallScheduler.h"
+#import "JSONRPCResponseHandler.h"
+
+#if TARGET_OS_IPHONE
+#import <UIKit/UIKit.h>
+#endif
+
+// Shared by all the schedulers, so that the indicator stays visible while any service is working
+static NSUInteger gNetworkActivityCount = 0;
+static void updateNetworkActivity(NSInteger delta) {
+	gNetworkActivityCount += delta;
+#if TARGET_OS_IPHONE
+	[UIApplication sharedApplication].networkActivityIndicatorVisible = (gNetworkActivityCount>0);
+#endif
+}
+
+//! @private Private API @internal
+@interface JSONRPCCallScheduler()
+-(void)scheduleDrain; //!< @private @internal
+-(void)drain; //!< @private @internal
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCCallScheduler
+@synthesize maxConcurrentCalls = _maxConcurrentCalls;
+
+- (id) init
+{
+	self = [super init];
+	if (self != nil) {
+		for(int p=0; p<JSONRPCCallPriorityCount; ++p) {
+			_pendingHandlers[p] = [[NSMutableArray alloc] init];
+		}
+		_runningHandlers = [[NSMutableArray alloc] init];
+		_maxConcurrentCalls = 4;
+		_maxConcurrentCallsPerPriority[JSONRPCCallPriorityBackground] = 1;
+		_maxConcurrentCallsPerPriority[JSONRPCCallPriorityLow] = 2;
+	}
+	return self;
+}
+
+-(void)dealloc {
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(drain) object:nil];
+	for(int p=0; p<JSONRPCCallPriorityCount; ++p) {
+		[_pendingHandlers[p] release];
+	}
+	updateNetworkActivity(-(NSInteger)([_runningHandlers count]+_hedgesCount));
+	[_runningHandlers release];
+	[super dealloc];
+}
+
+-(void)setMaxConcurrentCalls:(NSUInteger)max {
+	_maxConcurrentCalls = max;
+	[self scheduleDrain];
+}
+-(void)setMaxConcurrentCalls:(NSUInteger)max forPriority:(JSONRPCCallPriority)priority {
+	NSParameterAssert(priority < JSONRPCCallPriorityCount);
+	_maxConcurrentCallsPerPriority[priority] = max;
+	[self scheduleDrain];
+}
+-(NSUInteger)maxConcurrentCallsForPriority:(JSONRPCCallPriority)priority {
+	NSParameterAssert(priority < JSONRPCCallPriorityCount);
+	return _maxConcurrentCallsPerPriority[priority];
+}
+
+-(NSUInteger)runningCallsCount {
+	return [_runningHandlers count];
+}
+-(NSUInteger)pendingCallsCount {
+	NSUInteger n = 0;
+	for(int p=0; p<JSONRPCCallPriorityCount; ++p) n += [_pendingHandlers[p] count];
+	return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Queueing
+/////////////////////////////////////////////////////////////////////////////
+
+-(void)enqueueResponseHandler:(JSONRPCResponseHandler*)handler {
+	[_pendingHandlers[handler.priority] addObject:handler];
+	[self scheduleDrain];
+}
+
+-(void)cancelResponseHandler:(JSONRPCResponseHandler*)handler {
+	for(int p=0; p<JSONRPCCallPriorityCount; ++p) {
+		NSUInteger idx = [_pendingHandlers[p] indexOfObjectIdenticalTo:handler];
+		if (idx != NSNotFound) {
+			[_pendingHandlers[p] removeObjectAtIndex:idx];
+			return;
+		}
+	}
+	[self responseHandlerDidFinish:handler];
+}
+
+-(void)responseHandlerDidFinish:(JSONRPCResponseHandler*)handler {
+	NSUInteger idx = [_runningHandlers indexOfObjectIdenticalTo:handler];
+	if (idx == NSNotFound) return;
+	
+	--_runningCounts[handler.priority];
+	[[handler retain] autorelease]; // the caller may still be using it
+	[_runningHandlers removeObjectAtIndex:idx];
+	updateNetworkActivity(-1);
+	[self scheduleDrain];
+}
+
+-(void)responseHandler:(JSONRPCResponseHandler*)handler didChangePriorityFrom:(JSONRPCCallPriority)oldPriority {
+	JSONRPCCallPriority newPriority = handler.priority;
+	if (newPriority == oldPriority) return;
+	
+	NSUInteger idx = [_pendingHandlers[oldPriority] indexOfObjectIdenticalTo:handler];
+	if (idx != NSNotFound) {
+		[handler retain];
+		[_pendingHandlers[oldPriority] removeObjectAtIndex:idx];
+		[_pendingHandlers[newPriority] addObject:handler];
+		[handler release];
+		[self scheduleDrain];
+	} else if ([_runningHandlers indexOfObjectIdenticalTo:handler] != NSNotFound) {
+		--_runningCounts[oldPriority];
+		++_runningCounts[newPriority];
+	}
+}
+
+-(BOOL)reserveHedgeSlot {
+	// a hedge must never delay a call that has not been sent at all
+	if (self.pendingCallsCount) return NO;
+	if (_maxConcurrentCalls && [_runningHandlers count]+_hedgesCount >= _maxConcurrentCalls) return NO;
+	++_hedgesCount;
+	updateNetworkActivity(+1);
+	return YES;
+}
+
+-(void)releaseHedgeSlot {
+	if (!_hedgesCount) return;
+	--_hedgesCount;
+	updateNetworkActivity(-1);
+	[self scheduleDrain];
+}
+
+-(void)scheduleDrain {
+	if (_drainScheduled) return;
+	_drainScheduled = YES;
+	// Wait for the next run loop iteration so that the caller can finish configuring its JSONRPCResponseHandler
+	[self performSelector:@selector(drain) withObject:nil afterDelay:0];
+}
+
+-(void)drain {
+	_drainScheduled = NO;
+	
+	while (!_maxConcurrentCalls || [_runningHandlers count]+_hedgesCount < _maxConcurrentCalls)
+	{
+		// Pick the oldest pending handler of the highest priority class that still has a free slot
+		JSONRPCResponseHandler* next = nil;
+		for(int p=JSONRPCCallPriorityCount-1; p>=0 && !next; --p) {
+			NSUInteger classMax = _maxConcurrentCallsPerPriority[p];
+			if ([_pendingHandlers[p] count] && (!classMax || _runningCounts[p] < classMax)) {
+				next = [_pendingHandlers[p] objectAtIndex:0];
+			}
+		}
+		if (!next) break;
+		
+		[_runningHandlers addObject:next];
+		[_pendingHandlers[next.priority] removeObjectAtIndex:0];
+		++_runningCounts[next.priority];
+		updateNetworkActivity(+1);
+		[next startConnection];
+	}
+}
+
+@end
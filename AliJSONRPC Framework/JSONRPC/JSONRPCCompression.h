@@ -0,0 +1,125 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+#include <zlib.h>
+
+//! @file JSONRPCCompression.h
+//! @brief gzip/deflate compression of the requests and streaming inflation of the responses. Requires linking with libz.
+
+//! Content-Encoding used to compress the request bodies (see JSONRPCService#requestContentEncoding)
+typedef enum {
+	JSONRPCContentEncodingGzip,   //!< "gzip" (RFC 1952)
+	JSONRPCContentEncodingDeflate //!< "deflate", i.e. zlib format (RFC 1950)
+} JSONRPCContentEncoding;
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Statistics
+/////////////////////////////////////////////////////////////////////////////
+
+/** @brief Compression statistics of a JSONRPCService (see JSONRPCService#compressionStats)
+ * Ratios are uncompressed size / compressed size, so 5 means the data was 5 times smaller on the wire.
+ * Times are the CPU time spent compressing or inflating, in seconds.
+ */
+@interface JSONRPCCompressionStats : NSObject
+{
+	//! @privatesection
+	NSUInteger _compressedRequestsCount;
+	unsigned long long _requestBytes;
+	unsigned long long _compressedRequestBytes;
+	NSTimeInterval _compressionTime;
+	NSUInteger _inflatedResponsesCount;
+	unsigned long long _compressedResponseBytes;
+	unsigned long long _responseBytes;
+	NSTimeInterval _inflationTime;
+}
+@property(nonatomic, readonly) NSUInteger compressedRequestsCount; //!< number of request bodies sent compressed
+@property(nonatomic, readonly) unsigned long long requestBytes; //!< size of the compressed request bodies before compression
+@property(nonatomic, readonly) unsigned long long compressedRequestBytes; //!< size of the compressed request bodies after compression
+@property(nonatomic, readonly) NSTimeInterval compressionTime; //!< CPU time spent compressing request bodies
+@property(nonatomic, readonly) NSUInteger inflatedResponsesCount; //!< number of compressed responses inflated by the framework
+@property(nonatomic, readonly) unsigned long long compressedResponseBytes; //!< size of the compressed responses as received
+@property(nonatomic, readonly) unsigned long long responseBytes; //!< size of the compressed responses after inflation
+@property(nonatomic, readonly) NSTimeInterval inflationTime; //!< CPU time spent inflating responses
+@property(nonatomic, readonly) double requestCompressionRatio; //!< requestBytes / compressedRequestBytes
+@property(nonatomic, readonly) double responseCompressionRatio; //!< responseBytes / compressedResponseBytes
+-(void)reset; //!< reset all the statistics to zero
+
+-(void)recordCompressionOf:(NSUInteger)length into:(NSUInteger)compressedLength time:(NSTimeInterval)cpuTime; //!< @internal
+-(void)recordInflationOf:(NSUInteger)compressedLength into:(NSUInteger)length time:(NSTimeInterval)cpuTime; //!< @internal
+-(void)recordInflatedResponse; //!< @internal
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Compression
+/////////////////////////////////////////////////////////////////////////////
+
+//! zlib helpers used by JSONRPCService to compress the request bodies
+@interface JSONRPCCompression : NSObject
++(NSString*)nameOfEncoding:(JSONRPCContentEncoding)encoding; //!< the Content-Encoding HTTP header value for the encoding
+/** @brief Compress data in one shot
+ * @param data the data to compress
+ * @param encoding the format of the compressed data
+ * @param stats statistics to update, or nil
+ * @return the compressed data, or nil if zlib failed
+ */
++(NSData*)compressData:(NSData*)data encoding:(JSONRPCContentEncoding)encoding stats:(JSONRPCCompressionStats*)stats;
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Streaming inflation
+/////////////////////////////////////////////////////////////////////////////
+
+/** @brief Inflate a gzip or deflate response as its chunks arrive, so that the whole compressed response is never held in memory.
+ *
+ * The format is detected from the first bytes. As the URL loading system may already have inflated the response itself,
+ * data that does not start with a gzip or zlib header is passed through unchanged.
+ */
+@interface JSONRPCInflater : NSObject
+{
+	//! @privatesection
+	z_stream _stream;
+	int _state; // 0 = not started, 1 = inflating, 2 = passthrough, 3 = done, 4 = error
+	NSError* _error;
+	JSONRPCCompressionStats* _stats;
+}
+-(id)initWithStats:(JSONRPCCompressionStats*)stats; //!< Designed initializer. stats may be nil.
+/** @brief Inflate a chunk of the response
+ * @param chunk the bytes received
+ * @param output the buffer to append the inflated bytes to
+ * @return NO if the data is corrupted (see error). The following chunks are then ignored.
+ */
+-(BOOL)inflateChunk:(NSData*)chunk into:(NSMutableData*)output;
+//! Call when the whole response has been received. Returns nil if it was inflated successfully, or the error.
+-(NSError*)finish;
+@property(nonatomic, readonly) NSError* error; //!< the error that occurred while inflating, if any
+@end
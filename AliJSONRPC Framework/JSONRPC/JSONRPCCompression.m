@@ -0,0 +1,242 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCCompression.h"
+#import "JSONRPCService.h"
+#include <time.h>
+
+enum { kInflaterNotStarted, kInflaterInflating, kInflaterPassthrough, kInflaterDone, kInflaterError };
+static const NSUInteger kInflateBufferSize = 16*1024;
+
+static inline NSTimeInterval cpuTime() {
+	return (NSTimeInterval)clock() / CLOCKS_PER_SEC;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Statistics
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCCompressionStats
+@synthesize compressedRequestsCount = _compressedRequestsCount;
+@synthesize requestBytes = _requestBytes;
+@synthesize compressedRequestBytes = _compressedRequestBytes;
+@synthesize compressionTime = _compressionTime;
+@synthesize inflatedResponsesCount = _inflatedResponsesCount;
+@synthesize compressedResponseBytes = _compressedResponseBytes;
+@synthesize responseBytes = _responseBytes;
+@synthesize inflationTime = _inflationTime;
+
+-(double)requestCompressionRatio {
+	return _compressedRequestBytes ? (double)_requestBytes / _compressedRequestBytes : 0;
+}
+-(double)responseCompressionRatio {
+	return _compressedResponseBytes ? (double)_responseBytes / _compressedResponseBytes : 0;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ requests:%lu ratio:%.2f cpu:%.3fs, responses:%lu ratio:%.2f cpu:%.3fs>",
+			NSStringFromClass([self class]),
+			(unsigned long)_compressedRequestsCount,self.requestCompressionRatio,_compressionTime,
+			(unsigned long)_inflatedResponsesCount,self.responseCompressionRatio,_inflationTime];
+}
+
+-(void)reset {
+	_compressedRequestsCount = _inflatedResponsesCount = 0;
+	_requestBytes = _compressedRequestBytes = _compressedResponseBytes = _responseBytes = 0;
+	_compressionTime = _inflationTime = 0;
+}
+
+-(void)recordCompressionOf:(NSUInteger)length into:(NSUInteger)compressedLength time:(NSTimeInterval)t {
+	++_compressedRequestsCount;
+	_requestBytes += length;
+	_compressedRequestBytes += compressedLength;
+	_compressionTime += t;
+}
+-(void)recordInflationOf:(NSUInteger)compressedLength into:(NSUInteger)length time:(NSTimeInterval)t {
+	_compressedResponseBytes += compressedLength;
+	_responseBytes += length;
+	_inflationTime += t;
+}
+-(void)recordInflatedResponse {
+	++_inflatedResponsesCount;
+}
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Compression
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCCompression
+
++(NSString*)nameOfEncoding:(JSONRPCContentEncoding)encoding {
+	return (encoding == JSONRPCContentEncodingGzip) ? @"gzip" : @"deflate";
+}
+
++(NSData*)compressData:(NSData*)data encoding:(JSONRPCContentEncoding)encoding stats:(JSONRPCCompressionStats*)stats {
+	NSTimeInterval t0 = cpuTime();
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	int windowBits = (encoding == JSONRPCContentEncodingGzip) ? 15+16 : 15;
+	if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) return nil;
+	
+	uLong bound = deflateBound(&strm, [data length]) + 18; // deflateBound does not count the gzip header & trailer
+	NSMutableData* output = [NSMutableData dataWithLength:bound];
+	strm.next_in = (Bytef*)[data bytes];
+	strm.avail_in = (uInt)[data length];
+	strm.next_out = [output mutableBytes];
+	strm.avail_out = (uInt)bound;
+	int ret = deflate(&strm, Z_FINISH);
+	[output setLength:strm.total_out];
+	deflateEnd(&strm);
+	if (ret != Z_STREAM_END) return nil;
+	
+	[stats recordCompressionOf:[data length] into:[output length] time:cpuTime()-t0];
+	return output;
+}
+
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Streaming inflation
+/////////////////////////////////////////////////////////////////////////////
+
+@interface JSONRPCInflater()
+-(void)failWithZlibCode:(int)code; //!< @private
+@end
+
+@implementation JSONRPCInflater
+@synthesize error = _error;
+
+-(id)initWithStats:(JSONRPCCompressionStats*)stats
+{
+	self = [super init];
+	if (self != nil) {
+		_stats = [stats retain];
+	}
+	return self;
+}
+
+-(id)init {
+	return [self initWithStats:nil];
+}
+
+-(void)dealloc {
+	if (_state == kInflaterInflating) inflateEnd(&_stream);
+	[_error release];
+	[_stats release];
+	[super dealloc];
+}
+
+-(void)failWithZlibCode:(int)code {
+	if (_state == kInflaterInflating) inflateEnd(&_stream);
+	_state = kInflaterError;
+	NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCCompressionErrorString" value:JSONRPCCompressionErrorString table:nil];
+	NSDictionary* userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+							  locDesc,NSLocalizedDescriptionKey,
+							  [NSNumber numberWithInt:code],@"zlibErrorCode",
+							  nil];
+	[_error release];
+	_error = [[NSError alloc] initWithDomain:JSONRPCInternalErrorDomain code:JSONRPCCompressionErrorCode userInfo:userInfo];
+}
+
+-(BOOL)inflateChunk:(NSData*)chunk into:(NSMutableData*)output {
+	NSUInteger len = [chunk length];
+	if (!len) return (_state != kInflaterError);
+	
+	if (_state == kInflaterNotStarted) {
+		const unsigned char* b = [chunk bytes];
+		// gzip magic number, or zlib header (deflate method with a 32K window). JSON can start with neither.
+		if (b[0] == 0x1f || b[0] == 0x78) {
+			memset(&_stream, 0, sizeof(_stream));
+			if (inflateInit2(&_stream, 15+32) != Z_OK) { // +32: detect gzip or zlib format automatically
+				[self failWithZlibCode:Z_MEM_ERROR];
+				return NO;
+			}
+			_state = kInflaterInflating;
+			[_stats recordInflatedResponse];
+		} else {
+			_state = kInflaterPassthrough;
+		}
+	}
+	
+	switch (_state) {
+		case kInflaterPassthrough:
+			[output appendData:chunk];
+			return YES;
+		case kInflaterInflating:
+			break;
+		case kInflaterDone:
+			return YES; // ignore trailing garbage
+		default:
+			return NO;
+	}
+	
+	NSTimeInterval t0 = cpuTime();
+	NSUInteger initialLength = [output length];
+	_stream.next_in = (Bytef*)[chunk bytes];
+	_stream.avail_in = (uInt)len;
+	int ret = Z_OK;
+	while (ret == Z_OK && (_stream.avail_in || !_stream.avail_out)) {
+		NSUInteger offset = [output length];
+		[output increaseLengthBy:kInflateBufferSize];
+		_stream.next_out = (Bytef*)[output mutableBytes] + offset;
+		_stream.avail_out = (uInt)kInflateBufferSize;
+		ret = inflate(&_stream, Z_NO_FLUSH);
+		[output setLength:offset + kInflateBufferSize - _stream.avail_out];
+	}
+	[_stats recordInflationOf:len into:[output length]-initialLength time:cpuTime()-t0];
+	
+	if (ret == Z_STREAM_END) {
+		inflateEnd(&_stream);
+		_state = kInflaterDone;
+	} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+		[self failWithZlibCode:ret];
+		return NO;
+	}
+	return YES;
+}
+
+-(NSError*)finish {
+	if (_state == kInflaterInflating) {
+		// the response ended before the end of the compressed stream
+		[self failWithZlibCode:Z_DATA_ERROR];
+	}
+	return _error;
+}
+
+@end
@@ -0,0 +1,101 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCHedgingPolicy.h
+//! @brief Policy to send duplicate requests for slow idempotent method calls.
+
+@class JSONRPCMethodCall;
+
+/** @brief Opt-in policy to cut the tail latency of idempotent method calls (see JSONRPCService#hedgingPolicy)
+ *
+ * When an idempotent method call did not receive its response after a given delay, a duplicate (a "hedged" request)
+ * is sent, optionally to another endpoint (hedgeURL). The first valid response is used, the other request is cancelled,
+ * and the JSONRPCResponseHandler still calls its delegate or completion block only once.
+ *
+ * The delay is the given percentile of the recent latencies of the method, so that only the slowest calls are hedged.
+ * Until enough latencies have been measured, defaultDelay is used.
+ *
+ * To keep the extra load bounded, at most maxHedgeRatio of the hedgeable calls are duplicated; the counters
+ * (hedgeableCallsCount, hedgesSentCount, ...) let you monitor it. A hedged request also needs a free slot in the
+ * JSONRPCService#scheduler: it is not sent while other calls are waiting for a connection.
+ * @code
+ * JSONRPCHedgingPolicy* hedging = [JSONRPCHedgingPolicy policyWithIdempotentMethods:[NSSet setWithObjects:@"getUser",@"search",nil]];
+ * hedging.percentile = 0.95;
+ * service.hedgingPolicy = hedging;
+ * @endcode
+ */
+@interface JSONRPCHedgingPolicy : NSObject
+{
+	//! @privatesection
+	NSSet* _idempotentMethods;
+	NSURL* _hedgeURL;
+	double _percentile;
+	NSTimeInterval _defaultDelay;
+	NSTimeInterval _minimumDelay;
+	NSUInteger _samplesCount;
+	double _maxHedgeRatio;
+	NSMutableDictionary* _latencies; // method name -> NSMutableData of NSTimeInterval (ring buffer)
+	
+	NSUInteger _hedgeableCallsCount;
+	NSUInteger _hedgesSentCount;
+	NSUInteger _hedgesWonCount;
+	NSUInteger _hedgesSkippedCount;
+}
+@property(nonatomic, copy) NSSet* idempotentMethods; //!< names of the methods that can safely be sent twice. Other methods are never hedged.
+@property(nonatomic, retain) NSURL* hedgeURL; //!< URL to send the hedged requests to. nil (the default) to use the same URL as the original request.
+@property(nonatomic, assign) double percentile; //!< the latency percentile (between 0 and 1) after which a request is hedged. Defaults to 0.95.
+@property(nonatomic, assign) NSTimeInterval defaultDelay; //!< delay before hedging while fewer than minimumSamples latencies are known. Defaults to 0.5s.
+@property(nonatomic, assign) NSTimeInterval minimumDelay; //!< the hedge delay is never shorter than this. Defaults to 20ms.
+@property(nonatomic, assign) NSUInteger samplesCount; //!< the number of recent latencies kept per method to compute the percentile. Defaults to 100.
+@property(nonatomic, assign) double maxHedgeRatio; //!< maximum ratio of hedgeable calls that can be hedged. Defaults to 0.1 (10%).
+
+@property(nonatomic, readonly) NSUInteger hedgeableCallsCount; //!< number of calls to idempotent methods seen by the policy
+@property(nonatomic, readonly) NSUInteger hedgesSentCount;     //!< number of hedged requests sent
+@property(nonatomic, readonly) NSUInteger hedgesWonCount;      //!< number of hedged requests that answered before the original request
+@property(nonatomic, readonly) NSUInteger hedgesSkippedCount;  //!< number of hedged requests not sent because of maxHedgeRatio
+
+//! Commodity constructor
++(id)policyWithIdempotentMethods:(NSSet*)methodNames;
+//! Designed initializer
+-(id)initWithIdempotentMethods:(NSSet*)methodNames;
+-(void)resetCounters; //!< reset the hedging counters to zero
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Used by the framework
+/////////////////////////////////////////////////////////////////////////////
+
+-(BOOL)shouldHedgeMethodCall:(JSONRPCMethodCall*)methodCall attempt:(NSUInteger)attempt; //!< @internal YES if the call is idempotent. Counts it as hedgeable on its first attempt (0) only.
+-(NSTimeInterval)hedgeDelayForMethodName:(NSString*)methodName; //!< @internal the delay before sending the hedged request
+-(BOOL)reserveHedge; //!< @internal YES if the hedge budget allows to send a hedged request now. Counts it as sent.
+-(void)hedgeDidWin; //!< @internal the hedged request answered first
+-(void)recordLatency:(NSTimeInterval)latency forMethodName:(NSString*)methodName; //!< @internal
+@end
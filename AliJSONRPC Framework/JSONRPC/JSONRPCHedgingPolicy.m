@@ -0,0 +1,159 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCHedgingPolicy.h"
+#import "JSONRPCMethodCall.h"
+
+// Header of the latencies ring buffer stored in an NSMutableData, followed by samplesCount NSTimeInterval values
+typedef struct {
+	NSUInteger count;
+	NSUInteger next;
+} LatencyRing;
+
+static int compareTimeIntervals(const void* a, const void* b) {
+	NSTimeInterval x = *(const NSTimeInterval*)a, y = *(const NSTimeInterval*)b;
+	return (x<y) ? -1 : (x>y);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCHedgingPolicy
+@synthesize idempotentMethods = _idempotentMethods;
+@synthesize hedgeURL = _hedgeURL;
+@synthesize percentile = _percentile;
+@synthesize defaultDelay = _defaultDelay;
+@synthesize minimumDelay = _minimumDelay;
+@synthesize samplesCount = _samplesCount;
+@synthesize maxHedgeRatio = _maxHedgeRatio;
+@synthesize hedgeableCallsCount = _hedgeableCallsCount;
+@synthesize hedgesSentCount = _hedgesSentCount;
+@synthesize hedgesWonCount = _hedgesWonCount;
+@synthesize hedgesSkippedCount = _hedgesSkippedCount;
+
++(id)policyWithIdempotentMethods:(NSSet*)methodNames {
+	return [[[self alloc] initWithIdempotentMethods:methodNames] autorelease];
+}
+
+-(id)initWithIdempotentMethods:(NSSet*)methodNames
+{
+	self = [super init];
+	if (self != nil) {
+		_idempotentMethods = [methodNames copy];
+		_percentile = 0.95;
+		_defaultDelay = 0.5;
+		_minimumDelay = 0.02;
+		_samplesCount = 100;
+		_maxHedgeRatio = 0.1;
+		_latencies = [[NSMutableDictionary alloc] init];
+	}
+	return self;
+}
+
+-(id)init {
+	return [self initWithIdempotentMethods:nil];
+}
+
+-(void)dealloc {
+	[_idempotentMethods release];
+	[_hedgeURL release];
+	[_latencies release];
+	[super dealloc];
+}
+
+-(void)setSamplesCount:(NSUInteger)count {
+	_samplesCount = MAX(count,1);
+	[_latencies removeAllObjects]; // ring buffers have the old size
+}
+
+-(void)resetCounters {
+	_hedgeableCallsCount = _hedgesSentCount = _hedgesWonCount = _hedgesSkippedCount = 0;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ p%.0f hedgeable:%lu sent:%lu won:%lu skipped:%lu>",NSStringFromClass([self class]),
+			_percentile*100,(unsigned long)_hedgeableCallsCount,(unsigned long)_hedgesSentCount,
+			(unsigned long)_hedgesWonCount,(unsigned long)_hedgesSkippedCount];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Used by the framework
+/////////////////////////////////////////////////////////////////////////////
+
+-(BOOL)shouldHedgeMethodCall:(JSONRPCMethodCall*)methodCall attempt:(NSUInteger)attempt {
+	if (![_idempotentMethods containsObject:methodCall.methodName]) return NO;
+	if (attempt == 0) ++_hedgeableCallsCount; // retries are the same call: don't inflate the budget
+	return YES;
+}
+
+-(BOOL)reserveHedge {
+	if (_hedgesSentCount+1 > _maxHedgeRatio * _hedgeableCallsCount) {
+		++_hedgesSkippedCount;
+		return NO;
+	}
+	++_hedgesSentCount;
+	return YES;
+}
+
+-(void)hedgeDidWin {
+	++_hedgesWonCount;
+}
+
+-(void)recordLatency:(NSTimeInterval)latency forMethodName:(NSString*)methodName {
+	if (![_idempotentMethods containsObject:methodName]) return;
+	
+	NSMutableData* ringData = [_latencies objectForKey:methodName];
+	if (!ringData) {
+		ringData = [NSMutableData dataWithLength:sizeof(LatencyRing) + _samplesCount*sizeof(NSTimeInterval)];
+		[_latencies setObject:ringData forKey:methodName];
+	}
+	LatencyRing* ring = (LatencyRing*)[ringData mutableBytes];
+	NSTimeInterval* samples = (NSTimeInterval*)(ring+1);
+	samples[ring->next] = latency;
+	ring->next = (ring->next+1) % _samplesCount;
+	if (ring->count < _samplesCount) ++ring->count;
+}
+
+-(NSTimeInterval)hedgeDelayForMethodName:(NSString*)methodName {
+	NSData* ringData = [_latencies objectForKey:methodName];
+	const LatencyRing* ring = (const LatencyRing*)[ringData bytes];
+	// wait for enough samples so that the percentile means something
+	if (!ring || ring->count < MIN(_samplesCount,(NSUInteger)20)) return MAX(_defaultDelay,_minimumDelay);
+	
+	NSTimeInterval* sorted = malloc(ring->count * sizeof(NSTimeInterval));
+	memcpy(sorted, ring+1, ring->count * sizeof(NSTimeInterval));
+	qsort(sorted, ring->count, sizeof(NSTimeInterval), compareTimeIntervals);
+	NSUInteger idx = MIN((NSUInteger)(_percentile * ring->count), ring->count-1);
+	NSTimeInterval delay = sorted[idx];
+	free(sorted);
+	
+	return MAX(delay,_minimumDelay);
+}
+
+@end
@@ -0,0 +1,142 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCLoadBalancing.h
+//! @brief Endpoints of a replicated JSON-RPC WebService and strategies to spread the method calls among them.
+
+
+//! Outcome of a request sent to a JSONRPCEndpoint, used to track its health
+typedef enum {
+	JSONRPCAttemptSucceeded,
+	JSONRPCAttemptFailed,    //!< network error or invalid response
+	JSONRPCAttemptCancelled  //!< cancelled by the client (e.g. hedged request that lost the race): does not affect the endpoint health
+} JSONRPCAttemptOutcome;
+
+//! State of the circuit breaker of a JSONRPCEndpoint
+typedef enum {
+	JSONRPCCircuitClosed,   //!< the endpoint is healthy: requests are sent to it
+	JSONRPCCircuitOpen,     //!< the endpoint is failing: no request is sent to it
+	JSONRPCCircuitHalfOpen  //!< the ejection delay has elapsed: a single probe request is allowed to test the endpoint
+} JSONRPCCircuitState;
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Endpoint
+/////////////////////////////////////////////////////////////////////////////
+
+/** @brief One replica of a JSON-RPC WebService (see JSONRPCService#endpoints)
+ *
+ * The endpoint keeps passive health statistics about the requests sent to it, and can act as a circuit breaker
+ * (opt-in: set ejectionThreshold):
+ * - After ejectionThreshold consecutive failures, the circuit opens and the endpoint is ejected: no request is sent to it.
+ *   If no other endpoint is available, method calls fail immediately with the JSONRPCCircuitOpenErrorCode error code.
+ * - After ejectionDuration seconds, the circuit is half-open: a single request is sent to probe the endpoint.
+ * - If the probe succeeds, the circuit closes again; otherwise it opens for another ejectionDuration.
+ *   Requests sent before the circuit opened do not change its state when they end.
+ */
+@interface JSONRPCEndpoint : NSObject
+{
+	//! @privatesection
+	NSURL* _URL;
+	NSUInteger _outstandingRequests;
+	NSTimeInterval _latencyEWMA;
+	NSUInteger _consecutiveFailures;
+	JSONRPCCircuitState _circuitState;
+	CFAbsoluteTime _ejectedUntil;
+	BOOL _probing;
+	NSUInteger _ejectionThreshold;
+	NSTimeInterval _ejectionDuration;
+}
+@property(nonatomic, readonly) NSURL* URL; //!< the URL of the replica
+@property(nonatomic, readonly) NSUInteger outstandingRequests; //!< number of requests sent to this endpoint still waiting for their response
+@property(nonatomic, readonly) NSTimeInterval latencyEWMA; //!< exponentially weighted moving average of the latency of the requests, failed ones counting 1s more. 0 if unknown.
+@property(nonatomic, readonly) NSUInteger consecutiveFailures; //!< number of failed requests since the last successful one
+@property(nonatomic, readonly) JSONRPCCircuitState circuitState; //!< the state of the circuit breaker
+@property(nonatomic, readonly, getter=isEjected) BOOL ejected; //!< YES while the circuit is open because of too many failures
+@property(nonatomic, assign) NSUInteger ejectionThreshold; //!< consecutive failures before ejecting the endpoint. Defaults to 0, which disables ejection.
+@property(nonatomic, assign) NSTimeInterval ejectionDuration; //!< how long a failing endpoint is ejected. Defaults to 30s.
+
+//! Commodity constructor
++(id)endpointWithURL:(NSURL*)url;
+//! Designed initializer
+-(id)initWithURL:(NSURL*)url;
+
+-(BOOL)isAvailable; //!< @internal YES if the circuit breaker allows to send a request to this endpoint now
+-(BOOL)attemptDidStart; //!< @internal a request has been sent to this endpoint. Returns YES if this request is the probe of a half-open circuit.
+-(void)attemptDidEnd:(JSONRPCAttemptOutcome)outcome latency:(NSTimeInterval)latency probe:(BOOL)probe; //!< @internal a request sent to this endpoint has ended. probe is the value returned by attemptDidStart.
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Strategies
+/////////////////////////////////////////////////////////////////////////////
+
+//! Strategy used by a JSONRPCService to choose the endpoint of each request (see JSONRPCService#loadBalancingStrategy)
+@protocol JSONRPCLoadBalancingStrategy <NSObject>
+/** @brief Choose the endpoint to send the next request to.
+ * @param endpoints the JSONRPCEndpoint candidates. Never empty. Endpoints whose circuit is open are already filtered out.
+ * @return the chosen endpoint, which must be one of the candidates.
+ */
+-(JSONRPCEndpoint*)endpointAmongEndpoints:(NSArray*)endpoints;
+@end
+
+//! Send the requests to each endpoint in turn. This is the default strategy.
+@interface JSONRPCRoundRobinStrategy : NSObject <JSONRPCLoadBalancingStrategy>
+{
+	//! @privatesection
+	NSUInteger _next;
+}
+@end
+
+//! Send the request to the endpoint with the fewest requests waiting for their response.
+@interface JSONRPCLeastOutstandingStrategy : NSObject <JSONRPCLoadBalancingStrategy>
+{
+	//! @privatesection
+	NSUInteger _next;
+}
+@end
+
+/** @brief Send the request to the endpoint with the lowest expected latency.
+ *
+ * The expected latency is the JSONRPCEndpoint#latencyEWMA multiplied by the number of outstanding requests (+1),
+ * so that a fast endpoint does not get all the traffic. Endpoints whose latency is unknown yet are assumed to be
+ * as fast as the average of the others: they get their share of the traffic without taking all of it.
+ */
+@interface JSONRPCLatencyEWMAStrategy : NSObject <JSONRPCLoadBalancingStrategy>
+{
+	//! @privatesection
+	NSUInteger _next;
+}
+@end
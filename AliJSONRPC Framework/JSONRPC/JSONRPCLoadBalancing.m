@@ -0,0 +1,194 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCLoadBalancing.h"
+
+static const double kLatencyEWMAWeight = 0.3; // weight of the newest sample
+static const NSTimeInterval kFailureLatencyPenalty = 1.0; // added to the latency of a failed request, so that failing fast does not look fast
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Endpoint
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCEndpoint
+@synthesize URL = _URL;
+@synthesize outstandingRequests = _outstandingRequests;
+@synthesize latencyEWMA = _latencyEWMA;
+@synthesize consecutiveFailures = _consecutiveFailures;
+@synthesize ejectionThreshold = _ejectionThreshold;
+@synthesize ejectionDuration = _ejectionDuration;
+
++(id)endpointWithURL:(NSURL*)url {
+	return [[[self alloc] initWithURL:url] autorelease];
+}
+
+-(id)initWithURL:(NSURL*)url
+{
+	self = [super init];
+	if (self != nil) {
+		_URL = [url retain];
+		_ejectionDuration = 30;
+	}
+	return self;
+}
+
+-(void)dealloc {
+	[_URL release];
+	[super dealloc];
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@ outstanding:%lu latency:%.0fms%@>",NSStringFromClass([self class]),
+			_URL,(unsigned long)_outstandingRequests,_latencyEWMA*1000,self.ejected?@" ejected":@""];
+}
+
+-(JSONRPCCircuitState)circuitState {
+	if (_circuitState == JSONRPCCircuitOpen && _ejectedUntil <= CFAbsoluteTimeGetCurrent()) {
+		_circuitState = JSONRPCCircuitHalfOpen;
+	}
+	return _circuitState;
+}
+
+-(BOOL)isEjected {
+	return (self.circuitState == JSONRPCCircuitOpen);
+}
+
+-(BOOL)isAvailable {
+	switch (self.circuitState) {
+		case JSONRPCCircuitClosed: return YES;
+		case JSONRPCCircuitHalfOpen: return !_probing;
+		default: return NO;
+	}
+}
+
+-(BOOL)attemptDidStart {
+	++_outstandingRequests;
+	if (self.circuitState != JSONRPCCircuitHalfOpen || _probing) return NO;
+	_probing = YES;
+	return YES;
+}
+
+-(void)openCircuit {
+	_circuitState = JSONRPCCircuitOpen;
+	_ejectedUntil = CFAbsoluteTimeGetCurrent() + _ejectionDuration;
+	_consecutiveFailures = 0;
+}
+
+-(void)attemptDidEnd:(JSONRPCAttemptOutcome)outcome latency:(NSTimeInterval)latency probe:(BOOL)probe {
+	if (_outstandingRequests) --_outstandingRequests;
+	if (probe) _probing = NO;
+	
+	if (outcome != JSONRPCAttemptCancelled) {
+		NSTimeInterval sample = (outcome == JSONRPCAttemptFailed) ? latency + kFailureLatencyPenalty : latency;
+		_latencyEWMA = _latencyEWMA ? (kLatencyEWMAWeight*sample + (1-kLatencyEWMAWeight)*_latencyEWMA) : sample;
+	}
+	
+	// only the probe decides the state of a half-open circuit: requests sent before it opened are outdated
+	if (!probe && self.circuitState != JSONRPCCircuitClosed) return;
+	
+	switch (outcome) {
+		case JSONRPCAttemptSucceeded:
+			_consecutiveFailures = 0;
+			_circuitState = JSONRPCCircuitClosed;
+			break;
+		case JSONRPCAttemptFailed:
+			++_consecutiveFailures;
+			if (probe || (_ejectionThreshold && _consecutiveFailures >= _ejectionThreshold)) {
+				[self openCircuit];
+			}
+			break;
+		case JSONRPCAttemptCancelled:
+			break; // a cancelled probe lets another request probe the endpoint
+	}
+}
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Strategies
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCRoundRobinStrategy
+-(JSONRPCEndpoint*)endpointAmongEndpoints:(NSArray*)endpoints {
+	return [endpoints objectAtIndex:(_next++ % [endpoints count])];
+}
+@end
+
+// MARK: -
+
+@implementation JSONRPCLeastOutstandingStrategy
+-(JSONRPCEndpoint*)endpointAmongEndpoints:(NSArray*)endpoints {
+	// start from a rotating index so that ties are spread among endpoints
+	NSUInteger n = [endpoints count];
+	NSUInteger start = _next++ % n;
+	JSONRPCEndpoint* best = nil;
+	for(NSUInteger i=0; i<n; ++i) {
+		JSONRPCEndpoint* ep = [endpoints objectAtIndex:(start+i)%n];
+		if (!best || ep.outstandingRequests < best.outstandingRequests) best = ep;
+	}
+	return best;
+}
+@end
+
+// MARK: -
+
+@implementation JSONRPCLatencyEWMAStrategy
+-(JSONRPCEndpoint*)endpointAmongEndpoints:(NSArray*)endpoints {
+	// endpoints never measured are assumed to be as fast as the average of the others
+	NSTimeInterval latencySum = 0;
+	NSUInteger measuredCount = 0;
+	for(JSONRPCEndpoint* ep in endpoints) {
+		if (ep.latencyEWMA) {
+			latencySum += ep.latencyEWMA;
+			++measuredCount;
+		}
+	}
+	NSTimeInterval defaultLatency = measuredCount ? latencySum/measuredCount : 1; // none measured: least outstanding wins
+	
+	// start from a rotating index so that ties are spread among endpoints
+	NSUInteger n = [endpoints count];
+	NSUInteger start = _next++ % n;
+	JSONRPCEndpoint* best = nil;
+	double bestCost = 0;
+	for(NSUInteger i=0; i<n; ++i) {
+		JSONRPCEndpoint* ep = [endpoints objectAtIndex:(start+i)%n];
+		double cost = (ep.latencyEWMA ?: defaultLatency) * (ep.outstandingRequests+1);
+		if (!best || cost < bestCost) {
+			best = ep;
+			bestCost = cost;
+		}
+	}
+	return best;
+}
+@end
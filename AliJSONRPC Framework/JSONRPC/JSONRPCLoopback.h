@@ -0,0 +1,69 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCLoopback.h
+//! @brief In-process transport, to measure and test the framework without any network.
+
+#if NS_BLOCKS_AVAILABLE
+
+/** @brief Block answering the requests of a JSONRPCService#loopbackHandler, in place of a server.
+ * @param request the HTTP request as it would have been sent: the serialized method call is its HTTPBody.
+ * @param MIMEType set it to the content type of the response (e.g. JSONRPCMessagePackMIMEType) when it differs from the one of
+ *        the request. Left nil, the response has the Content-Type of the request.
+ * @return the body of the response, which is decoded according to its content type (JSON or MessagePack).
+ *         Return nil to simulate a network error (NSURLErrorNetworkConnectionLost), which is retried as usual.
+ */
+typedef NSData* (^JSONRPCLoopbackHandler)(NSURLRequest* request, NSString** MIMEType);
+
+/** @brief Stands for the NSURLConnection of a JSONRPCResponseHandler when its service has a JSONRPCService#loopbackHandler.
+ *
+ * The request is answered by the handler on the next iteration of the run loop, and the reply is delivered through the same
+ * NSURLConnection delegate methods as a response from the network (response, data, finished loading), so that it follows the
+ * normal receive, parse, convert and dispatch path.
+ */
+@interface JSONRPCLoopbackConnection : NSObject
+{
+	//! @privatesection
+	NSURLRequest* _request;
+	id _delegate;
+	JSONRPCLoopbackHandler _handler;
+	BOOL _cancelled;
+}
+/** @brief Designed initializer. The request is answered asynchronously, like with NSURLConnection.
+ * @param request the request to answer
+ * @param delegate the object receiving the NSURLConnection delegate messages. It is retained until the response is delivered or the connection is cancelled.
+ * @param handler the block answering the request
+ */
+-(id)initWithRequest:(NSURLRequest*)request delegate:(id)delegate handler:(JSONRPCLoopbackHandler)handler;
+-(void)cancel; //!< Don't deliver the response
+@end
+
+#endif
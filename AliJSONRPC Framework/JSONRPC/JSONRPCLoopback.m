@@ -0,0 +1,96 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCLoopback.h"
+
+#if NS_BLOCKS_AVAILABLE
+
+@interface JSONRPCLoopbackConnection()
+-(void)deliverResponse; //!< @private @internal
+@end
+
+@implementation JSONRPCLoopbackConnection
+
+-(id)initWithRequest:(NSURLRequest*)request delegate:(id)delegate handler:(JSONRPCLoopbackHandler)handler {
+	self = [super init];
+	if (self != nil) {
+		_request = [request retain];
+		_delegate = [delegate retain];
+		_handler = [handler copy];
+		[self performSelector:@selector(deliverResponse) withObject:nil afterDelay:0];
+	}
+	return self;
+}
+
+-(void)cancel {
+	if (_cancelled) return;
+	_cancelled = YES;
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(deliverResponse) object:nil];
+	[_delegate autorelease]; // we may be cancelled from one of the delegate's callbacks
+	_delegate = nil;
+}
+
+-(void)deliverResponse {
+	if (_cancelled) return;
+	[[self retain] autorelease]; // the delegate may release us from its callbacks
+	id delegate = [[_delegate retain] autorelease];
+	NSURLConnection* connection = (NSURLConnection*)self; // the delegate only compares it to its connections
+	
+	NSString* mimeType = nil;
+	NSData* reply = _handler(_request, &mimeType);
+	if (_cancelled) return;
+	if (!reply) {
+		NSDictionary* userInfo = [NSDictionary dictionaryWithObject:[_request URL] forKey:NSURLErrorFailingURLErrorKey];
+		[delegate connection:connection didFailWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:userInfo]];
+	} else {
+		// unless the handler says otherwise, the reply has the same content type as the request (without the parameters such as charset)
+		if (!mimeType) {
+			mimeType = [[[[_request valueForHTTPHeaderField:@"Content-Type"] componentsSeparatedByString:@";"] objectAtIndex:0]
+						stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+		}
+		NSURLResponse* response = [[NSURLResponse alloc] initWithURL:[_request URL] MIMEType:([mimeType length] ? mimeType : @"application/json")
+											   expectedContentLength:[reply length] textEncodingName:nil];
+		[delegate connection:connection didReceiveResponse:response];
+		[response release];
+		if (!_cancelled) [delegate connection:connection didReceiveData:reply];
+		if (!_cancelled) [delegate connectionDidFinishLoading:connection];
+	}
+	[self cancel]; // done: release the delegate
+}
+
+-(void)dealloc {
+	[_request release];
+	[_delegate release];
+	[_handler release];
+	[super dealloc];
+}
+
+@end
+
+#endif
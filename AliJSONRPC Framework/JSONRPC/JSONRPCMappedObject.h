@@ -0,0 +1,83 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCMappedObject.h
+//! @brief Declarative conversion of JSON objects to instances of your classes (see @ref ResultConversionMapping).
+
+/** @brief How a property of a JSONRPCMappedObject subclass is read from the JSON object (see JSONRPCMappedObject#propertyMappings)
+ */
+@interface JSONRPCPropertyMapping : NSObject
+{
+	//! @privatesection
+	NSString* _propertyName;
+	NSArray* _keys;
+	Class _objectClass;
+	Class _itemsClass;
+}
+@property(nonatomic, readonly) NSString* propertyName;
+@property(nonatomic, readonly) NSArray* keys;     //!< the keys of the value in the JSON object, tried in this order
+@property(nonatomic, readonly) Class objectClass; //!< if not Nil, the value is converted to this class with initWithJson:
+@property(nonatomic, readonly) Class itemsClass;  //!< if not Nil, the value is an array whose items are converted to this class with initWithJson:
+//! The property is read from the given key (instead of the property name)
++(id)mappingForProperty:(NSString*)propertyName key:(NSString*)key;
+//! The property is read from the first of these keys present in the JSON object (e.g. to handle several spellings)
++(id)mappingForProperty:(NSString*)propertyName keys:(NSArray*)keys;
+//! The property is an object of the given class, converted with initWithJson:. Only needed if the class cannot be inferred from the property type.
++(id)mappingForProperty:(NSString*)propertyName key:(NSString*)key objectClass:(Class)objectClass;
+//! The property is an NSArray of objects of the given class, converted with initWithJson:
++(id)mappingForProperty:(NSString*)propertyName key:(NSString*)key itemsClass:(Class)itemsClass;
+//! Designed initializer. key is the first of the keys. objectClass and itemsClass may be Nil.
+-(id)initWithPropertyName:(NSString*)propertyName keys:(NSArray*)keys objectClass:(Class)objectClass itemsClass:(Class)itemsClass;
+@end
+
+
+
+/** @brief Base class of the classes converted from JSON objects, whose properties are declared instead of read in initWithJson:
+ *
+ * Every \@property backed by an instance variable is read from the JSON object key of the same name, unless
+ * propertyMappings declares another key, key aliases, or the class of the array items. Properties whose type is a class
+ * responding to initWithJson: are converted to this class. NSURL properties are created from JSON strings.
+ * Scalar properties (int, BOOL, double, ...) are read from JSON numbers. Values of an unexpected type are ignored.
+ *
+ * The metadata of each class (instance variables, keys and classes) is computed once, on first use. The instance
+ * variables are then filled in a single pass over the JSON object, nested objects included, so the getters are plain accessors.
+ *
+ * @note The instance variables of the mapped properties are released by JSONRPCMappedObject's -dealloc: don't release them in your -dealloc.
+ */
+@interface JSONRPCMappedObject : NSObject
+/** @brief Override to declare the properties which are not read from the key of the same name, or which are arrays of objects.
+ * The other properties are still mapped automatically. Defaults to an empty array.
+ * @return an NSArray of JSONRPCPropertyMapping
+ */
++(NSArray*)propertyMappings;
+-(id)initWithJson:(NSDictionary*)dict; //!< @return nil if dict is not an NSDictionary
+-(id)proxyForJson; //!< the JSON object (with the first key of each property), so that the object can be sent as a parameter
+@end
@@ -0,0 +1,357 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCMappedObject.h"
+#import "JSONRPC_Extensions.h"
+#import <objc/runtime.h>
+#include <pthread.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Property mapping
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCPropertyMapping
+@synthesize propertyName = _propertyName, keys = _keys, objectClass = _objectClass, itemsClass = _itemsClass;
+
++(id)mappingForProperty:(NSString*)propertyName key:(NSString*)key {
+	return [[[self alloc] initWithPropertyName:propertyName keys:[NSArray arrayWithObject:key] objectClass:Nil itemsClass:Nil] autorelease];
+}
++(id)mappingForProperty:(NSString*)propertyName keys:(NSArray*)keys {
+	return [[[self alloc] initWithPropertyName:propertyName keys:keys objectClass:Nil itemsClass:Nil] autorelease];
+}
++(id)mappingForProperty:(NSString*)propertyName key:(NSString*)key objectClass:(Class)objectClass {
+	return [[[self alloc] initWithPropertyName:propertyName keys:[NSArray arrayWithObject:key] objectClass:objectClass itemsClass:Nil] autorelease];
+}
++(id)mappingForProperty:(NSString*)propertyName key:(NSString*)key itemsClass:(Class)itemsClass {
+	return [[[self alloc] initWithPropertyName:propertyName keys:[NSArray arrayWithObject:key] objectClass:Nil itemsClass:itemsClass] autorelease];
+}
+
+-(id)initWithPropertyName:(NSString*)propertyName keys:(NSArray*)keys objectClass:(Class)objectClass itemsClass:(Class)itemsClass {
+	self = [super init];
+	if (self != nil) {
+		_propertyName = [propertyName copy];
+		_keys = [keys copy];
+		_objectClass = objectClass;
+		_itemsClass = itemsClass;
+	}
+	return self;
+}
+
+-(void)dealloc {
+	[_propertyName release];
+	[_keys release];
+	[super dealloc];
+}
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Class metadata
+/////////////////////////////////////////////////////////////////////////////
+
+// How to fill an instance variable
+typedef struct {
+	ptrdiff_t offset;
+	char type;         // type encoding of the ivar: '@' for objects, or a scalar type
+	Class valueClass;  // the class of an object property, Nil for id
+	Class objectClass; // converted with initWithJson:
+	Class itemsClass;  // array items converted with initWithJson:
+	NSString* key;     // the main key, used by proxyForJson
+} MappedIvar;
+
+//! @private The metadata of a JSONRPCMappedObject subclass
+@interface JSONRPCClassMapping : NSObject {
+@public
+	MappedIvar* _ivars;
+	NSUInteger _count;
+	CFMutableDictionaryRef _keys; // JSON key -> (ivar index << 8 | alias rank) + 1
+}
+-(id)initWithClass:(Class)cls;
+@end
+
+@implementation JSONRPCClassMapping
+
+// Class of an object property, from its attributes (e.g. T@"NSString",R,N,V_name)
+static Class propertyClass(const char* attributes) {
+	if (strncmp(attributes, "T@\"", 3)) return Nil;
+	const char* start = attributes + 3;
+	const char* end = strchr(start, '"');
+	if (!end) return Nil;
+	char name[256];
+	size_t len = MIN((size_t)(end - start), sizeof(name) - 1);
+	memcpy(name, start, len);
+	name[len] = '\0';
+	return objc_getClass(name);
+}
+
+// Name of the ivar backing a property, from its attributes
+static NSString* propertyIvarName(const char* attributes) {
+	const char* v = strstr(attributes, ",V");
+	return v ? [NSString stringWithUTF8String:v+2] : nil;
+}
+
+static BOOL isFoundationValueClass(Class cls) {
+	return [cls isSubclassOfClass:[NSString class]] || [cls isSubclassOfClass:[NSNumber class]] || [cls isSubclassOfClass:[NSArray class]]
+		|| [cls isSubclassOfClass:[NSDictionary class]] || [cls isSubclassOfClass:[NSNull class]] || [cls isSubclassOfClass:[NSURL class]];
+}
+
+-(id)initWithClass:(Class)cls {
+	self = [super init];
+	if (self != nil) {
+		// default mappings: every property with an ivar, from its name
+		NSMutableDictionary* mappings = [NSMutableDictionary dictionary]; // property name -> JSONRPCPropertyMapping
+		NSMutableDictionary* ivarNames = [NSMutableDictionary dictionary];
+		NSMutableDictionary* valueClasses = [NSMutableDictionary dictionary];
+		for(Class c = cls; c && c != [JSONRPCMappedObject class]; c = class_getSuperclass(c)) {
+			unsigned int n = 0;
+			objc_property_t* props = class_copyPropertyList(c, &n);
+			for(unsigned int i=0; i<n; ++i) {
+				NSString* name = [NSString stringWithUTF8String:property_getName(props[i])];
+				if ([mappings objectForKey:name]) continue; // overridden in a subclass
+				const char* attributes = property_getAttributes(props[i]);
+				NSString* ivarName = propertyIvarName(attributes) ?: [@"_" stringByAppendingString:name];
+				Class valueClass = propertyClass(attributes);
+				[ivarNames setObject:ivarName forKey:name];
+				if (valueClass) [valueClasses setObject:valueClass forKey:name];
+				[mappings setObject:[JSONRPCPropertyMapping mappingForProperty:name key:name] forKey:name];
+			}
+			free(props);
+		}
+		for(JSONRPCPropertyMapping* m in [cls propertyMappings]) [mappings setObject:m forKey:m.propertyName];
+		
+		_ivars = calloc(MAX([mappings count],1), sizeof(MappedIvar));
+		_keys = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+		for(NSString* name in mappings) {
+			JSONRPCPropertyMapping* m = [mappings objectForKey:name];
+			NSString* ivarName = [ivarNames objectForKey:name] ?: [@"_" stringByAppendingString:name];
+			Ivar ivar = class_getInstanceVariable(cls, [ivarName UTF8String]) ?: class_getInstanceVariable(cls, [name UTF8String]);
+			if (!ivar || ![m.keys count]) {
+				NSLog(@"%@ warning: no instance variable to store the property %@ of %@", [self class], name, cls);
+				continue;
+			}
+			MappedIvar* iv = &_ivars[_count];
+			iv->offset = ivar_getOffset(ivar);
+			iv->type = ivar_getTypeEncoding(ivar)[0];
+			iv->valueClass = [valueClasses objectForKey:name];
+			iv->itemsClass = m.itemsClass;
+			iv->objectClass = m.objectClass;
+			if (!iv->objectClass && !iv->itemsClass && iv->valueClass && !isFoundationValueClass(iv->valueClass)
+				&& [iv->valueClass instancesRespondToSelector:@selector(initWithJson:)]) {
+				iv->objectClass = iv->valueClass;
+			}
+			iv->key = [[m.keys objectAtIndex:0] copy];
+			NSUInteger rank = 0;
+			for(NSString* key in m.keys) {
+				uintptr_t entry = ((_count << 8) | MIN(rank,254)) + 1;
+				if (!CFDictionaryContainsKey(_keys, key)) CFDictionarySetValue(_keys, key, (const void*)entry);
+				++rank;
+			}
+			++_count;
+		}
+	}
+	return self;
+}
+
+-(void)dealloc {
+	for(NSUInteger i=0; i<_count; ++i) [_ivars[i].key release];
+	free(_ivars);
+	if (_keys) CFRelease(_keys);
+	[super dealloc];
+}
+@end
+
+// Metadata cache (Class -> JSONRPCClassMapping)
+static CFMutableDictionaryRef gClassMappings = NULL;
+static pthread_mutex_t gClassMappingsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static JSONRPCClassMapping* mappingForClass(Class cls) {
+	pthread_mutex_lock(&gClassMappingsLock);
+	if (!gClassMappings) gClassMappings = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+	JSONRPCClassMapping* mapping = (JSONRPCClassMapping*)CFDictionaryGetValue(gClassMappings, cls);
+	pthread_mutex_unlock(&gClassMappingsLock);
+	if (mapping) return mapping;
+	
+	// built outside of the lock, as it calls +propertyMappings
+	JSONRPCClassMapping* newMapping = [[JSONRPCClassMapping alloc] initWithClass:cls];
+	pthread_mutex_lock(&gClassMappingsLock);
+	mapping = (JSONRPCClassMapping*)CFDictionaryGetValue(gClassMappings, cls);
+	if (!mapping) {
+		CFDictionarySetValue(gClassMappings, cls, newMapping);
+		mapping = newMapping;
+	}
+	pthread_mutex_unlock(&gClassMappingsLock);
+	[newMapping release];
+	return mapping;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Conversion
+/////////////////////////////////////////////////////////////////////////////
+
+// The value to store in an object ivar (retained), or nil if the JSON value does not have the expected type
+static id objectValue(id value, const MappedIvar* iv) {
+	if (value == [NSNull null]) return nil;
+	if (iv->itemsClass) {
+		return [value isKindOfClass:[NSArray class]] ? [[NSArray alloc] initWithJson:value itemsClass:iv->itemsClass] : nil;
+	}
+	if (iv->objectClass) return [[iv->objectClass alloc] initWithJson:value];
+	if (iv->valueClass == [NSURL class]) {
+		return [value isKindOfClass:[NSString class]] ? [[NSURL alloc] initWithString:value] : nil;
+	}
+	if (!iv->valueClass || [value isKindOfClass:iv->valueClass]) return [value retain];
+	if (iv->valueClass == [NSString class] && [value isKindOfClass:[NSNumber class]]) return [[value stringValue] retain];
+	return nil;
+}
+
+static void setScalar(void* ivar, char type, NSNumber* n) {
+	switch (type) {
+		case 'c': *(char*)ivar = [n boolValue]; break; // BOOL
+		case 'B': *(bool*)ivar = [n boolValue]; break;
+		case 'C': *(unsigned char*)ivar = [n unsignedCharValue]; break;
+		case 's': *(short*)ivar = [n shortValue]; break;
+		case 'S': *(unsigned short*)ivar = [n unsignedShortValue]; break;
+		case 'i': *(int*)ivar = [n intValue]; break;
+		case 'I': *(unsigned int*)ivar = [n unsignedIntValue]; break;
+		case 'l': *(long*)ivar = [n longValue]; break;
+		case 'L': *(unsigned long*)ivar = [n unsignedLongValue]; break;
+		case 'q': *(long long*)ivar = [n longLongValue]; break;
+		case 'Q': *(unsigned long long*)ivar = [n unsignedLongLongValue]; break;
+		case 'f': *(float*)ivar = [n floatValue]; break;
+		case 'd': *(double*)ivar = [n doubleValue]; break;
+		default: break;
+	}
+}
+
+static NSNumber* scalarValue(const void* ivar, char type) {
+	switch (type) {
+		case 'c': return [NSNumber numberWithBool:*(const char*)ivar]; // BOOL
+		case 'B': return [NSNumber numberWithBool:*(const bool*)ivar];
+		case 'C': return [NSNumber numberWithUnsignedChar:*(const unsigned char*)ivar];
+		case 's': return [NSNumber numberWithShort:*(const short*)ivar];
+		case 'S': return [NSNumber numberWithUnsignedShort:*(const unsigned short*)ivar];
+		case 'i': return [NSNumber numberWithInt:*(const int*)ivar];
+		case 'I': return [NSNumber numberWithUnsignedInt:*(const unsigned int*)ivar];
+		case 'l': return [NSNumber numberWithLong:*(const long*)ivar];
+		case 'L': return [NSNumber numberWithUnsignedLong:*(const unsigned long*)ivar];
+		case 'q': return [NSNumber numberWithLongLong:*(const long long*)ivar];
+		case 'Q': return [NSNumber numberWithUnsignedLongLong:*(const unsigned long long*)ivar];
+		case 'f': return [NSNumber numberWithFloat:*(const float*)ivar];
+		case 'd': return [NSNumber numberWithDouble:*(const double*)ivar];
+		default: return nil;
+	}
+}
+
+typedef struct {
+	id object;
+	JSONRPCClassMapping* mapping;
+	uint8_t* ranks; // rank of the key each ivar was read from, so that the first alias present wins
+} FillContext;
+
+static void fillIvar(const void* key, const void* value, void* context) {
+	FillContext* ctx = context;
+	uintptr_t entry = (uintptr_t)CFDictionaryGetValue(ctx->mapping->_keys, key);
+	if (!entry) return;
+	--entry;
+	NSUInteger index = entry >> 8;
+	uint8_t rank = entry & 0xFF;
+	if (rank >= ctx->ranks[index]) return;
+	
+	const MappedIvar* iv = &ctx->mapping->_ivars[index];
+	char* ivar = (char*)ctx->object + iv->offset;
+	if (iv->type == '@') {
+		id obj = objectValue((id)value, iv);
+		if (!obj && value != [NSNull null]) return; // unexpected type: a lower-ranked key may do better
+		[*(id*)ivar release];
+		*(id*)ivar = obj;
+	} else {
+		id n = (id)value;
+		if ([n isKindOfClass:[NSString class]]) n = [NSDecimalNumber decimalNumberWithString:n];
+		if (![n isKindOfClass:[NSNumber class]]) return;
+		setScalar(ivar, iv->type, n);
+	}
+	ctx->ranks[index] = rank;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Mapped object
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCMappedObject
+
++(NSArray*)propertyMappings {
+	return [NSArray array];
+}
+
+-(id)initWithJson:(NSDictionary*)dict {
+	if (![dict isKindOfClass:[NSDictionary class]]) {
+		[self release];
+		return nil;
+	}
+	self = [super init];
+	if (self != nil) {
+		JSONRPCClassMapping* mapping = mappingForClass([self class]);
+		uint8_t stackRanks[64];
+		uint8_t* ranks = (mapping->_count <= sizeof(stackRanks)) ? stackRanks : malloc(mapping->_count);
+		memset(ranks, 0xFF, mapping->_count);
+		FillContext ctx = { self, mapping, ranks };
+		CFDictionaryApplyFunction((CFDictionaryRef)dict, fillIvar, &ctx);
+		if (ranks != stackRanks) free(ranks);
+	}
+	return self;
+}
+
+-(id)proxyForJson {
+	JSONRPCClassMapping* mapping = mappingForClass([self class]);
+	NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:mapping->_count];
+	for(NSUInteger i=0; i<mapping->_count; ++i) {
+		const MappedIvar* iv = &mapping->_ivars[i];
+		const char* ivar = (const char*)self + iv->offset;
+		id value = (iv->type == '@') ? *(id*)ivar : scalarValue(ivar, iv->type);
+		if ([value isKindOfClass:[NSURL class]]) value = [value absoluteString];
+		if (value) [dict setObject:value forKey:iv->key];
+	}
+	return dict;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@>",NSStringFromClass([self class]),[self proxyForJson]];
+}
+
+-(void)dealloc {
+	JSONRPCClassMapping* mapping = mappingForClass([self class]);
+	for(NSUInteger i=0; i<mapping->_count; ++i) {
+		if (mapping->_ivars[i].type == '@') [*(id*)((char*)self + mapping->_ivars[i].offset) release];
+	}
+	[super dealloc];
+}
+
+@end
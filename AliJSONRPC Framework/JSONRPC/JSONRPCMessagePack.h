@@ -0,0 +1,63 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCMessagePack.h
+//! @brief MessagePack binary encoding of the JSON object model, used as an alternative to JSON text (see JSONRPCService#contentType).
+
+extern NSString* const JSONRPCMessagePackErrorDomain; //!< domain of the errors returned by JSONRPCMessagePack
+extern NSString* const JSONRPCMessagePackMIMEType;    //!< "application/msgpack"
+
+/** @brief MessagePack (http://msgpack.org) encoder and decoder.
+ *
+ * Objects are mapped the same way as with the JSON parser and writer, so the rest of the framework
+ * (JSONRPCMethodCall#proxyForJson, JSONInitializer, resultClass conversion, ...) works unchanged:
+ *  - NSDictionary <-> map, NSArray <-> array, NSString <-> str, NSNull <-> nil
+ *  - NSNumber <-> int, float or bool (an NSNumber created with numberWithBool: is encoded as a bool, as with the JSON writer)
+ *  - NSData <-> bin: raw binary data is sent as is, instead of being base64-encoded in a JSON string
+ *  - other objects are encoded using their proxyForJson representation
+ *
+ * Numbers are encoded in binary, so neither formatting nor parsing them is needed, which makes this encoding
+ * especially faster than JSON for numeric-heavy payloads.
+ */
+@interface JSONRPCMessagePack : NSObject
+/** @brief Encode an object
+ * @param object the object to encode
+ * @param error if non-NULL, set to the reason of the failure if the object could not be encoded
+ * @return the MessagePack data, or nil on error
+ */
++(NSData*)dataWithObject:(id)object error:(NSError**)error;
+/** @brief Decode MessagePack data
+ * @param data the MessagePack data, containing a single object
+ * @param error if non-NULL, set to the reason of the failure if the data is invalid
+ * @return the decoded object (with mutable containers, as with the JSON parser), or nil on error
+ */
++(id)objectWithData:(NSData*)data error:(NSError**)error;
+@end
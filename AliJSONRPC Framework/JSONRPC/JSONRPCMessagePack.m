@@ -0,0 +1,294 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCMessagePack.h"
+
+NSString* const JSONRPCMessagePackErrorDomain = @"JSONRPCMessagePackError";
+NSString* const JSONRPCMessagePackMIMEType = @"application/msgpack";
+
+static const NSUInteger kMaxDepth = 512; // same default as the JSON parser
+
+static NSError* mpError(NSString* description) {
+	return [NSError errorWithDomain:JSONRPCMessagePackErrorDomain code:1
+						   userInfo:[NSDictionary dictionaryWithObject:description forKey:NSLocalizedDescriptionKey]];
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Encoder
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+	NSMutableData* data;
+	NSUInteger depth;
+	NSString* failure;
+} MPWriter;
+
+static inline void mpAppend(MPWriter* w, const void* bytes, NSUInteger len) {
+	[w->data appendBytes:bytes length:len];
+}
+static inline void mpAppendByte(MPWriter* w, uint8_t b) {
+	mpAppend(w, &b, 1);
+}
+static inline void mpAppendTyped(MPWriter* w, uint8_t type, uint64_t value, int size) {
+	uint8_t buf[9];
+	buf[0] = type;
+	for(int i=0; i<size; ++i) buf[1+i] = (uint8_t)(value >> (8*(size-1-i))); // big endian
+	mpAppend(w, buf, 1+size);
+}
+
+// Header of a str/bin/array/map, choosing the smallest format. types = { fix, 8, 16, 32 } (0 if the format does not exist)
+static void mpAppendHeader(MPWriter* w, NSUInteger len, uint8_t fixType, NSUInteger fixMax, uint8_t type8, uint8_t type16, uint8_t type32) {
+	if (fixType && len <= fixMax) mpAppendByte(w, fixType | (uint8_t)len);
+	else if (type8 && len <= 0xFF) mpAppendTyped(w, type8, len, 1);
+	else if (len <= 0xFFFF) mpAppendTyped(w, type16, len, 2);
+	else mpAppendTyped(w, type32, len, 4);
+}
+
+static void mpAppendNumber(MPWriter* w, NSNumber* n) {
+	char t = *[n objCType];
+	if (t == 'c') {
+		mpAppendByte(w, [n boolValue] ? 0xc3 : 0xc2);
+	} else if (t == 'f') {
+		union { float f; uint32_t u; } v = { [n floatValue] };
+		mpAppendTyped(w, 0xca, v.u, 4);
+	} else if (t == 'd') {
+		union { double d; uint64_t u; } v = { [n doubleValue] };
+		mpAppendTyped(w, 0xcb, v.u, 8);
+	} else if (t == 'Q' && [n unsignedLongLongValue] > INT64_MAX) {
+		mpAppendTyped(w, 0xcf, [n unsignedLongLongValue], 8);
+	} else {
+		int64_t i = [n longLongValue];
+		if (i >= 0) {
+			if (i <= 0x7F) mpAppendByte(w, (uint8_t)i);
+			else if (i <= 0xFF) mpAppendTyped(w, 0xcc, i, 1);
+			else if (i <= 0xFFFF) mpAppendTyped(w, 0xcd, i, 2);
+			else if (i <= 0xFFFFFFFFLL) mpAppendTyped(w, 0xce, i, 4);
+			else mpAppendTyped(w, 0xcf, i, 8);
+		} else {
+			if (i >= -32) mpAppendByte(w, (uint8_t)(int8_t)i);
+			else if (i >= INT8_MIN) mpAppendTyped(w, 0xd0, (uint8_t)(int8_t)i, 1);
+			else if (i >= INT16_MIN) mpAppendTyped(w, 0xd1, (uint16_t)(int16_t)i, 2);
+			else if (i >= INT32_MIN) mpAppendTyped(w, 0xd2, (uint32_t)(int32_t)i, 4);
+			else mpAppendTyped(w, 0xd3, (uint64_t)i, 8);
+		}
+	}
+}
+
+static BOOL mpAppendObject(MPWriter* w, id obj) {
+	if ([obj isKindOfClass:[NSString class]]) {
+		NSUInteger maxLen = [obj maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+		char stackBuf[256];
+		char* buf = (maxLen <= sizeof(stackBuf)) ? stackBuf : malloc(maxLen);
+		NSUInteger len = 0;
+		[obj getBytes:buf maxLength:maxLen usedLength:&len encoding:NSUTF8StringEncoding options:0
+				range:NSMakeRange(0,[obj length]) remainingRange:NULL];
+		mpAppendHeader(w, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+		mpAppend(w, buf, len);
+		if (buf != stackBuf) free(buf);
+		
+	} else if ([obj isKindOfClass:[NSNumber class]]) {
+		mpAppendNumber(w, obj);
+		
+	} else if ([obj isKindOfClass:[NSDictionary class]]) {
+		if (++w->depth > kMaxDepth) { w->failure = @"Nested too deep"; return NO; }
+		mpAppendHeader(w, [obj count], 0x80, 15, 0, 0xde, 0xdf);
+		for(id key in obj) {
+			if (!mpAppendObject(w, key) || !mpAppendObject(w, [obj objectForKey:key])) return NO;
+		}
+		--w->depth;
+		
+	} else if ([obj isKindOfClass:[NSArray class]]) {
+		if (++w->depth > kMaxDepth) { w->failure = @"Nested too deep"; return NO; }
+		mpAppendHeader(w, [obj count], 0x90, 15, 0, 0xdc, 0xdd);
+		for(id item in obj) {
+			if (!mpAppendObject(w, item)) return NO;
+		}
+		--w->depth;
+		
+	} else if ([obj isKindOfClass:[NSNull class]]) {
+		mpAppendByte(w, 0xc0);
+		
+	} else if ([obj isKindOfClass:[NSData class]]) {
+		mpAppendHeader(w, [obj length], 0, 0, 0xc4, 0xc5, 0xc6);
+		mpAppend(w, [obj bytes], [obj length]);
+		
+	} else if ([obj respondsToSelector:@selector(proxyForJson)]) {
+		return mpAppendObject(w, [obj proxyForJson]);
+		
+	} else {
+		w->failure = [NSString stringWithFormat:@"MessagePack serialisation not supported for %@", [obj class]];
+		return NO;
+	}
+	return YES;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Decoder
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+	const uint8_t* p;
+	const uint8_t* end;
+	NSUInteger depth;
+	NSString* failure;
+} MPReader;
+
+static inline BOOL mpCanRead(MPReader* r, NSUInteger len) {
+	if ((NSUInteger)(r->end - r->p) >= len) return YES;
+	r->failure = @"Unexpected end of data";
+	return NO;
+}
+static inline uint64_t mpReadUInt(MPReader* r, int size) {
+	uint64_t v = 0;
+	for(int i=0; i<size; ++i) v = (v << 8) | r->p[i];
+	r->p += size;
+	return v;
+}
+
+static id mpReadObject(MPReader* r);
+
+static id mpReadString(MPReader* r, NSUInteger len) {
+	if (!mpCanRead(r, len)) return nil;
+	NSString* s = [[NSString alloc] initWithBytes:r->p length:len encoding:NSUTF8StringEncoding];
+	if (!s) r->failure = @"Invalid UTF-8 string";
+	r->p += len;
+	return [s autorelease];
+}
+static id mpReadBinary(MPReader* r, NSUInteger len) {
+	if (!mpCanRead(r, len)) return nil;
+	NSData* d = [NSData dataWithBytes:r->p length:len];
+	r->p += len;
+	return d;
+}
+static id mpReadArray(MPReader* r, NSUInteger count) {
+	if (++r->depth > kMaxDepth) { r->failure = @"Nested too deep"; return nil; }
+	if (!mpCanRead(r, count)) return nil; // each item takes at least one byte
+	NSMutableArray* a = [NSMutableArray arrayWithCapacity:count];
+	for(NSUInteger i=0; i<count; ++i) {
+		id item = mpReadObject(r);
+		if (!item) return nil;
+		[a addObject:item];
+	}
+	--r->depth;
+	return a;
+}
+static id mpReadMap(MPReader* r, NSUInteger count) {
+	if (++r->depth > kMaxDepth) { r->failure = @"Nested too deep"; return nil; }
+	if (count > (NSUInteger)(r->end - r->p)/2) { r->failure = @"Unexpected end of data"; return nil; } // each entry takes at least two bytes
+	NSMutableDictionary* d = [NSMutableDictionary dictionaryWithCapacity:count];
+	for(NSUInteger i=0; i<count; ++i) {
+		id key = mpReadObject(r);
+		if (!key) return nil;
+		id value = mpReadObject(r);
+		if (!value) return nil;
+		[d setObject:value forKey:key];
+	}
+	--r->depth;
+	return d;
+}
+
+static id mpReadObject(MPReader* r) {
+	if (!mpCanRead(r, 1)) return nil;
+	uint8_t b = *r->p++;
+	
+	if (b <= 0x7f) return [NSNumber numberWithInt:b];
+	if (b >= 0xe0) return [NSNumber numberWithInt:(int8_t)b];
+	if ((b & 0xf0) == 0x80) return mpReadMap(r, b & 0x0f);
+	if ((b & 0xf0) == 0x90) return mpReadArray(r, b & 0x0f);
+	if ((b & 0xe0) == 0xa0) return mpReadString(r, b & 0x1f);
+	
+	static const int sizes[] = { // size of the value or length following the type byte, from 0xc4 to 0xdf
+		1,2,4, 1,2,4, 4,8, 1,2,4,8, 1,2,4,8, 2,3,5,9,17, 1,2,4, 2,4, 2,4
+	};
+	if (b < 0xc4) {
+		switch (b) {
+			case 0xc0: return [NSNull null];
+			case 0xc2: return [NSNumber numberWithBool:NO];
+			case 0xc3: return [NSNumber numberWithBool:YES];
+			default: r->failure = @"Invalid type"; return nil;
+		}
+	}
+	int size = sizes[b - 0xc4];
+	if (!mpCanRead(r, size)) return nil;
+	switch (b) {
+		case 0xc4: case 0xc5: case 0xc6: return mpReadBinary(r, (NSUInteger)mpReadUInt(r, size));
+		case 0xca: { union { uint32_t u; float f; } v = { (uint32_t)mpReadUInt(r, 4) }; return [NSNumber numberWithFloat:v.f]; }
+		case 0xcb: { union { uint64_t u; double d; } v = { mpReadUInt(r, 8) }; return [NSNumber numberWithDouble:v.d]; }
+		case 0xcc: case 0xcd: case 0xce: return [NSNumber numberWithLongLong:(long long)mpReadUInt(r, size)];
+		case 0xcf: return [NSNumber numberWithUnsignedLongLong:mpReadUInt(r, 8)];
+		case 0xd0: return [NSNumber numberWithInt:(int8_t)mpReadUInt(r, 1)];
+		case 0xd1: return [NSNumber numberWithInt:(int16_t)mpReadUInt(r, 2)];
+		case 0xd2: return [NSNumber numberWithInt:(int32_t)mpReadUInt(r, 4)];
+		case 0xd3: return [NSNumber numberWithLongLong:(int64_t)mpReadUInt(r, 8)];
+		case 0xd9: case 0xda: case 0xdb: return mpReadString(r, (NSUInteger)mpReadUInt(r, size));
+		case 0xdc: case 0xdd: return mpReadArray(r, (NSUInteger)mpReadUInt(r, size));
+		case 0xde: case 0xdf: return mpReadMap(r, (NSUInteger)mpReadUInt(r, size));
+		default:
+			// ext types (0xc7-0xc9, 0xd4-0xd8) have no equivalent in the JSON object model
+			r->failure = @"MessagePack extension types are not supported";
+			return nil;
+	}
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Public API
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCMessagePack
+
++(NSData*)dataWithObject:(id)object error:(NSError**)error {
+	MPWriter w = { [NSMutableData dataWithCapacity:256], 0, nil };
+	if (!mpAppendObject(&w, object)) {
+		if (error) *error = mpError(w.failure);
+		return nil;
+	}
+	return w.data;
+}
+
++(id)objectWithData:(NSData*)data error:(NSError**)error {
+	MPReader r = { [data bytes], (const uint8_t*)[data bytes] + [data length], 0, nil };
+	id obj = mpReadObject(&r);
+	if (obj && r.p != r.end) r.failure = @"Garbage after the MessagePack object";
+	if (r.failure || !obj) {
+		if (error) *error = mpError(r.failure ?: @"Invalid MessagePack data");
+		return nil;
+	}
+	return obj;
+}
+
+@end
@@ -126,5 +126,11 @@
 
 
 -(id)proxyForJson; //!< @return the JSON representation of the JSONRPCMethodCall. @internal
+
+/** @brief The request envelope, encoded in JSON (UTF-8). @internal
+ * Defaults to the JSON representation of proxyForJson. Subclasses can override it to encode the envelope faster,
+ * like the clients generated by SMDGen, which only encode the parameters and the id into an envelope built beforehand.
+ */
+-(NSData*)JSONData;
 @end
 
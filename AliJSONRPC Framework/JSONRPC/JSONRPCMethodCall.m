@@ -174,6 +174,10 @@ static inline NSString* generateUUID() {
 	return [NSDictionary dictionaryWithDictionary:jsonObj];
 }
 
+-(NSData*)JSONData {
+	return [[[self proxyForJson] JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
 -(NSString*)description {
 	NSString* paramsStr;
 	if (!_parameters) {
@@ -0,0 +1,169 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCMetrics.h
+//! @brief Per-call timing records and per-method latency histograms.
+
+@class JSONRPCMethodCall;
+
+//! The phases of a method call, in chronological order (see JSONRPCCallMetrics#durationOfPhase:)
+typedef enum {
+	JSONRPCCallPhaseSerialization, //!< encoding the request envelope (JSON or MessagePack, compression)
+	JSONRPCCallPhaseQueueing,      //!< waiting in the JSONRPCService#scheduler queue
+	JSONRPCCallPhaseRetries,       //!< failed attempts and backoff delays before the last attempt
+	JSONRPCCallPhaseConnect,       //!< from sending the last attempt to receiving the response headers
+	JSONRPCCallPhaseFirstByte,     //!< from the response headers to the first byte of the body
+	JSONRPCCallPhaseTransfer,      //!< from the first to the last byte of the body
+	JSONRPCCallPhaseParsing,       //!< decoding the response (inflation is counted in JSONRPCCallPhaseTransfer)
+	JSONRPCCallPhaseConversion,    //!< converting the result to the resultClass
+	JSONRPCCallPhaseDispatch,      //!< running the delegate callback or completion block
+	JSONRPCCallPhaseCount
+} JSONRPCCallPhase;
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Call metrics
+/////////////////////////////////////////////////////////////////////////////
+
+/** @brief Timings of a single method call, sent to the JSONRPCService#metricsObserver when the call is finished.
+ *
+ * Timestamps are CFAbsoluteTime values, 0 if the phase did not happen (e.g. no response was received).
+ * They are filled by the framework.
+ */
+@interface JSONRPCCallMetrics : NSObject
+{
+	//! @privatesection
+	NSString* _methodName;
+	CFAbsoluteTime _callTime, _serializedTime, _sentTime, _attemptTime;
+	CFAbsoluteTime _responseTime, _firstByteTime, _lastByteTime, _parsedTime, _convertedTime, _dispatchedTime;
+	NSUInteger _requestBytes;
+	NSUInteger _responseBytes;
+	NSUInteger _retriesCount;
+	NSError* _error;
+	BOOL _cancelled;
+	BOOL _fromCache;
+}
+@property(nonatomic, copy) NSString* methodName; //!< the name of the JSON-RPC method
+@property(nonatomic, assign) CFAbsoluteTime callTime;       //!< the method was called
+@property(nonatomic, assign) CFAbsoluteTime serializedTime; //!< the request envelope was encoded and queued
+@property(nonatomic, assign) CFAbsoluteTime sentTime;       //!< the first attempt was sent
+@property(nonatomic, assign) CFAbsoluteTime attemptTime;    //!< the last attempt was sent
+@property(nonatomic, assign) CFAbsoluteTime responseTime;   //!< the response headers were received
+@property(nonatomic, assign) CFAbsoluteTime firstByteTime;  //!< the first byte of the response body was received
+@property(nonatomic, assign) CFAbsoluteTime lastByteTime;   //!< the last byte of the response body was received
+@property(nonatomic, assign) CFAbsoluteTime parsedTime;     //!< the response was decoded
+@property(nonatomic, assign) CFAbsoluteTime convertedTime;  //!< the result was converted to the resultClass
+@property(nonatomic, assign) CFAbsoluteTime dispatchedTime; //!< the delegate callback or completion block returned
+@property(nonatomic, assign) NSUInteger requestBytes;  //!< size of the request body, as sent
+@property(nonatomic, assign) NSUInteger responseBytes; //!< size of the response body, as received (before inflation)
+@property(nonatomic, assign) NSUInteger retriesCount;  //!< number of retries after network errors
+@property(nonatomic, retain) NSError* error; //!< the error the call failed with (including errors returned by the server), if any
+@property(nonatomic, assign, getter=isCancelled) BOOL cancelled; //!< YES if the call was cancelled
+@property(nonatomic, assign) BOOL fromCache; //!< YES if the response came from the JSONRPCService#responseCache (no request was sent)
+
+-(NSTimeInterval)durationOfPhase:(JSONRPCCallPhase)phase; //!< duration of the given phase, 0 if it did not happen
+-(NSTimeInterval)totalDuration; //!< from callTime to the end of the last phase that happened
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Observer
+/////////////////////////////////////////////////////////////////////////////
+
+//! Receives the metrics of every method call of a JSONRPCService (see JSONRPCService#metricsObserver)
+@protocol JSONRPCMetricsObserver <NSObject>
+/** @brief Called once per method call, when it is finished (response delivered, error forwarded or call cancelled).
+ * @note Called on the thread of the connection (typically the main thread): keep this method fast.
+ */
+-(void)methodCall:(JSONRPCMethodCall*)methodCall didFinishWithMetrics:(JSONRPCCallMetrics*)metrics;
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Histograms
+/////////////////////////////////////////////////////////////////////////////
+
+/** @brief Immutable snapshot of the latency distribution of a method (see JSONRPCMetricsAggregator#snapshot)
+ * Latencies are bucketed on a logarithmic scale (4 buckets per power of 2), so percentiles are accurate to about 10%.
+ */
+@interface JSONRPCLatencyHistogram : NSObject
+{
+	//! @privatesection
+	NSString* _methodName;
+	NSUInteger _count;
+	NSUInteger _errorsCount;
+	NSTimeInterval _totalLatency;
+	NSTimeInterval _maxLatency;
+	NSTimeInterval _phaseDurations[JSONRPCCallPhaseCount];
+	NSData* _buckets;
+}
+@property(nonatomic, readonly) NSString* methodName;
+@property(nonatomic, readonly) NSUInteger count;       //!< number of calls recorded
+@property(nonatomic, readonly) NSUInteger errorsCount; //!< number of calls that failed
+@property(nonatomic, readonly) NSTimeInterval meanLatency;
+@property(nonatomic, readonly) NSTimeInterval maxLatency;
+-(NSTimeInterval)latencyAtPercentile:(double)percentile; //!< percentile between 0 and 1, e.g. 0.99
+-(NSTimeInterval)meanDurationOfPhase:(JSONRPCCallPhase)phase; //!< where the time goes, on average
+
+-(id)initWithMethodName:(NSString*)name count:(NSUInteger)count errorsCount:(NSUInteger)errorsCount
+		   totalLatency:(NSTimeInterval)total maxLatency:(NSTimeInterval)max
+		 phaseDurations:(const NSTimeInterval*)phaseTotals buckets:(NSData*)buckets; //!< @internal
+@end
+
+/** @brief A JSONRPCMetricsObserver that aggregates the latencies of the calls into per-method histograms.
+ *
+ * Recording is lock-free (atomic counters in a fixed-size table), so snapshot can be called from any thread
+ * while calls are being recorded. Up to 128 distinct methods are tracked separately; calls to further methods are
+ * aggregated under the "*" method name.
+ * @code
+ * JSONRPCMetricsAggregator* metrics = [[[JSONRPCMetricsAggregator alloc] init] autorelease];
+ * service.metricsObserver = metrics;
+ * ...
+ * JSONRPCLatencyHistogram* h = [[metrics snapshot] objectForKey:@"getUser"];
+ * NSLog(@"getUser p99: %.0fms", [h latencyAtPercentile:0.99]*1000);
+ * @endcode
+ */
+@interface JSONRPCMetricsAggregator : NSObject <JSONRPCMetricsObserver>
+{
+	//! @privatesection
+	void* _slots;
+	id<JSONRPCMetricsObserver> _nextObserver;
+}
+@property(nonatomic, retain) id<JSONRPCMetricsObserver> nextObserver; //!< another observer to forward the metrics to, if you also need the individual records
+-(NSDictionary*)snapshot; //!< method name -> JSONRPCLatencyHistogram, for every method called since the creation or the last reset
+-(void)reset; //!< clear the histograms. Calls recorded concurrently with the reset may be partially lost.
+@end
@@ -0,0 +1,298 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCMetrics.h"
+#include <stdatomic.h>
+#include <math.h>
+
+#define kMaxMethods 128
+#define kBucketsPerOctave 4
+#define kBucketsCount 112 // 28 octaves of microseconds: up to ~4.5 minutes
+static NSString* const kOverflowMethodName = @"*";
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Call metrics
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCCallMetrics
+@synthesize methodName = _methodName;
+@synthesize callTime = _callTime, serializedTime = _serializedTime, sentTime = _sentTime, attemptTime = _attemptTime;
+@synthesize responseTime = _responseTime, firstByteTime = _firstByteTime, lastByteTime = _lastByteTime;
+@synthesize parsedTime = _parsedTime, convertedTime = _convertedTime, dispatchedTime = _dispatchedTime;
+@synthesize requestBytes = _requestBytes, responseBytes = _responseBytes, retriesCount = _retriesCount;
+@synthesize error = _error;
+@synthesize cancelled = _cancelled;
+@synthesize fromCache = _fromCache;
+
+-(void)dealloc {
+	[_methodName release];
+	[_error release];
+	[super dealloc];
+}
+
+// the timestamps in chronological order: phase i goes from timestamps[i] to timestamps[i+1]
+-(void)getTimestamps:(CFAbsoluteTime*)t {
+	t[0] = _callTime; t[1] = _serializedTime; t[2] = _sentTime; t[3] = _attemptTime; t[4] = _responseTime;
+	t[5] = _firstByteTime; t[6] = _lastByteTime; t[7] = _parsedTime; t[8] = _convertedTime; t[9] = _dispatchedTime;
+}
+
+-(NSTimeInterval)durationOfPhase:(JSONRPCCallPhase)phase {
+	if (phase >= JSONRPCCallPhaseCount) return 0;
+	CFAbsoluteTime t[JSONRPCCallPhaseCount+1];
+	[self getTimestamps:t];
+	return (t[phase] && t[phase+1]) ? MAX(0, t[phase+1]-t[phase]) : 0;
+}
+
+-(NSTimeInterval)totalDuration {
+	CFAbsoluteTime t[JSONRPCCallPhaseCount+1];
+	[self getTimestamps:t];
+	for(int i=JSONRPCCallPhaseCount; i>0; --i) {
+		if (t[i]) return MAX(0, t[i]-_callTime);
+	}
+	return 0;
+}
+
+-(NSString*)description {
+	NSMutableString* desc = [NSMutableString stringWithFormat:@"<%@ %@ total:%.1fms",NSStringFromClass([self class]),_methodName,[self totalDuration]*1000];
+	static const char* names[JSONRPCCallPhaseCount] = {
+		"serialization","queueing","retries","connect","firstByte","transfer","parsing","conversion","dispatch"
+	};
+	for(int p=0; p<JSONRPCCallPhaseCount; ++p) {
+		[desc appendFormat:@" %s:%.1fms",names[p],[self durationOfPhase:p]*1000];
+	}
+	[desc appendFormat:@" sent:%luB received:%luB retries:%lu%@%@>",
+	 (unsigned long)_requestBytes,(unsigned long)_responseBytes,(unsigned long)_retriesCount,
+	 _error?@" failed":@"",_cancelled?@" cancelled":@""];
+	return desc;
+}
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Histograms
+/////////////////////////////////////////////////////////////////////////////
+
+static inline NSTimeInterval bucketUpperBound(NSUInteger idx) {
+	return exp2((double)(idx+1)/kBucketsPerOctave) * 1e-6;
+}
+
+@implementation JSONRPCLatencyHistogram
+@synthesize methodName = _methodName;
+@synthesize count = _count;
+@synthesize errorsCount = _errorsCount;
+@synthesize maxLatency = _maxLatency;
+
+-(id)initWithMethodName:(NSString*)name count:(NSUInteger)count errorsCount:(NSUInteger)errorsCount
+		   totalLatency:(NSTimeInterval)total maxLatency:(NSTimeInterval)max
+		 phaseDurations:(const NSTimeInterval*)phaseTotals buckets:(NSData*)buckets
+{
+	self = [super init];
+	if (self != nil) {
+		_methodName = [name copy];
+		_count = count;
+		_errorsCount = errorsCount;
+		_totalLatency = total;
+		_maxLatency = max;
+		memcpy(_phaseDurations, phaseTotals, sizeof(_phaseDurations));
+		_buckets = [buckets copy];
+	}
+	return self;
+}
+
+-(void)dealloc {
+	[_methodName release];
+	[_buckets release];
+	[super dealloc];
+}
+
+-(NSTimeInterval)meanLatency {
+	return _count ? _totalLatency / _count : 0;
+}
+
+-(NSTimeInterval)meanDurationOfPhase:(JSONRPCCallPhase)phase {
+	return (_count && phase < JSONRPCCallPhaseCount) ? _phaseDurations[phase] / _count : 0;
+}
+
+-(NSTimeInterval)latencyAtPercentile:(double)percentile {
+	const int32_t* b = [_buckets bytes];
+	NSUInteger n = [_buckets length] / sizeof(int32_t);
+	NSUInteger total = 0;
+	for(NSUInteger i=0; i<n; ++i) total += b[i];
+	if (!total) return 0;
+	
+	NSUInteger rank = (NSUInteger)ceil(MAX(0, MIN(percentile, 1)) * total);
+	NSUInteger seen = 0;
+	for(NSUInteger i=0; i<n; ++i) {
+		seen += b[i];
+		if (seen >= rank && b[i]) return MIN(bucketUpperBound(i), _maxLatency);
+	}
+	return _maxLatency;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@ count:%lu errors:%lu mean:%.1fms p50:%.1fms p90:%.1fms p99:%.1fms max:%.1fms>",
+			NSStringFromClass([self class]),_methodName,(unsigned long)_count,(unsigned long)_errorsCount,self.meanLatency*1000,
+			[self latencyAtPercentile:0.5]*1000,[self latencyAtPercentile:0.9]*1000,[self latencyAtPercentile:0.99]*1000,
+			_maxLatency*1000];
+}
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Aggregator
+/////////////////////////////////////////////////////////////////////////////
+
+// One method of the lock-free table. Durations are in microseconds.
+typedef struct {
+	_Atomic(NSString*) name;
+	_Atomic(int32_t) count;
+	_Atomic(int32_t) errorsCount;
+	_Atomic(int64_t) totalMicros;
+	_Atomic(int64_t) maxMicros;
+	_Atomic(int64_t) phaseMicros[JSONRPCCallPhaseCount];
+	_Atomic(int32_t) buckets[kBucketsCount];
+} MethodSlot;
+
+// Find or atomically claim the slot of a method (open addressing). The last slot collects the methods that don't fit.
+static MethodSlot* slotForMethod(MethodSlot* slots, NSString* name) {
+	if (!name) return &slots[kMaxMethods];
+	NSUInteger h = [name hash];
+	for(NSUInteger i=0; i<kMaxMethods; ++i) {
+		MethodSlot* slot = &slots[(h+i) % kMaxMethods];
+		NSString* slotName = atomic_load_explicit(&slot->name, memory_order_acquire);
+		if (!slotName) {
+			NSString* copy = [name copy];
+			// on failure, slotName receives the name stored by the thread that claimed this slot meanwhile
+			if (atomic_compare_exchange_strong_explicit(&slot->name, &slotName, copy, memory_order_acq_rel, memory_order_acquire)) return slot;
+			[copy release];
+		}
+		if ([slotName isEqualToString:name]) return slot;
+	}
+	return &slots[kMaxMethods];
+}
+
+static inline int64_t toMicros(NSTimeInterval t) {
+	return (int64_t)(t * 1e6);
+}
+
+@implementation JSONRPCMetricsAggregator
+@synthesize nextObserver = _nextObserver;
+
+- (id) init
+{
+	self = [super init];
+	if (self != nil) {
+		_slots = calloc(kMaxMethods+1, sizeof(MethodSlot));
+		atomic_init(&((MethodSlot*)_slots)[kMaxMethods].name, [kOverflowMethodName copy]);
+	}
+	return self;
+}
+
+-(void)dealloc {
+	MethodSlot* slots = _slots;
+	for(int i=0; i<=kMaxMethods; ++i) [atomic_load_explicit(&slots[i].name, memory_order_relaxed) release];
+	free(_slots);
+	[_nextObserver release];
+	[super dealloc];
+}
+
+-(void)methodCall:(JSONRPCMethodCall*)methodCall didFinishWithMetrics:(JSONRPCCallMetrics*)metrics {
+	if (!metrics.cancelled) {
+		MethodSlot* slot = slotForMethod(_slots, metrics.methodName);
+		int64_t us = toMicros([metrics totalDuration]);
+		
+		int bucket = (us > 0) ? (int)(log2((double)us) * kBucketsPerOctave) : 0;
+		bucket = MAX(0, MIN(bucket, kBucketsCount-1));
+		// independent counters: a snapshot may see a call in some of them only, which is fine for statistics
+		atomic_fetch_add_explicit(&slot->buckets[bucket], 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&slot->count, 1, memory_order_relaxed);
+		if (metrics.error) atomic_fetch_add_explicit(&slot->errorsCount, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&slot->totalMicros, us, memory_order_relaxed);
+		for(int p=0; p<JSONRPCCallPhaseCount; ++p) {
+			atomic_fetch_add_explicit(&slot->phaseMicros[p], toMicros([metrics durationOfPhase:p]), memory_order_relaxed);
+		}
+		int64_t max = atomic_load_explicit(&slot->maxMicros, memory_order_relaxed);
+		while (us > max && !atomic_compare_exchange_weak_explicit(&slot->maxMicros, &max, us, memory_order_relaxed, memory_order_relaxed)) {
+			// max has been reloaded by the failed exchange
+		}
+	}
+	
+	[_nextObserver methodCall:methodCall didFinishWithMetrics:metrics];
+}
+
+-(NSDictionary*)snapshot {
+	MethodSlot* slots = _slots;
+	NSMutableDictionary* histograms = [NSMutableDictionary dictionary];
+	for(int i=0; i<=kMaxMethods; ++i) {
+		MethodSlot* slot = &slots[i];
+		NSString* name = atomic_load_explicit(&slot->name, memory_order_acquire);
+		int32_t count = atomic_load_explicit(&slot->count, memory_order_relaxed);
+		if (!name || !count) continue;
+		
+		NSTimeInterval phases[JSONRPCCallPhaseCount];
+		for(int p=0; p<JSONRPCCallPhaseCount; ++p) phases[p] = atomic_load_explicit(&slot->phaseMicros[p], memory_order_relaxed) * 1e-6;
+		int32_t bucketCounts[kBucketsCount];
+		for(int b=0; b<kBucketsCount; ++b) bucketCounts[b] = atomic_load_explicit(&slot->buckets[b], memory_order_relaxed);
+		NSData* buckets = [NSData dataWithBytes:bucketCounts length:sizeof(bucketCounts)];
+		JSONRPCLatencyHistogram* h = [[JSONRPCLatencyHistogram alloc] initWithMethodName:name
+																				   count:count
+																			 errorsCount:atomic_load_explicit(&slot->errorsCount, memory_order_relaxed)
+																			totalLatency:atomic_load_explicit(&slot->totalMicros, memory_order_relaxed) * 1e-6
+																			  maxLatency:atomic_load_explicit(&slot->maxMicros, memory_order_relaxed) * 1e-6
+																		  phaseDurations:phases
+																				 buckets:buckets];
+		[histograms setObject:h forKey:name];
+		[h release];
+	}
+	return histograms;
+}
+
+-(void)reset {
+	MethodSlot* slots = _slots;
+	for(int i=0; i<=kMaxMethods; ++i) {
+		// keep the names: the slots stay assigned to the same methods
+		MethodSlot* slot = &slots[i];
+		atomic_store_explicit(&slot->count, 0, memory_order_relaxed);
+		atomic_store_explicit(&slot->errorsCount, 0, memory_order_relaxed);
+		atomic_store_explicit(&slot->totalMicros, 0, memory_order_relaxed);
+		atomic_store_explicit(&slot->maxMicros, 0, memory_order_relaxed);
+		for(int p=0; p<JSONRPCCallPhaseCount; ++p) atomic_store_explicit(&slot->phaseMicros[p], 0, memory_order_relaxed);
+		for(int b=0; b<kBucketsCount; ++b) atomic_store_explicit(&slot->buckets[b], 0, memory_order_relaxed);
+	}
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+@end
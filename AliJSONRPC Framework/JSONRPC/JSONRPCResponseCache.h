@@ -0,0 +1,120 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCResponseCache.h
+//! @brief Caches the responses of read-only methods, in memory and optionally on disk (see JSONRPCService#responseCache)
+
+@class JSONRPCCacheEntry;
+
+/** @brief Keeps the raw responses of read-only methods, to answer the next calls with the same parameters without any request
+ *
+ * Only the methods given a time to live (with setTimeToLive:forMethodName:, or for all the methods with defaultTimeToLive) are cached,
+ * and only their successful JSON responses (not the errors, nor the MessagePack or streamed responses).
+ * The responses are keyed by the service (see JSONRPCService#responseCacheNamespace), the method name and the parameters
+ * (serialized with sorted keys), and are kept as received:
+ * a cached response is parsed, converted and dispatched like a response from the network.
+ *
+ * The memory tier keeps the most recently used responses, up to maxMemoryBytes: each hit moves its response to the back
+ * of the eviction order, so the responses that are read often stay in memory even when many others are stored.
+ *
+ * When created with a directory, the responses are also stored on disk, so that they survive the restarts of the process:
+ *  - the responses are appended to segment files of a fixed size (1/8 of maxDiskBytes, at least 64KB), which are memory-mapped.
+ *    Each response is preceded by its key and followed by a NUL byte, so that SBJsonParser parses it straight from the mapped
+ *    pages (objectWithUTF8Bytes:length:), without reading the file into a heap buffer.
+ *  - the "index" file lists the responses (segment, offset, length of the key and of the response, expiry date), with one
+ *    record appended per response stored. It is compacted when the cache is opened, and as soon as its records of replaced
+ *    or expired responses outnumber the others.
+ *  - once the segments reach maxDiskBytes, the oldest segment is deleted with all its responses.
+ *
+ * Responses found on disk are not copied to the memory tier: their pages are already kept in memory by the system while they are used.
+ * The cache only reads its files back when it is created: use a single cache per directory, and per process.
+ * This class is thread-safe, so a cache can be shared by several JSONRPCService instances: their responses are kept apart
+ * by their responseCacheNamespace, so two services only share the responses of the same servers.
+ */
+@interface JSONRPCResponseCache : NSObject
+{
+	//! @privatesection
+	NSMutableDictionary* _timesToLive; // method name -> NSNumber
+	NSTimeInterval _defaultTimeToLive;
+	NSMutableDictionary* _memoryEntries; // key -> JSONRPCCacheEntry
+	JSONRPCCacheEntry* _leastRecentlyUsed; // the entries of the memory tier are linked in the order of their last use
+	JSONRPCCacheEntry* _mostRecentlyUsed;
+	NSUInteger _maxMemoryBytes;
+	NSUInteger _memoryBytes;
+	NSString* _directory;
+	unsigned long long _maxDiskBytes;
+	NSUInteger _segmentSize;
+	NSMutableArray* _segments; // JSONRPCCacheSegment, oldest first
+	NSMutableDictionary* _diskEntries; // key -> JSONRPCCacheEntry
+	NSUInteger _writeOffset; // in the last segment
+	int _indexFD;
+	NSUInteger _deadIndexRecordsCount; // records of the index file for responses replaced, expired or deleted since it was written
+	NSUInteger _hitsCount;
+	NSUInteger _diskHitsCount;
+	NSUInteger _missesCount;
+}
++(id)cacheWithDirectory:(NSString*)path maxDiskBytes:(unsigned long long)maxDiskBytes error:(NSError**)error; //!< Commodity constructor
+/** @brief Create a cache with a disk tier, reloading the responses stored in the directory by a previous run
+ * @param path the directory of the segment and index files. It is created if needed.
+ * @param maxDiskBytes the space used on disk by the segment files
+ * @return nil if the directory cannot be created or the index file cannot be opened
+ */
+-(id)initWithDirectory:(NSString*)path maxDiskBytes:(unsigned long long)maxDiskBytes error:(NSError**)error;
+-(id)init; //!< Create a cache with a memory tier only
+
+/** @brief Cache the responses of a method for the given time. 0 stops caching them.
+ * @note Only cache the methods without side effects, whose result may be a little stale.
+ */
+-(void)setTimeToLive:(NSTimeInterval)ttl forMethodName:(NSString*)methodName;
+-(NSTimeInterval)timeToLiveForMethodName:(NSString*)methodName; //!< the time to live of the method, or defaultTimeToLive
+@property(nonatomic, assign) NSTimeInterval defaultTimeToLive; //!< the time to live of the methods without their own. Defaults to 0 (not cached).
+@property(nonatomic, assign) NSUInteger maxMemoryBytes; //!< the size of the responses kept in memory. Defaults to 1MB.
+@property(nonatomic, readonly) NSString* directory; //!< the directory of the disk tier, or nil
+@property(nonatomic, readonly) unsigned long long maxDiskBytes;
+@property(nonatomic, readonly) NSUInteger memoryBytes; //!< the size of the responses in the memory tier
+@property(nonatomic, readonly) unsigned long long diskBytes; //!< the size of the segment files
+@property(nonatomic, readonly) NSUInteger hitsCount; //!< number of responses found (in memory or on disk)
+@property(nonatomic, readonly) NSUInteger diskHitsCount; //!< number of responses found on disk only
+@property(nonatomic, readonly) NSUInteger missesCount; //!< number of lookups of cached methods without a fresh response
+
+/** @brief The fresh response cached for this method call, if any
+ * @param serviceNamespace the identity of the service the call is sent to (JSONRPCService#responseCacheNamespace), so that
+ *        the services sharing the cache don't answer each other's calls
+ * @return the JSON response, immutable. The byte after its last one (at [data bytes]+[data length]) is a NUL byte,
+ *         as required by SBJsonParser's objectWithUTF8Bytes:length:. nil if the method is not cached or the response has expired.
+ */
+-(NSData*)responseForMethodName:(NSString*)methodName parameters:(id)params serviceNamespace:(NSString*)serviceNamespace;
+/** @brief Store the response of a method call. Called by the JSONRPCResponseHandler once a successful response is parsed.
+ * Does nothing if the method has no time to live.
+ */
+-(void)storeResponse:(NSData*)response forMethodName:(NSString*)methodName parameters:(id)params serviceNamespace:(NSString*)serviceNamespace;
+-(void)removeAllResponses; //!< empty both tiers, and delete the segment files
+@end
@@ -0,0 +1,562 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCResponseCache.h"
+#import "JSON.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char kIndexSignature[8] = { 'J','R','P','C','I','D','X','1' };
+static NSString* const kIndexFileName = @"index";
+static NSString* const kSegmentFilePrefix = @"segment-";
+static const NSUInteger kSegmentsCount = 8;
+static const NSUInteger kMinSegmentSize = 64*1024;
+#define kIndexRecordSize 24 // expiry (float64), segment, offset, length, keyLength (uint32), little-endian
+static const NSUInteger kMinDeadIndexRecordsCount = 1024; // below this, the index is not worth compacting
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Private classes
+/////////////////////////////////////////////////////////////////////////////
+
+//! @private A segment file of the disk tier, mapped in memory as long as it is retained
+@interface JSONRPCCacheSegment : NSObject
+{
+	@public
+	uint32_t _number;
+	NSString* _path;
+	int _fd;
+	const char* _bytes;
+	NSUInteger _size;
+}
+-(id)initWithPath:(NSString*)path number:(uint32_t)number size:(NSUInteger)size create:(BOOL)create;
+@end
+
+@implementation JSONRPCCacheSegment
+-(id)initWithPath:(NSString*)path number:(uint32_t)number size:(NSUInteger)size create:(BOOL)create {
+	self = [super init];
+	if (self != nil) {
+		_path = [path copy];
+		_number = number;
+		_size = size;
+		_fd = open([path fileSystemRepresentation], O_RDWR | (create ? O_CREAT|O_TRUNC : 0), 0600);
+		struct stat st;
+		// created at its full size, so that it is mapped once
+		BOOL ok = (_fd >= 0) && (!create || ftruncate(_fd, size) == 0) && (fstat(_fd, &st) == 0) && (st.st_size == (off_t)size);
+		void* bytes = ok ? mmap(NULL, size, PROT_READ, MAP_SHARED, _fd, 0) : MAP_FAILED;
+		if (bytes == MAP_FAILED) {
+			[self release];
+			return nil;
+		}
+		_bytes = bytes;
+	}
+	return self;
+}
+-(void)dealloc {
+	if (_bytes) munmap((void*)_bytes, _size);
+	if (_fd >= 0) close(_fd);
+	[_path release];
+	[super dealloc];
+}
+@end
+
+
+//! @private A cached response, either in memory or in a segment
+@interface JSONRPCCacheEntry : NSObject
+{
+	@public
+	CFAbsoluteTime _expiry;
+	NSData* _data;                  // memory tier: the response, followed by a NUL byte
+	NSData* _key;                   // memory tier: the key of the entry in _memoryEntries
+	JSONRPCCacheEntry* _previous;   // memory tier: the entries used before and after this one (not retained)
+	JSONRPCCacheEntry* _next;
+	JSONRPCCacheSegment* _segment;  // disk tier: the response is at _offset, preceded by its key
+	uint32_t _offset, _length, _keyLength;
+}
+@end
+
+@implementation JSONRPCCacheEntry
+-(void)dealloc {
+	[_data release];
+	[_key release];
+	[_segment release];
+	[super dealloc];
+}
+@end
+
+
+//! @private Immutable bytes that belong to another object (a buffer or a segment), retained as long as they are used
+@interface JSONRPCCachedResponseData : NSData
+{
+	id _owner;
+	const void* _bytes;
+	NSUInteger _length;
+}
+-(id)initWithBytes:(const void*)bytes length:(NSUInteger)length owner:(id)owner;
+@end
+
+@implementation JSONRPCCachedResponseData
+-(id)initWithBytes:(const void*)bytes length:(NSUInteger)length owner:(id)owner {
+	self = [super init];
+	if (self != nil) {
+		_owner = [owner retain];
+		_bytes = bytes;
+		_length = length;
+	}
+	return self;
+}
+-(const void*)bytes { return _bytes; }
+-(NSUInteger)length { return _length; }
+-(id)copyWithZone:(NSZone*)zone { return [self retain]; }
+-(void)dealloc {
+	[_owner release];
+	[super dealloc];
+}
+@end
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Helpers
+/////////////////////////////////////////////////////////////////////////////
+
+// The service, the method name and the parameters with sorted keys, so that equal parameters always give the same key
+static NSData* cacheKey(NSString* serviceNamespace, NSString* methodName, id params) {
+	SBJsonWriter* writer = [[SBJsonWriter alloc] init];
+	writer.sortKeys = YES;
+	NSString* json = params ? [writer stringWithObject:params] : @"null";
+	[writer release];
+	if (!methodName || !json) return nil; // the parameters cannot be serialized
+	NSMutableData* key = [NSMutableData dataWithData:[(serviceNamespace ?: @"") dataUsingEncoding:NSUTF8StringEncoding]];
+	[key appendBytes:"" length:1]; // NUL bytes between the namespace, the name and the parameters
+	[key appendData:[methodName dataUsingEncoding:NSUTF8StringEncoding]];
+	[key appendBytes:"" length:1];
+	[key appendData:[json dataUsingEncoding:NSUTF8StringEncoding]];
+	return key;
+}
+
+static void encodeIndexRecord(uint8_t* record, JSONRPCCacheEntry* entry) {
+	NSSwappedDouble expiry = NSSwapHostDoubleToLittle(entry->_expiry);
+	uint32_t fields[4] = {
+		NSSwapHostIntToLittle(entry->_segment->_number), NSSwapHostIntToLittle(entry->_offset),
+		NSSwapHostIntToLittle(entry->_length), NSSwapHostIntToLittle(entry->_keyLength)
+	};
+	memcpy(record, &expiry, sizeof(expiry));
+	memcpy(record + sizeof(expiry), fields, sizeof(fields));
+}
+// Returns the number of the segment of the entry
+static uint32_t decodeIndexRecord(const uint8_t* record, JSONRPCCacheEntry* entry) {
+	NSSwappedDouble expiry;
+	uint32_t fields[4];
+	memcpy(&expiry, record, sizeof(expiry));
+	memcpy(fields, record + sizeof(expiry), sizeof(fields));
+	entry->_expiry = NSSwapLittleDoubleToHost(expiry);
+	entry->_offset = NSSwapLittleIntToHost(fields[1]);
+	entry->_length = NSSwapLittleIntToHost(fields[2]);
+	entry->_keyLength = NSSwapLittleIntToHost(fields[3]);
+	return NSSwapLittleIntToHost(fields[0]);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Cache
+/////////////////////////////////////////////////////////////////////////////
+
+//! @private Private API @internal
+@interface JSONRPCResponseCache()
+-(void)removeMemoryEntryForKey:(NSData*)key; //!< @private @internal
+-(void)unlinkMemoryEntry:(JSONRPCCacheEntry*)entry; //!< @private @internal
+-(void)appendMemoryEntry:(JSONRPCCacheEntry*)entry; //!< @private @internal
+-(void)trimMemoryTier; //!< @private @internal
+-(void)indexRecordsDidDie:(NSUInteger)count; //!< @private @internal
+-(BOOL)loadDiskTier; //!< @private @internal
+-(BOOL)rewriteIndex; //!< @private @internal
+-(JSONRPCCacheSegment*)addSegment; //!< @private @internal
+-(void)removeOldestSegment; //!< @private @internal
+-(void)writeResponse:(NSData*)response key:(NSData*)key expiry:(CFAbsoluteTime)expiry; //!< @private @internal
+@end
+
+@implementation JSONRPCResponseCache
+@synthesize defaultTimeToLive = _defaultTimeToLive;
+@synthesize maxMemoryBytes = _maxMemoryBytes;
+@synthesize directory = _directory, maxDiskBytes = _maxDiskBytes;
+@synthesize hitsCount = _hitsCount, diskHitsCount = _diskHitsCount, missesCount = _missesCount;
+
+- (id) init
+{
+	self = [super init];
+	if (self != nil) {
+		_timesToLive = [[NSMutableDictionary alloc] init];
+		_memoryEntries = [[NSMutableDictionary alloc] init];
+		_maxMemoryBytes = 1024*1024;
+		_indexFD = -1;
+	}
+	return self;
+}
+
++(id)cacheWithDirectory:(NSString*)path maxDiskBytes:(unsigned long long)maxDiskBytes error:(NSError**)error {
+	return [[[self alloc] initWithDirectory:path maxDiskBytes:maxDiskBytes error:error] autorelease];
+}
+
+-(id)initWithDirectory:(NSString*)path maxDiskBytes:(unsigned long long)maxDiskBytes error:(NSError**)error {
+	self = [self init];
+	if (self != nil) {
+		_directory = [path copy];
+		_maxDiskBytes = maxDiskBytes;
+		_segmentSize = (NSUInteger)MAX(maxDiskBytes/kSegmentsCount, (unsigned long long)kMinSegmentSize);
+		_segments = [[NSMutableArray alloc] init];
+		_diskEntries = [[NSMutableDictionary alloc] init];
+		if (![[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:error]) {
+			[self release];
+			return nil;
+		}
+		if (![self loadDiskTier]) {
+			if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno
+												userInfo:[NSDictionary dictionaryWithObject:path forKey:NSFilePathErrorKey]];
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+-(void)dealloc {
+	if (_indexFD >= 0) close(_indexFD);
+	[_timesToLive release];
+	[_memoryEntries release];
+	[_directory release];
+	[_segments release];
+	[_diskEntries release];
+	[super dealloc];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Settings and counters
+
+-(void)setTimeToLive:(NSTimeInterval)ttl forMethodName:(NSString*)methodName {
+	@synchronized(self) {
+		if (ttl > 0) [_timesToLive setObject:[NSNumber numberWithDouble:ttl] forKey:methodName];
+		else [_timesToLive removeObjectForKey:methodName];
+	}
+}
+-(NSTimeInterval)timeToLiveForMethodName:(NSString*)methodName {
+	@synchronized(self) {
+		NSNumber* ttl = methodName ? [_timesToLive objectForKey:methodName] : nil;
+		return ttl ? [ttl doubleValue] : _defaultTimeToLive;
+	}
+}
+
+-(void)setMaxMemoryBytes:(NSUInteger)maxBytes {
+	@synchronized(self) {
+		_maxMemoryBytes = maxBytes;
+		[self trimMemoryTier];
+	}
+}
+-(NSUInteger)memoryBytes {
+	@synchronized(self) {
+		return _memoryBytes;
+	}
+}
+-(unsigned long long)diskBytes {
+	@synchronized(self) {
+		return [_segments count] * (unsigned long long)_segmentSize;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Lookup and storage
+
+-(NSData*)responseForMethodName:(NSString*)methodName parameters:(id)params serviceNamespace:(NSString*)serviceNamespace {
+	if ([self timeToLiveForMethodName:methodName] <= 0) return nil;
+	NSData* key = cacheKey(serviceNamespace, methodName, params);
+	if (!key) return nil;
+	
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	NSData* response = nil;
+	@synchronized(self) {
+		JSONRPCCacheEntry* entry = [_memoryEntries objectForKey:key];
+		if (entry && entry->_expiry > now) {
+			response = [[JSONRPCCachedResponseData alloc] initWithBytes:[entry->_data bytes] length:[entry->_data length]-1 owner:entry->_data];
+			// now the most recently used
+			[self unlinkMemoryEntry:entry];
+			[self appendMemoryEntry:entry];
+		} else {
+			if (entry) [self removeMemoryEntryForKey:key];
+			entry = [_diskEntries objectForKey:key];
+			if (entry && entry->_expiry > now) {
+				// parsed straight from the mapped pages: the segment stays mapped as long as the response is used
+				JSONRPCCacheSegment* segment = entry->_segment;
+				response = [[JSONRPCCachedResponseData alloc] initWithBytes:segment->_bytes + entry->_offset length:entry->_length owner:segment];
+				++_diskHitsCount;
+			} else if (entry) {
+				[_diskEntries removeObjectForKey:key]; // its bytes are left in the segment until it is deleted
+				[self indexRecordsDidDie:1];
+			}
+		}
+		if (response) ++_hitsCount;
+		else ++_missesCount;
+	}
+	return [response autorelease];
+}
+
+-(void)storeResponse:(NSData*)response forMethodName:(NSString*)methodName parameters:(id)params serviceNamespace:(NSString*)serviceNamespace {
+	NSTimeInterval ttl = [self timeToLiveForMethodName:methodName];
+	NSUInteger length = [response length];
+	if (ttl <= 0 || !length) return;
+	NSData* key = cacheKey(serviceNamespace, methodName, params);
+	if (!key) return;
+	CFAbsoluteTime expiry = CFAbsoluteTimeGetCurrent() + ttl;
+	
+	@synchronized(self) {
+		[self removeMemoryEntryForKey:key];
+		if (length <= _maxMemoryBytes) {
+			NSMutableData* data = [[NSMutableData alloc] initWithCapacity:length+1];
+			[data appendData:response];
+			[data appendBytes:"" length:1];
+			JSONRPCCacheEntry* entry = [[JSONRPCCacheEntry alloc] init];
+			entry->_expiry = expiry;
+			entry->_data = data;
+			entry->_key = [key retain];
+			[_memoryEntries setObject:entry forKey:key];
+			[self appendMemoryEntry:entry];
+			_memoryBytes += length;
+			[entry release];
+			[self trimMemoryTier];
+		}
+		if (_directory) [self writeResponse:response key:key expiry:expiry];
+	}
+}
+
+-(void)removeAllResponses {
+	@synchronized(self) {
+		[_memoryEntries removeAllObjects];
+		_leastRecentlyUsed = _mostRecentlyUsed = nil;
+		_memoryBytes = 0;
+		while ([_segments count]) [self removeOldestSegment];
+		_writeOffset = 0;
+		if (_directory) [self rewriteIndex];
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Memory tier (the methods below are called @synchronized)
+
+-(void)removeMemoryEntryForKey:(NSData*)key {
+	JSONRPCCacheEntry* entry = [_memoryEntries objectForKey:key];
+	if (!entry) return;
+	[[key retain] autorelease]; // may be the instance held by the entry
+	_memoryBytes -= [entry->_data length]-1;
+	[self unlinkMemoryEntry:entry];
+	[_memoryEntries removeObjectForKey:key];
+}
+
+-(void)unlinkMemoryEntry:(JSONRPCCacheEntry*)entry {
+	if (entry->_previous) entry->_previous->_next = entry->_next;
+	else _leastRecentlyUsed = entry->_next;
+	if (entry->_next) entry->_next->_previous = entry->_previous;
+	else _mostRecentlyUsed = entry->_previous;
+	entry->_previous = entry->_next = nil;
+}
+
+-(void)appendMemoryEntry:(JSONRPCCacheEntry*)entry {
+	entry->_previous = _mostRecentlyUsed;
+	if (_mostRecentlyUsed) _mostRecentlyUsed->_next = entry;
+	else _leastRecentlyUsed = entry;
+	_mostRecentlyUsed = entry;
+}
+
+// Forget the least recently used responses until the memory tier fits in maxMemoryBytes
+-(void)trimMemoryTier {
+	while (_memoryBytes > _maxMemoryBytes && _leastRecentlyUsed) {
+		[self removeMemoryEntryForKey:_leastRecentlyUsed->_key];
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Disk tier (the methods below are called @synchronized)
+
+// Map the segment files and read the index back, keeping the fresh responses only. Rewrites the index without the others.
+-(BOOL)loadDiskTier {
+	NSArray* names = [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:_directory error:NULL] sortedArrayUsingSelector:@selector(compare:)];
+	for(NSString* name in names) {
+		if (![name hasPrefix:kSegmentFilePrefix]) continue;
+		NSString* path = [_directory stringByAppendingPathComponent:name];
+		uint32_t number = (uint32_t)[[name substringFromIndex:[kSegmentFilePrefix length]] longLongValue];
+		JSONRPCCacheSegment* segment = [[JSONRPCCacheSegment alloc] initWithPath:path number:number size:_segmentSize create:NO];
+		if (segment) [_segments addObject:segment];
+		else unlink([path fileSystemRepresentation]); // written with another maxDiskBytes, or unreadable
+		[segment release];
+	}
+	while ([_segments count] > 1 && [_segments count] * (unsigned long long)_segmentSize > _maxDiskBytes) {
+		[self removeOldestSegment];
+	}
+	
+	NSData* index = [NSData dataWithContentsOfFile:[_directory stringByAppendingPathComponent:kIndexFileName] options:NSMappedRead error:NULL];
+	const uint8_t* p = [index bytes];
+	const uint8_t* end = p + [index length];
+	JSONRPCCacheSegment* lastSegment = [_segments lastObject];
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	if ([index length] >= sizeof(kIndexSignature) && !memcmp(p, kIndexSignature, sizeof(kIndexSignature))) {
+		for(p += sizeof(kIndexSignature); end - p >= kIndexRecordSize; p += kIndexRecordSize) {
+			JSONRPCCacheEntry* entry = [[JSONRPCCacheEntry alloc] init];
+			uint32_t number = decodeIndexRecord(p, entry);
+			JSONRPCCacheSegment* segment = nil;
+			for(JSONRPCCacheSegment* s in _segments) if (s->_number == number) segment = s;
+			// the segment may have been deleted since the record was written
+			if (segment && entry->_keyLength <= entry->_offset && (unsigned long long)entry->_offset + entry->_length < _segmentSize) {
+				if (segment == lastSegment) _writeOffset = MAX(_writeOffset, (NSUInteger)entry->_offset + entry->_length + 1);
+				NSData* key = [NSData dataWithBytes:segment->_bytes + entry->_offset - entry->_keyLength length:entry->_keyLength];
+				if (entry->_expiry > now && segment->_bytes[entry->_offset + entry->_length] == 0) {
+					entry->_segment = [segment retain];
+					[_diskEntries setObject:entry forKey:key];
+				} else {
+					[_diskEntries removeObjectForKey:key]; // the last record of a key wins
+				}
+			}
+			[entry release];
+		}
+	}
+	return [self rewriteIndex];
+}
+
+// Write the records of the responses on disk to a new index file, which replaces the current one
+-(BOOL)rewriteIndex {
+	NSMutableData* index = [NSMutableData dataWithCapacity:sizeof(kIndexSignature) + [_diskEntries count]*kIndexRecordSize];
+	[index appendBytes:kIndexSignature length:sizeof(kIndexSignature)];
+	uint8_t record[kIndexRecordSize];
+	for(JSONRPCCacheEntry* entry in [_diskEntries objectEnumerator]) {
+		encodeIndexRecord(record, entry);
+		[index appendBytes:record length:sizeof(record)];
+	}
+	
+	NSString* path = [_directory stringByAppendingPathComponent:kIndexFileName];
+	if (_indexFD >= 0) close(_indexFD);
+	_indexFD = -1;
+	_deadIndexRecordsCount = 0;
+	if (![index writeToFile:path atomically:YES]) return NO;
+	_indexFD = open([path fileSystemRepresentation], O_WRONLY|O_APPEND);
+	return (_indexFD >= 0);
+}
+
+// Start a new segment, deleting the oldest ones to stay within maxDiskBytes
+-(JSONRPCCacheSegment*)addSegment {
+	JSONRPCCacheSegment* lastSegment = [_segments lastObject];
+	uint32_t number = lastSegment ? lastSegment->_number+1 : 0;
+	if ([_segments count] && ([_segments count]+1) * (unsigned long long)_segmentSize > _maxDiskBytes) {
+		do {
+			[self removeOldestSegment];
+		} while ([_segments count] && ([_segments count]+1) * (unsigned long long)_segmentSize > _maxDiskBytes);
+		[self rewriteIndex];
+	}
+	
+	NSString* name = [kSegmentFilePrefix stringByAppendingFormat:@"%08u", number];
+	JSONRPCCacheSegment* segment = [[JSONRPCCacheSegment alloc] initWithPath:[_directory stringByAppendingPathComponent:name]
+																	 number:number size:_segmentSize create:YES];
+	if (!segment) {
+		NSLog(@"JSONRPCResponseCache: cannot create %@ in %@: %s", name, _directory, strerror(errno));
+		return nil;
+	}
+	[_segments addObject:segment];
+	[segment release];
+	_writeOffset = 0;
+	return segment;
+}
+
+// Delete the oldest segment file and forget its responses. The index is not rewritten.
+-(void)removeOldestSegment {
+	JSONRPCCacheSegment* oldestSegment = [_segments objectAtIndex:0];
+	unlink([oldestSegment->_path fileSystemRepresentation]); // the responses still in use stay mapped
+	for(NSData* key in [_diskEntries allKeys]) {
+		if (((JSONRPCCacheEntry*)[_diskEntries objectForKey:key])->_segment == oldestSegment) {
+			[_diskEntries removeObjectForKey:key];
+			++_deadIndexRecordsCount;
+		}
+	}
+	[_segments removeObjectAtIndex:0];
+}
+
+// Append the key, the response and a NUL byte to the last segment, and its record to the index
+-(void)writeResponse:(NSData*)response key:(NSData*)key expiry:(CFAbsoluteTime)expiry {
+	NSUInteger keyLength = [key length];
+	NSUInteger length = [response length];
+	NSUInteger entrySize = keyLength + length + 1;
+	if (entrySize > _segmentSize) return;
+	
+	JSONRPCCacheSegment* segment = [_segments lastObject];
+	if (!segment || _writeOffset + entrySize > _segmentSize) {
+		segment = [self addSegment];
+		if (!segment) return;
+	}
+	off_t offset = _writeOffset;
+	// the NUL byte is written too: the bytes after the last indexed response may be left from an interrupted run
+	if (pwrite(segment->_fd, [key bytes], keyLength, offset) != (ssize_t)keyLength
+		|| pwrite(segment->_fd, [response bytes], length, offset + keyLength) != (ssize_t)length
+		|| pwrite(segment->_fd, "", 1, offset + keyLength + length) != 1)
+	{
+		NSLog(@"JSONRPCResponseCache: cannot write to %@: %s", segment->_path, strerror(errno));
+		return;
+	}
+	_writeOffset += entrySize;
+	
+	JSONRPCCacheEntry* entry = [[JSONRPCCacheEntry alloc] init];
+	entry->_expiry = expiry;
+	entry->_segment = [segment retain];
+	entry->_offset = (uint32_t)(offset + keyLength);
+	entry->_length = (uint32_t)length;
+	entry->_keyLength = (uint32_t)keyLength;
+	BOOL replaced = ([_diskEntries objectForKey:key] != nil);
+	[_diskEntries setObject:entry forKey:key];
+	
+	// the record is appended once the response is written: an interrupted write is never indexed
+	uint8_t record[kIndexRecordSize];
+	encodeIndexRecord(record, entry);
+	if (_indexFD >= 0 && write(_indexFD, record, sizeof(record)) != sizeof(record)) {
+		NSLog(@"JSONRPCResponseCache: cannot write to the index in %@: %s", _directory, strerror(errno));
+	}
+	[entry release];
+	if (replaced) [self indexRecordsDidDie:1];
+}
+
+// Count the records of the index that no longer describe a response, and rewrite it once they outnumber the others:
+// the index stays proportional to the responses on disk, however often they are replaced
+-(void)indexRecordsDidDie:(NSUInteger)count {
+	_deadIndexRecordsCount += count;
+	if (_deadIndexRecordsCount > MAX([_diskEntries count], kMinDeadIndexRecordsCount)) [self rewriteIndex];
+}
+
+@end
@@ -28,11 +28,16 @@
  */
 
 #import <Foundation/Foundation.h>
+#import "JSONRPCCallScheduler.h"
+#import "JSONRPCResultStreamParser.h"
 
 //! @file JSONRPCResponseHandler.h
 //! @brief Utility object to configure the way to handle the response to a JSON-RPC method call
 
 @class JSONRPCMethodCall;
+@class JSONRPCEndpoint;
+@class JSONRPCInflater;
+@class JSONRPCCallMetrics;
 @protocol JSONRPCDelegate;
 
 
@@ -45,6 +50,11 @@
  */
 @interface NSObject (JSONInitializer)
 -(id)initWithJson:(NSDictionary*)dict; //!< @param dict the NSDictionary representing the JSON object, used to initialize the object instance from a JSON response
+/** @brief Optional. Return NO if initWithJson: must not be called from several threads at the same time
+ * (e.g. it uses a shared NSDateFormatter), so that large arrays of this class are never converted concurrently.
+ * If not implemented, initWithJson: is considered thread-safe.
+ */
++(BOOL)allowsConcurrentJsonConversion;
 @end
 
 
@@ -58,20 +68,54 @@
  * when calling JSONRPCService#callMethod: or similar methods; this returned object help you define
  * how to handle the response returned by the WebService after the method call.
  */
-@interface JSONRPCResponseHandler : NSObject
+@interface JSONRPCResponseHandler : NSObject <JSONRPCResultStreamParserDelegate>
 {
 	//! @privatesection
 	JSONRPCMethodCall* _methodCall;
+	NSURLRequest* _request;
+	id _connection; // NSURLConnection, or JSONRPCLoopbackConnection
 	NSMutableData* _receivedData;
+	NSURLRequest* _sentRequest;
+	id _hedgeConnection;
+	NSMutableData* _hedgeData;
+	CFAbsoluteTime _attemptStartTime;
+	CFAbsoluteTime _hedgeStartTime;
+	JSONRPCEndpoint* _endpoint;
+	JSONRPCEndpoint* _hedgeEndpoint;
+	JSONRPCInflater* _inflater;
+	JSONRPCInflater* _hedgeInflater;
+	BOOL _binaryResponse;
+	BOOL _hedgeBinaryResponse;
+	BOOL _probe;
+	BOOL _hedgeProbe;
+	JSONRPCCallMetrics* _metrics;
+	uint32_t _traceID;
+	CFAbsoluteTime _traceCallTime;
+	CFAbsoluteTime _traceMark;
+	JSONRPCCallPriority _priority;
+	BOOL _cancelled;
+	NSTimeInterval _timeout;
+	CFAbsoluteTime _callStartTime;
+	BOOL _expired;
 	
 	id<NSObject> _delegate;
 	SEL _callbackSelector;
+	Class _callbackClass;   // the class of the target _callbackIMP was resolved for
+	SEL _resolvedCallback;  // the selector _callbackIMP was resolved for
+	IMP _callbackIMP;
+	BOOL _callbackNeedsInvocation;
 #if NS_BLOCKS_AVAILABLE
 	void(^_completionBlock)(JSONRPCMethodCall*,id,NSError*);
+	BOOL(^_resultElementBlock)(JSONRPCMethodCall*,id,NSUInteger);
 #endif
+	JSONRPCResultStreamParser* _streamParser;
+	NSUInteger _streamedElementsCount;
 	
 	Class _resultClass; // instances of this class should conform to JSONInitializer
+	BOOL _lazyResultConversion;
+	BOOL _concurrentResultConversion;
 	int _maxRetryAttempts;
+	NSUInteger _retriesCount;
 	NSTimeInterval _delayBeforeRetry;
 }
 @property(nonatomic,retain) JSONRPCMethodCall* methodCall; //!< the method call attached with this response handler
@@ -89,6 +133,9 @@
  *
  * @note This method is called on the JSONRPCResponseHandler#delegate object if set, or on the JSONRPCService#delegate if not.
  * @note By default, this selector is not set (the default) and the @ref JSONRPCDelegate methodCall:didReturn:error: (JSONRPCDelegate \@protocol) method is called instead.
+ * @note The method implementation is looked up once (when calling setDelegate:callback:, or on the first response) and then
+ *       called directly, so the callback should return void and take three objects. Other signatures still work, but
+ *       are called through an NSInvocation.
  */
 @property(nonatomic,assign) SEL callback;
 /** The class to convert the received object to, if wanted.
@@ -100,6 +147,16 @@
  *       (instead of trying to create the instance of this class by passing the NSArray to initWithJson: directly)
  */
 @property(nonatomic,assign) Class resultClass;
+/** @brief If YES and the result is an NSArray, its objects are converted to the resultClass only when they are first accessed.
+ * The result is then a JSONRPCLazyArray, whose prefetchRange: method converts a range in bulk. Defaults to NO.
+ * Use it for large results of which only a part is displayed at a time (e.g. in a UITableView).
+ */
+@property(nonatomic,assign) BOOL lazyResultConversion;
+/** @brief If YES and the result is a large NSArray, its objects are converted to the resultClass on all cores (see NSArray(JSON)). Defaults to YES.
+ * Set it to NO if the initWithJson: method of the resultClass is not thread-safe (or implement +allowsConcurrentJsonConversion in this class).
+ * Ignored if lazyResultConversion is YES.
+ */
+@property(nonatomic,assign) BOOL concurrentResultConversion;
 
 /** @brief set both the delegate and the callback to call upon receiving the WebService's response
  * @param aDelegate the delegate object that will receive the message (on which the callback will be called)
@@ -126,10 +183,64 @@
  * @param cls the Class to convert the received JSON object to before calling the completionBlock
  */
 -(void)completion:(void(^)(JSONRPCMethodCall* methodCall,id result,NSError* error))completionBlock resultClass:(Class)cls;
+/** @brief Receive the elements of a result array one by one, as soon as each one has been received, instead of the whole array.
+ *
+ * Use it for methods returning very large arrays (exports, synchronization feeds...): the response is parsed as it arrives,
+ * each element is converted to the resultClass (if any) and passed to elementBlock, then released, so the memory used depends
+ * on the largest element and not on the length of the array.
+ *
+ * elementBlock is called on the thread receiving the response, and the following bytes are not read until it returns:
+ * a slow consumer slows the download down (back-pressure) instead of piling elements up in memory.
+ * Return NO from elementBlock to stop: the method call is then cancelled.
+ *
+ * The delegate callback or completion block is still called once the response is complete, with a nil result (and the
+ * error, if any). If the result is not an array, it is delivered there as usual.
+ * @note Once an element has been delivered, the method call is not retried upon network errors, nor hedged.
+ *       MessagePack responses are not streamed, nor recorded by the JSONRPCService#trafficRecorder when streamed.
+ * @param elementBlock the block receiving each element and its index in the array
+ */
+-(void)streamResultElements:(BOOL(^)(JSONRPCMethodCall* methodCall,id element,NSUInteger index))elementBlock;
 #endif
+@property(nonatomic, readonly) NSUInteger streamedElementsCount; //!< number of result elements delivered to the streamResultElements: block
 
-@property(nonatomic, assign) int maxRetryAttempts;
+@property(nonatomic, assign) int maxRetryAttempts; //!< The number of retries left for this method call upon network errors. Defaults to 2.
+/** @brief The delay before the first retry, overriding JSONRPCRetryPolicy#initialDelay for this method call. 0 (the default) uses the policy.
+ * Subsequent retries back off according to the JSONRPCService#retryPolicy. If the service has no retryPolicy, every retry
+ * waits this delay (0.5s if not set).
+ */
 @property(nonatomic, assign) NSTimeInterval delayBeforeRetry;
 -(void)retryRequest; //!< Relaunch the request associated with this responseHandler.  You should not need to call this method yourself as this is done automatically upon network error
+
+/** @brief The priority class of the method call, used by the JSONRPCService#scheduler to order pending calls.
+ * Defaults to JSONRPCCallPriorityNormal. Calls of the same priority are sent in the order they were made.
+ */
+@property(nonatomic, assign) JSONRPCCallPriority priority;
+/** @brief Cancel the method call.
+ *
+ * If the request is still waiting in the JSONRPCService#scheduler queue, it is removed from it; if it has been sent, the connection
+ * is torn down and the response, if any, is dropped without being parsed. Pending retries are cancelled too.
+ * No delegate method nor completion block will be called for this method call afterwards.
+ */
+-(void)cancel;
+@property(nonatomic, readonly, getter=isCancelled) BOOL cancelled; //!< YES if the method call has been cancelled
+
+/** @brief The time budget of the method call, in seconds. 0 means use the JSONRPCService#defaultTimeout.
+ *
+ * The deadline starts when the method is called and covers the time spent waiting in the JSONRPCService#scheduler queue,
+ * connecting, transferring and parsing the response, and every retry. Retries are not attempted if the remaining budget
+ * is shorter than the delay before the retry.
+ *
+ * When the deadline expires, the connection is torn down and an NSError with the JSONRPCTimeoutErrorCode code
+ * (JSONRPCInternalErrorDomain) is forwarded as for any other connection error (see @ref ErrMgmt).
+ */
+@property(nonatomic, assign) NSTimeInterval timeout;
+@property(nonatomic, readonly) NSTimeInterval remainingTime; //!< The time left before the deadline, or a negative value if no timeout applies to this method call.
+
+@property(nonatomic, retain) NSURLRequest* request; //!< the HTTP request to send for this method call. @internal
+-(void)startConnection; //!< Send the request. Called by the JSONRPCCallScheduler when a slot is available. @internal
+-(void)startDeadlineTimer; //!< Start counting the time budget of the method call. Called by the JSONRPCService. @internal
+-(void)startMetricsAtTime:(CFAbsoluteTime)callTime requestBytes:(NSUInteger)requestBytes; //!< Start measuring the method call for the JSONRPCService#metricsObserver. @internal
+-(void)startTraceAtTime:(CFAbsoluteTime)callTime; //!< Start recording the spans of the method call in the JSONRPCService#tracer. @internal
+-(void)deliverCachedResponse:(NSData*)response; //!< Answer the method call with a response of the JSONRPCService#responseCache instead of sending the request. Called by the JSONRPCService. @internal
 @end
 
@@ -33,11 +33,41 @@
 #import "JSONRPCMethodCall.h"
 #import "JSONRPCService.h"
 #import "JSONRPC_Extensions.h"
+#import "JSONRPCHedgingPolicy.h"
+#import "JSONRPCMessagePack.h"
+#import "JSONRPCMetrics.h"
+#import "JSONRPCTracer.h"
+#import "JSONRPCLoopback.h"
+#import <objc/runtime.h>
+
+typedef void (*JSONRPCCallbackIMP)(id, SEL, JSONRPCMethodCall*, id, NSError*); // -(void)methodCall:didReturn:error:
+static const char* const kOutcomeNames[] = { "succeeded", "failed", "cancelled" }; // JSONRPCAttemptOutcome names, for the traces
 
 //! @private Private API @internal
 @interface JSONRPCResponseHandler()
 -(id)objectFromJson:(id)jsonObject; //!< @private @internal
+-(void)resolveCallbackForTarget:(id)target selector:(SEL)sel; //!< @private @internal
 -(void)forwardConnectionError:(NSError*)error; //!< @private @internal
+-(void)connectionDidEnd; //!< @private @internal
+-(id)parseResponseData:(NSData*)data binary:(BOOL)binary error:(NSError**)error; //!< @private @internal
+-(void)dispatchResponseObject:(id)respObj streamedResult:(BOOL)streamedResult parsedTime:(CFAbsoluteTime)parsedTime; //!< @private @internal
+-(void)dispatchCachedResponse:(NSData*)response; //!< @private @internal
+-(void)sendHedgedRequest; //!< @private @internal
+-(void)promoteHedgedConnection; //!< @private @internal
+-(void)dropHedgedConnection; //!< @private @internal
+-(void)endAttempt:(JSONRPCAttemptOutcome)outcome; //!< @private @internal
+-(void)endHedgedAttempt:(JSONRPCAttemptOutcome)outcome; //!< @private @internal
+-(id)newConnectionWithRequest:(NSURLRequest*)req; //!< @private @internal
+-(void)tearDown; //!< @private @internal
+-(void)recycleBuffer:(NSMutableData**)buffer; //!< @private @internal
+-(void)abortResponseFromConnection:(id)connection withError:(NSError*)error; //!< @private @internal
+-(NSTimeInterval)effectiveTimeout; //!< @private @internal
+-(void)deadlineTimerFired; //!< @private @internal
+-(void)deadlineExpiredWithError:(NSError*)underlyingError; //!< @private @internal
+-(void)failWithCircuitOpen; //!< @private @internal
+-(NSTimeInterval)nextRetryDelay; //!< @private @internal
+-(void)reportCallEndWithError:(NSError*)error; //!< @private @internal
+-(void)traceSpan:(const char*)name from:(CFAbsoluteTime)start attempt:(int)attempt outcome:(const char*)outcome; //!< @private @internal
 @end
 
 @implementation JSONRPCResponseHandler
@@ -46,14 +76,22 @@
 @synthesize callback = _callbackSelector;
 
 @synthesize resultClass = _resultClass;
-@synthesize maxRetryAttempts = _maxRetryAttempts, delayBeforeRetry = delayBeforeRetry;
+@synthesize lazyResultConversion = _lazyResultConversion;
+@synthesize concurrentResultConversion = _concurrentResultConversion;
+@synthesize streamedElementsCount = _streamedElementsCount;
+@synthesize request = _request;
+@synthesize priority = _priority;
+@synthesize cancelled = _cancelled;
+@synthesize timeout = _timeout;
+@synthesize maxRetryAttempts = _maxRetryAttempts, delayBeforeRetry = _delayBeforeRetry;
 
 - (id) init
 {
 	self = [super init];
 	if (self != nil) {
 		_maxRetryAttempts = 2;
-		_delayBeforeRetry = 0.5;
+		_concurrentResultConversion = YES;
+		_priority = JSONRPCCallPriorityNormal;
 	}
 	return self;
 }
@@ -65,6 +103,31 @@
 	self.callback = callback;
 	if (![aDelegate respondsToSelector:callback]) {
 		NSLog(@"%@ warning: %@ does not respond to selector %@",[self class],aDelegate,NSStringFromSelector(callback));
+	} else {
+		[self resolveCallbackForTarget:aDelegate selector:callback];
+	}
+}
+
+-(void)resolveCallbackForTarget:(id)target selector:(SEL)sel {
+	_callbackClass = object_getClass(target);
+	_resolvedCallback = sel;
+	_callbackIMP = NULL;
+	_callbackNeedsInvocation = NO;
+	if (!target || ![target respondsToSelector:sel]) return;
+	
+	// the IMP can only be called directly with the -(void)x:(id)a y:(id)b z:(id)c signature
+	NSMethodSignature* sig = [target methodSignatureForSelector:sel];
+	const char* ret = [sig methodReturnType];
+	while (ret && *ret && strchr("rnNoORV", *ret)) ++ret; // type qualifiers (oneway, ...)
+	BOOL directCall = sig && ([sig numberOfArguments] == 5) && ret && (*ret == 'v');
+	for(NSUInteger i=2; directCall && i<5; ++i) {
+		directCall = ([sig getArgumentTypeAtIndex:i][0] == '@');
+	}
+	if (directCall) {
+		_callbackIMP = class_getMethodImplementation(_callbackClass, sel); // the forwarding IMP if the target forwards it
+	} else {
+		NSLog(@"%@ warning: %@ should return void and take three objects (JSONRPCMethodCall*, id, NSError*)",[self class],NSStringFromSelector(sel));
+		_callbackNeedsInvocation = YES;
 	}
 }
 -(void)setDelegate:(id<NSObject>)aDelegate callback:(SEL)callback resultClass:(Class)cls {
@@ -80,29 +143,485 @@
 	[self completion:completionBlock];
 	self.resultClass = cls;
 }
+-(void)streamResultElements:(BOOL(^)(JSONRPCMethodCall* methodCall,id element,NSUInteger index))elementBlock {
+	[_resultElementBlock release];
+	_resultElementBlock = [elementBlock copy];
+}
 #endif
 
+-(void)setPriority:(JSONRPCCallPriority)priority {
+	JSONRPCCallPriority oldPriority = _priority;
+	_priority = priority;
+	[self.methodCall.service.scheduler responseHandler:self didChangePriorityFrom:oldPriority];
+}
+
 -(void)dealloc {
+	// given back while the methodCall still leads to the pool, so that they don't count as outstanding forever
+	[self recycleBuffer:&_receivedData];
+	[self recycleBuffer:&_hedgeData];
 	[_methodCall release];
+	[_request release];
+	[_connection release];
+	[_sentRequest release];
+	[_hedgeConnection release];
+	[_endpoint release];
+	[_hedgeEndpoint release];
+	[_inflater release];
+	[_hedgeInflater release];
+	[_metrics release];
 	[_delegate release];
 	[_completionBlock release];
+	[_resultElementBlock release];
+	[_streamParser release];
 	[super dealloc];
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Connection management
+/////////////////////////////////////////////////////////////////////////////
+
+-(void)startConnection {
+	NSTimeInterval remaining = self.remainingTime;
+	if (remaining == 0) {
+		[self deadlineExpiredWithError:nil];
+		return;
+	}
+	
+	NSMutableURLRequest* req = [[_request mutableCopy] autorelease];
+	if (remaining > 0) {
+		[req setTimeoutInterval:remaining];
+		if (self.methodCall.service.sendsTimeoutHeader) {
+			[req setValue:[NSString stringWithFormat:@"%.0f",remaining*1000] forHTTPHeaderField:JSONRPCTimeoutHeaderField];
+		}
+	}
+	[self endAttempt:JSONRPCAttemptCancelled];
+	if ([self.methodCall.service.endpoints count]) {
+		_endpoint = [[self.methodCall.service selectEndpointExcluding:nil] retain];
+		if (!_endpoint) {
+			[self failWithCircuitOpen];
+			return;
+		}
+		[req setURL:_endpoint.URL];
+	}
+	
+	[_sentRequest release];
+	_sentRequest = [req retain];
+	[_connection release];
+	_connection = [self newConnectionWithRequest:req];
+	_attemptStartTime = CFAbsoluteTimeGetCurrent();
+	_probe = [_endpoint attemptDidStart];
+	if (_traceID) [self traceSpan:"queue" from:_traceMark attempt:-1 outcome:NULL];
+	if (_metrics) {
+		if (!_metrics.sentTime) _metrics.sentTime = _attemptStartTime;
+		_metrics.attemptTime = _attemptStartTime;
+		_metrics.responseTime = _metrics.firstByteTime = 0;
+		_metrics.responseBytes = 0;
+	}
+	
+	JSONRPCHedgingPolicy* hedging = self.methodCall.service.hedgingPolicy;
+	if (hedging && [hedging shouldHedgeMethodCall:self.methodCall attempt:_retriesCount]) {
+		NSTimeInterval hedgeDelay = [hedging hedgeDelayForMethodName:self.methodCall.methodName];
+		[self performSelector:@selector(sendHedgedRequest) withObject:nil afterDelay:hedgeDelay];
+	}
+}
+
+// Send the request over the network, or to the loopback handler of the service
+-(id)newConnectionWithRequest:(NSURLRequest*)req {
+#if NS_BLOCKS_AVAILABLE
+	JSONRPCLoopbackHandler loopbackHandler = self.methodCall.service.loopbackHandler;
+	if (loopbackHandler) {
+		return [[JSONRPCLoopbackConnection alloc] initWithRequest:req delegate:self handler:loopbackHandler];
+	}
+#endif
+	return [[NSURLConnection alloc] initWithRequest:req delegate:self];
+}
+
+-(void)tearDown {
+	[NSObject cancelPreviousPerformRequestsWithTarget:self];
+	[self dropHedgedConnection];
+	[self endAttempt:JSONRPCAttemptCancelled];
+	[_connection cancel];
+	[_connection release];
+	_connection = nil;
+	[self recycleBuffer:&_receivedData];
+	[_inflater release];
+	_inflater = nil;
+	[_streamParser release];
+	_streamParser = nil;
+	[self.methodCall.service.scheduler cancelResponseHandler:self];
+}
+
+// Give the receive buffer, and our reference to it, back to the service's pool
+-(void)recycleBuffer:(NSMutableData**)buffer {
+	if (!*buffer) return;
+	JSONRPCBufferPool* pool = self.methodCall.service.bufferPool;
+	if (pool) [pool recycleBuffer:*buffer];
+	else [*buffer release];
+	*buffer = nil;
+}
+
+-(void)cancel {
+	if (_cancelled || _expired) return;
+	[[self retain] autorelease]; // the scheduler may hold the last reference on us
+	_cancelled = YES;
+	[self tearDown];
+	_metrics.cancelled = YES;
+	[self reportCallEndWithError:nil];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Metrics
+/////////////////////////////////////////////////////////////////////////////
+
+-(void)startMetricsAtTime:(CFAbsoluteTime)callTime requestBytes:(NSUInteger)requestBytes {
+	[_metrics release];
+	_metrics = [[JSONRPCCallMetrics alloc] init];
+	_metrics.methodName = self.methodCall.methodName;
+	_metrics.callTime = callTime;
+	_metrics.serializedTime = CFAbsoluteTimeGetCurrent();
+	_metrics.requestBytes = requestBytes;
+}
+
+-(void)startTraceAtTime:(CFAbsoluteTime)callTime {
+	_traceID = [self.methodCall.service.tracer newCallID];
+	_traceCallTime = callTime;
+	_traceMark = CFAbsoluteTimeGetCurrent();
+	[self traceSpan:"serialize" from:callTime attempt:-1 outcome:NULL];
+}
+
+-(void)traceSpan:(const char*)name from:(CFAbsoluteTime)start attempt:(int)attempt outcome:(const char*)outcome {
+	[self.methodCall.service.tracer recordSpan:name label:nil callID:_traceID
+										 start:start end:CFAbsoluteTimeGetCurrent() attempt:attempt outcome:outcome];
+}
+
+// Send the metrics to the observer and close the trace of the call, once per method call
+-(void)reportCallEndWithError:(NSError*)error {
+	if (_traceID) {
+		const char* outcome = _cancelled ? "cancelled" : (error ? "failed" : "succeeded");
+		[self.methodCall.service.tracer recordSpan:"call" label:self.methodCall.methodName callID:_traceID
+											 start:_traceCallTime end:CFAbsoluteTimeGetCurrent() attempt:-1 outcome:outcome];
+		_traceID = 0;
+	}
+	
+	if (!_metrics) return;
+	JSONRPCCallMetrics* metrics = _metrics;
+	_metrics = nil;
+	metrics.error = error;
+	metrics.retriesCount = _retriesCount;
+	[self.methodCall.service.metricsObserver methodCall:self.methodCall didFinishWithMetrics:metrics];
+	[metrics release];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Deadline
+/////////////////////////////////////////////////////////////////////////////
+
+-(NSTimeInterval)effectiveTimeout {
+	return _timeout ?: self.methodCall.service.defaultTimeout;
+}
+
+-(NSTimeInterval)remainingTime {
+	NSTimeInterval t = [self effectiveTimeout];
+	if (!t || !_callStartTime) return -1;
+	return MAX(0, _callStartTime + t - CFAbsoluteTimeGetCurrent());
+}
+
+-(void)setTimeout:(NSTimeInterval)timeout {
+	_timeout = timeout;
+	if (_callStartTime) {
+		// re-arm the timer with the new budget
+		[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(deadlineTimerFired) object:nil];
+		NSTimeInterval remaining = self.remainingTime;
+		if (remaining >= 0) {
+			[self performSelector:@selector(deadlineTimerFired) withObject:nil afterDelay:remaining];
+		}
+	}
+}
+
+-(void)startDeadlineTimer {
+	_callStartTime = CFAbsoluteTimeGetCurrent();
+	_expired = NO;
+	self.timeout = _timeout;
+}
+
+-(void)deadlineTimerFired {
+	[self deadlineExpiredWithError:nil];
+}
+
+-(void)deadlineExpiredWithError:(NSError*)underlyingError {
+	if (_cancelled || _expired) return;
+	[[self retain] autorelease]; // the scheduler may hold the last reference on us
+	_expired = YES;
+	[self tearDown];
+	
+	NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCTimeoutErrorString" value:JSONRPCTimeoutErrorString table:nil];
+	NSMutableDictionary* userInfo = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+									 locDesc,NSLocalizedDescriptionKey,
+									 [NSNumber numberWithDouble:[self effectiveTimeout]],@"timeout",
+									 nil];
+	if (underlyingError) [userInfo setObject:underlyingError forKey:NSUnderlyingErrorKey];
+	[self forwardConnectionError:[NSError errorWithDomain:JSONRPCInternalErrorDomain code:JSONRPCTimeoutErrorCode userInfo:userInfo]];
+}
+
+// Fail immediately, without sending any request, while every endpoint is known to be failing
+-(void)failWithCircuitOpen {
+	[[self retain] autorelease]; // the scheduler may hold the last reference on us
+	[NSObject cancelPreviousPerformRequestsWithTarget:self];
+	[self.methodCall.service.scheduler responseHandlerDidFinish:self];
+	
+	NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCCircuitOpenErrorString" value:JSONRPCCircuitOpenErrorString table:nil];
+	NSDictionary* userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+							  locDesc,NSLocalizedDescriptionKey,
+							  self.methodCall.service.endpoints,@"endpoints",
+							  nil];
+	[self forwardConnectionError:[NSError errorWithDomain:JSONRPCInternalErrorDomain code:JSONRPCCircuitOpenErrorCode userInfo:userInfo]];
+}
+
+-(void)connectionDidEnd {
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(sendHedgedRequest) object:nil];
+	[self dropHedgedConnection];
+	[self endAttempt:JSONRPCAttemptCancelled]; // no-op if the outcome has already been reported
+	[_connection release];
+	_connection = nil;
+	[self.methodCall.service.scheduler responseHandlerDidFinish:self];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Hedging
+/////////////////////////////////////////////////////////////////////////////
+
+-(void)sendHedgedRequest {
+	if (!_connection || _hedgeConnection) return;
+#if NS_BLOCKS_AVAILABLE
+	if (_resultElementBlock) return; // the elements would be delivered twice
+#endif
+	JSONRPCHedgingPolicy* hedging = self.methodCall.service.hedgingPolicy;
+	JSONRPCEndpoint* hedgeEndpoint = nil;
+	if (!hedging.hedgeURL && _endpoint) {
+		// prefer another replica than the one which is slow to respond
+		hedgeEndpoint = [self.methodCall.service selectEndpointExcluding:_endpoint];
+		if (!hedgeEndpoint) return; // every circuit is open
+	}
+	JSONRPCCallScheduler* scheduler = self.methodCall.service.scheduler;
+	if (![scheduler reserveHedgeSlot]) return;
+	if (![hedging reserveHedge]) {
+		[scheduler releaseHedgeSlot];
+		return;
+	}
+	
+	NSMutableURLRequest* req = [[_sentRequest mutableCopy] autorelease];
+	if (hedging.hedgeURL) {
+		[req setURL:hedging.hedgeURL];
+	} else if (hedgeEndpoint) {
+		_hedgeEndpoint = [hedgeEndpoint retain];
+		[req setURL:_hedgeEndpoint.URL];
+	}
+	NSTimeInterval remaining = self.remainingTime;
+	if (remaining > 0) [req setTimeoutInterval:remaining];
+	_hedgeConnection = [self newConnectionWithRequest:req];
+	_hedgeStartTime = CFAbsoluteTimeGetCurrent();
+	_hedgeProbe = [_hedgeEndpoint attemptDidStart];
+}
+
+// Keep only the hedged request, which becomes the main attempt
+-(void)promoteHedgedConnection {
+	[self endAttempt:JSONRPCAttemptCancelled]; // no-op if the outcome has already been reported
+	[_connection cancel];
+	[_connection release];
+	_connection = _hedgeConnection;
+	_hedgeConnection = nil;
+	[self.methodCall.service.scheduler releaseHedgeSlot]; // the main attempt's slot is kept
+	[self recycleBuffer:&_receivedData];
+	_receivedData = _hedgeData;
+	_hedgeData = nil;
+	[_inflater release];
+	_inflater = _hedgeInflater;
+	_hedgeInflater = nil;
+	_binaryResponse = _hedgeBinaryResponse;
+	_endpoint = _hedgeEndpoint;
+	_hedgeEndpoint = nil;
+	_probe = _hedgeProbe;
+	_attemptStartTime = _hedgeStartTime;
+}
+
+-(void)dropHedgedConnection {
+	[self endHedgedAttempt:JSONRPCAttemptCancelled]; // no-op if the outcome has already been reported
+	if (_hedgeConnection) {
+		[_hedgeConnection cancel];
+		[_hedgeConnection release];
+		_hedgeConnection = nil;
+		[self.methodCall.service.scheduler releaseHedgeSlot];
+	}
+	[self recycleBuffer:&_hedgeData];
+	[_hedgeInflater release];
+	_hedgeInflater = nil;
+}
+
+// Report the outcome of the request to its endpoint, for load balancing and health tracking
+-(void)endAttempt:(JSONRPCAttemptOutcome)outcome {
+	if (_traceID && _endpoint) [self traceSpan:"attempt" from:_attemptStartTime attempt:(int)_retriesCount outcome:kOutcomeNames[outcome]];
+	[_endpoint attemptDidEnd:outcome latency:CFAbsoluteTimeGetCurrent()-_attemptStartTime probe:_probe];
+	[_endpoint release];
+	_endpoint = nil;
+}
+-(void)endHedgedAttempt:(JSONRPCAttemptOutcome)outcome {
+	if (_traceID && _hedgeEndpoint) [self traceSpan:"hedge" from:_hedgeStartTime attempt:(int)_retriesCount outcome:kOutcomeNames[outcome]];
+	[_hedgeEndpoint attemptDidEnd:outcome latency:CFAbsoluteTimeGetCurrent()-_hedgeStartTime probe:_hedgeProbe];
+	[_hedgeEndpoint release];
+	_hedgeEndpoint = nil;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: NSURLConnection delegate
 /////////////////////////////////////////////////////////////////////////////
 
 - (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
 {
-	[_receivedData release];
-	_receivedData = [[NSMutableData alloc] init];
+	JSONRPCInflater* inflater = nil;
+	if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+		NSString* encoding = [[(NSHTTPURLResponse*)response allHeaderFields] objectForKey:@"Content-Encoding"];
+		if (encoding && [encoding caseInsensitiveCompare:@"identity"] != NSOrderedSame) {
+			inflater = [[JSONRPCInflater alloc] initWithStats:self.methodCall.service.compressionStats];
+		}
+	}
+	
+	BOOL binary = ([[response MIMEType] caseInsensitiveCompare:JSONRPCMessagePackMIMEType] == NSOrderedSame);
+	if (_metrics && !_metrics.responseTime) _metrics.responseTime = CFAbsoluteTimeGetCurrent();
+	
+	JSONRPCService* service = self.methodCall.service;
+	long long expectedLength = [response expectedContentLength]; // NSURLResponseUnknownLength (-1) if not sent
+	if (service.maxResponseSize && expectedLength > (long long)service.maxResponseSize
+#if NS_BLOCKS_AVAILABLE
+		&& !_resultElementBlock // only the largest element is held
+#endif
+		) {
+		[inflater release];
+		[self abortResponseFromConnection:connection withError:nil];
+		return;
+	}
+	// presized from the Content-Length (only a lower bound if the response is compressed)
+	NSMutableData* buffer = [service.bufferPool newBufferWithCapacity:(expectedLength > 0 ? (NSUInteger)expectedLength : 0)];
+	
+	if (connection == _hedgeConnection) {
+		[self recycleBuffer:&_hedgeData];
+		_hedgeData = buffer;
+		[_hedgeInflater release];
+		_hedgeInflater = inflater;
+		_hedgeBinaryResponse = binary;
+	} else {
+		[self recycleBuffer:&_receivedData];
+		_receivedData = buffer;
+		[_inflater release];
+		_inflater = inflater;
+		_binaryResponse = binary;
+		[_streamParser release];
+		_streamParser = nil;
+#if NS_BLOCKS_AVAILABLE
+		if (_resultElementBlock && !binary) _streamParser = [[JSONRPCResultStreamParser alloc] initWithDelegate:self];
+#endif
+	}
 }
 - (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
 {
-	[_receivedData appendData:data];
+	BOOL fromHedge = (connection == _hedgeConnection);
+	NSMutableData* buffer = fromHedge ? _hedgeData : _receivedData;
+	JSONRPCInflater* inflater = fromHedge ? _hedgeInflater : _inflater;
+	if (_metrics) {
+		if (!_metrics.firstByteTime) _metrics.firstByteTime = CFAbsoluteTimeGetCurrent();
+		_metrics.responseBytes += [data length];
+	}
+	if (inflater) {
+		// inflate as the chunks arrive, so that the whole compressed response is never kept
+		[inflater inflateChunk:data into:buffer];
+	} else {
+		[buffer appendData:data];
+	}
+	NSUInteger received = [buffer length];
+	if (!fromHedge && _streamParser) {
+		// parse what has been received so far, and keep only the element being received
+		JSONRPCResultStreamParser* parser = [[_streamParser retain] autorelease]; // the element block may cancel us
+		BOOL parsing = [parser parseBytes:[buffer bytes] length:[buffer length]];
+		if (_cancelled || _expired) return;
+		[buffer setLength:0];
+		if (!parsing) {
+			if (parser.error) [self abortResponseFromConnection:connection withError:parser.error];
+			else [self cancel]; // stopped by the resultElementBlock
+			return;
+		}
+		received = parser.bufferedBytes;
+	}
+	NSUInteger maxSize = self.methodCall.service.maxResponseSize;
+	if (maxSize && received > maxSize) {
+		[self abortResponseFromConnection:connection withError:nil];
+	}
+}
+
+// Give up the response being received (error is nil if it is too large)
+-(void)abortResponseFromConnection:(id)connection withError:(NSError*)error {
+	if (connection == _hedgeConnection) {
+		// the original request is still running
+		[self endHedgedAttempt:JSONRPCAttemptFailed];
+		[self dropHedgedConnection];
+		return;
+	} else if (_hedgeConnection) {
+		// the hedged request is still running, keep waiting for it
+		[self endAttempt:JSONRPCAttemptFailed];
+		[self promoteHedgedConnection];
+		return;
+	}
+	
+	[self endAttempt:JSONRPCAttemptFailed];
+	[_connection cancel];
+	[self connectionDidEnd];
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(deadlineTimerFired) object:nil];
+	[self recycleBuffer:&_receivedData];
+	[_inflater release];
+	_inflater = nil;
+	[[_streamParser retain] autorelease]; // error may belong to it
+	[_streamParser release];
+	_streamParser = nil;
+	
+	if (!error) {
+		NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCResponseTooLargeErrorString" value:JSONRPCResponseTooLargeErrorString table:nil];
+		NSDictionary* userInfo = [NSDictionary dictionaryWithObject:locDesc forKey:NSLocalizedDescriptionKey];
+		error = [NSError errorWithDomain:JSONRPCInternalErrorDomain code:JSONRPCResponseTooLargeErrorCode userInfo:userInfo];
+	}
+	NSLog(@"[JSON-RPC] %@",[error localizedDescription]);
+	[self forwardConnectionError:error];
+}
+
+-(BOOL)resultStreamParser:(JSONRPCResultStreamParser*)parser didParseElement:(id)element atIndex:(NSUInteger)index {
+	if (_resultClass) {
+		element = [[[_resultClass alloc] initWithJson:element] autorelease] ?: [NSNull null];
+	}
+	_maxRetryAttempts = 0; // the elements delivered cannot be taken back
+	_streamedElementsCount = index+1;
+#if NS_BLOCKS_AVAILABLE
+	return _resultElementBlock(self.methodCall, element, index);
+#else
+	return YES;
+#endif
+}
+
+-(NSTimeInterval)nextRetryDelay {
+	JSONRPCRetryPolicy* policy = self.methodCall.service.retryPolicy;
+	if (!policy) return _delayBeforeRetry ?: 0.5;
+	return [policy delayBeforeRetry:_retriesCount+1 baseDelay:_delayBeforeRetry];
 }
 
 -(void)retryRequest {
+	if (_cancelled || _expired) return;
 	--_maxRetryAttempts;
+	++_retriesCount;
+	if (_traceID) {
+		[self traceSpan:"backoff" from:_traceMark attempt:(int)_retriesCount outcome:NULL];
+		_traceMark = CFAbsoluteTimeGetCurrent();
+	}
 	if (_delegate && [_delegate respondsToSelector:@selector(methodCallIsRetrying:)]) {
 		[(id<JSONRPCDelegate>)_delegate methodCallIsRetrying:self.methodCall];
 	}
@@ -123,115 +642,304 @@
 		}
 		(void)cont; // UNUSED AFTER THAT
 	}
+	[self reportCallEndWithError:error];
 }
 
 - (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
 {
-	[UIApplication sharedApplication].networkActivityIndicatorVisible = NO;
-	[_receivedData release];
-	_receivedData = nil;
+	if (connection == _hedgeConnection) {
+		// the original request is still running
+		[self endHedgedAttempt:JSONRPCAttemptFailed];
+		[self dropHedgedConnection];
+		return;
+	} else if (_hedgeConnection) {
+		// the hedged request is still running, keep waiting for it
+		[self endAttempt:JSONRPCAttemptFailed];
+		[self promoteHedgedConnection];
+		return;
+	}
+	
+	[self endAttempt:JSONRPCAttemptFailed];
+	[self connectionDidEnd];
+	[self recycleBuffer:&_receivedData];
+	[_inflater release];
+	_inflater = nil;
+	[_streamParser release];
+	_streamParser = nil;
 
 	BOOL networkDomain = ( ([error domain] == NSURLErrorDomain) /* || ([error domain] == (NSString*)kCFErrorDomainCFNetwork) */ );
-	if ( networkDomain /* && ([error code]==NSURLErrorNetworkConnectionLost) */ && (_maxRetryAttempts>0)) {
+	BOOL canRetry = networkDomain /* && ([error code]==NSURLErrorNetworkConnectionLost) */ && (_maxRetryAttempts>0);
+	NSTimeInterval retryDelay = canRetry ? [self nextRetryDelay] : 0;
+	NSTimeInterval remaining = self.remainingTime;
+	BOOL timedOut = networkDomain && ([error code] == NSURLErrorTimedOut);
+	if ((remaining >= 0) && (timedOut || (canRetry && remaining <= retryDelay))) {
+		// Not enough time left to retry: fail fast
+		[self deadlineExpiredWithError:error];
+		return;
+	}
+	if (canRetry && self.methodCall.service.retryPolicy) {
+		// Don't add to the load of a server in trouble beyond the retry budget
+		canRetry = [self.methodCall.service.retryPolicy reserveRetry];
+	}
+	
+	if (canRetry) {
 		// Retry
-		NSLog(@"Connection lost. Retrying call to %@ (TTL=%d).",self.methodCall.methodName,_maxRetryAttempts);
+		NSLog(@"Connection lost. Retrying call to %@ in %.2fs (TTL=%d).",self.methodCall.methodName,retryDelay,_maxRetryAttempts);
 		if (_delegate && [_delegate respondsToSelector:@selector(methodCall:willRetryAfterError:)]) {
 			[(id<JSONRPCDelegate>)_delegate methodCall:self.methodCall willRetryAfterError:error];
 		}
-		[self performSelector:@selector(retryRequest) withObject:nil afterDelay:_delayBeforeRetry];
+		_traceMark = CFAbsoluteTimeGetCurrent();
+		[self performSelector:@selector(retryRequest) withObject:nil afterDelay:retryDelay];
 	} else {
+		[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(deadlineTimerFired) object:nil];
 		[self forwardConnectionError:error];
 	}
 }
 - (void)connectionDidFinishLoading:(NSURLConnection *)connection
 {
-	[UIApplication sharedApplication].networkActivityIndicatorVisible = NO;
+	if (_cancelled || _expired) return;
 	
-	NSError* jsonParsingError = nil;
-	NSString* jsonStr = [[[NSString alloc] initWithData:_receivedData encoding:NSUTF8StringEncoding] autorelease];
-	SBJSON* parser = [[SBJSON alloc] init];
-	id respObj = [parser objectWithString:jsonStr error:&jsonParsingError];
-	[parser release];
-
-	[_receivedData release];
-	_receivedData = nil;
+	BOOL fromHedge = (connection == _hedgeConnection);
+	BOOL otherAttemptRunning = fromHedge ? (_connection != nil) : (_hedgeConnection != nil);
+	CFAbsoluteTime lastByteTime = CFAbsoluteTimeGetCurrent();
+	_metrics.lastByteTime = lastByteTime;
+	NSError* parsingError = [(fromHedge ? _hedgeInflater : _inflater) finish];
+	// when the result is streamed, only the rest of the response is left to parse
+	JSONRPCResultStreamParser* streamParser = fromHedge ? nil : [[_streamParser retain] autorelease];
+	[_streamParser release];
+	_streamParser = nil;
+	id respObj = nil;
+	if (!parsingError) {
+		respObj = [self parseResponseData:(streamParser ? streamParser.envelopeData : (fromHedge ? _hedgeData : _receivedData))
+								   binary:(fromHedge ? _hedgeBinaryResponse : _binaryResponse)
+									error:&parsingError];
+	}
+	CFAbsoluteTime parsedTime = CFAbsoluteTimeGetCurrent();
+	_metrics.parsedTime = parsedTime;
+	if (parsingError && otherAttemptRunning) {
+		// Not a valid response: the other attempt may do better
+		if (fromHedge) {
+			[self endHedgedAttempt:JSONRPCAttemptFailed];
+			[self dropHedgedConnection];
+		} else {
+			[self endAttempt:JSONRPCAttemptFailed];
+			[self promoteHedgedConnection];
+		}
+		return;
+	}
+	
+	JSONRPCTrafficRecorder* recorder = self.methodCall.service.trafficRecorder;
+	if (recorder && !streamParser) {
+		[recorder recordMethodName:self.methodCall.methodName request:_sentRequest
+						  response:(fromHedge ? _hedgeData : _receivedData) binaryResponse:(fromHedge ? _hedgeBinaryResponse : _binaryResponse)
+						  callTime:_callStartTime duration:lastByteTime-_callStartTime];
+	}
+	
+	JSONRPCResponseCache* cache = self.methodCall.service.responseCache;
+	if (cache && !parsingError && !streamParser && !(fromHedge ? _hedgeBinaryResponse : _binaryResponse)
+		&& [respObj isKindOfClass:[NSDictionary class]]) {
+		// only the successful responses
+		id errorJsonObject = [respObj objectForKey:@"error"];
+		if (!errorJsonObject || errorJsonObject == [NSNull null]) {
+			[cache storeResponse:(fromHedge ? _hedgeData : _receivedData) forMethodName:self.methodCall.methodName
+					  parameters:self.methodCall.parameters serviceNamespace:self.methodCall.service.responseCacheNamespace];
+		}
+	}
+	
+	JSONRPCHedgingPolicy* hedging = self.methodCall.service.hedgingPolicy;
+	if (fromHedge) {
+		[self promoteHedgedConnection];
+		[hedging hedgeDidWin];
+	}
+	if (!parsingError) {
+		[hedging recordLatency:CFAbsoluteTimeGetCurrent()-_attemptStartTime forMethodName:self.methodCall.methodName];
+	}
+	[self endAttempt:(parsingError ? JSONRPCAttemptFailed : JSONRPCAttemptSucceeded)];
+	[self connectionDidEnd];
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(deadlineTimerFired) object:nil];
+	[self recycleBuffer:&_receivedData];
+	[_inflater release];
+	_inflater = nil;
+	if (_traceID) {
+		[self.methodCall.service.tracer recordSpan:"parse" label:nil callID:_traceID
+											 start:lastByteTime end:parsedTime attempt:-1 outcome:(parsingError ? "failed" : NULL)];
+	}
 
-	if (jsonParsingError) {
-		// raise an error regarding JSON Parsing
-		NSMutableDictionary* verboseUserInfo = [NSMutableDictionary dictionaryWithDictionary:[jsonParsingError userInfo]];
-		[verboseUserInfo setObject:jsonStr?:@"" forKey:JSONRPCErrorJSONObjectKey];
-		[self forwardConnectionError:[NSError errorWithDomain:[jsonParsingError domain] code:[jsonParsingError code] userInfo:verboseUserInfo]];
+	if (parsingError) {
+		[self forwardConnectionError:parsingError];
 	} else {
-		// extract result from JSON response
-		if (![respObj isKindOfClass:[NSDictionary class]]) {
-			NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCFormatErrorString" value:JSONRPCFormatErrorString table:nil];
-			NSLog(@"[JSON-RPC] %@",locDesc);
+		[self dispatchResponseObject:respObj streamedResult:streamParser.streamedResult parsedTime:parsedTime];
+	}
+}
+
+// Extract the result or the error of the response, convert the result and call the delegate or the completion block
+-(void)dispatchResponseObject:(id)respObj streamedResult:(BOOL)streamedResult parsedTime:(CFAbsoluteTime)parsedTime {
+	// extract result from JSON response
+	if (![respObj isKindOfClass:[NSDictionary class]]) {
+		NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCFormatErrorString" value:JSONRPCFormatErrorString table:nil];
+		NSLog(@"[JSON-RPC] %@",locDesc);
+		NSDictionary* userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+								  respObj,JSONRPCErrorJSONObjectKey,
+								  locDesc,NSLocalizedDescriptionKey,
+								  nil];
+		[self forwardConnectionError:[NSError errorWithDomain:JSONRPCInternalErrorDomain code:JSONRPCFormatErrorCode userInfo:userInfo]];
+		return;
+	}
+	
+	id resultJsonObject = [respObj objectForKey:@"result"];
+	if (resultJsonObject == [NSNull null] || streamedResult) resultJsonObject = nil; // streamed: already delivered
+	id parsedResult = resultJsonObject;
+	if (resultJsonObject && _resultClass) {
+		// decode object as expected Class
+		parsedResult = [self objectFromJson:resultJsonObject];
+		if (!parsedResult) {
+			// raise and error regarding conversion (send to _delegate or fallback to service)
+			NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCConversionErrorString" value:JSONRPCConversionErrorString table:nil];
 			NSDictionary* userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
-									  respObj,JSONRPCErrorJSONObjectKey,
+									  resultJsonObject,JSONRPCErrorJSONObjectKey,
 									  locDesc,NSLocalizedDescriptionKey,
+									  NSStringFromClass(_resultClass),JSONRPCErrorClassNameKey,
 									  nil];
-			[self forwardConnectionError:[NSError errorWithDomain:JSONRPCInternalErrorDomain code:JSONRPCFormatErrorCode userInfo:userInfo]];
+			[self forwardConnectionError:[NSError errorWithDomain:JSONRPCInternalErrorDomain code:JSONRPCConversionErrorCode userInfo:userInfo]];
 			return;
 		}
-		
-		id resultJsonObject = [respObj objectForKey:@"result"];
-		if (resultJsonObject == [NSNull null]) resultJsonObject = nil;
-		id parsedResult = resultJsonObject;
-		if (resultJsonObject && _resultClass) {
-			// decode object as expected Class
-			parsedResult = [self objectFromJson:resultJsonObject];
-			if (!parsedResult) {
-				// raise and error regarding conversion (send to _delegate or fallback to service)
-				NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCConversionErrorString" value:JSONRPCConversionErrorString table:nil];
-				NSDictionary* userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
-										  resultJsonObject,JSONRPCErrorJSONObjectKey,
-										  locDesc,NSLocalizedDescriptionKey,
-										  NSStringFromClass(_resultClass),JSONRPCErrorClassNameKey,
-										  nil];
-				[self forwardConnectionError:[NSError errorWithDomain:JSONRPCInternalErrorDomain code:JSONRPCConversionErrorCode userInfo:userInfo]];
-				return;
-			}
-		}
-		
-		// extract error from JSON response
-		id errorJsonObject  = [respObj objectForKey:@"error"];
-		if (errorJsonObject == [NSNull null]) errorJsonObject = nil;
-		NSError* parsedError = nil;
-		if (errorJsonObject) {
-			parsedError = [NSError errorWithDomain:JSONRPCServerErrorDomain
-											  code:[[errorJsonObject objectForKey:@"code"] longValue]
-										  userInfo:[NSDictionary dictionaryWithObjectsAndKeys:
-													[errorJsonObject objectForKey:@"message"]?:@"",NSLocalizedDescriptionKey,
-													errorJsonObject,JSONRPCErrorJSONObjectKey,
-													nil]];
-		}
-		if (parsedError) {
-			// Send notification for anyone interested
-			NSDictionary* notifUserInfo = [NSDictionary dictionaryWithObject:parsedError forKey:JSONRPCErrorJSONObjectKey];
-			[[NSNotificationCenter defaultCenter] postNotificationName:JSONRPCServerErrorNotification
-																object:self
-															  userInfo:notifUserInfo];
+	}
+	
+	CFAbsoluteTime convertedTime = CFAbsoluteTimeGetCurrent();
+	_metrics.convertedTime = convertedTime;
+	if (_traceID) [self traceSpan:"convert" from:parsedTime attempt:-1 outcome:NULL];
+	
+	// extract error from JSON response
+	id errorJsonObject  = [respObj objectForKey:@"error"];
+	if (errorJsonObject == [NSNull null]) errorJsonObject = nil;
+	NSError* parsedError = nil;
+	if (errorJsonObject) {
+		parsedError = [NSError errorWithDomain:JSONRPCServerErrorDomain
+										  code:[[errorJsonObject objectForKey:@"code"] longValue]
+									  userInfo:[NSDictionary dictionaryWithObjectsAndKeys:
+												[errorJsonObject objectForKey:@"message"]?:@"",NSLocalizedDescriptionKey,
+												errorJsonObject,JSONRPCErrorJSONObjectKey,
+												nil]];
+	}
+	
+	if (self.remainingTime == 0) {
+		// parsing and conversion are part of the time budget too
+		[self deadlineExpiredWithError:nil];
+		return;
+	}
+
+	if (parsedError) {
+		// Send notification for anyone interested
+		NSDictionary* notifUserInfo = [NSDictionary dictionaryWithObject:parsedError forKey:JSONRPCErrorJSONObjectKey];
+		[[NSNotificationCenter defaultCenter] postNotificationName:JSONRPCServerErrorNotification
+															object:self
+														  userInfo:notifUserInfo];
+	}
+	
+	JSONRPCMethodCall* methCall = self.methodCall;
+	if (_completionBlock) {
+		_completionBlock(methCall,parsedResult,parsedError);
+	} else {
+		NSObject<JSONRPCDelegate>* realDelegate = _delegate ?: methCall.service.delegate;
+		SEL realSel = _callbackSelector ?: @selector(methodCall:didReturn:error:);
+		if (object_getClass(realDelegate) != _callbackClass || realSel != _resolvedCallback) {
+			[self resolveCallbackForTarget:realDelegate selector:realSel];
 		}
 
-		JSONRPCMethodCall* methCall = self.methodCall;
-		if (_completionBlock) {
-			_completionBlock(methCall,parsedResult,parsedError);
+		if (_callbackIMP) {
+			((JSONRPCCallbackIMP)_callbackIMP)(realDelegate, realSel, methCall, parsedResult, parsedError);
+		} else if (_callbackNeedsInvocation) {
+			NSInvocation* inv = [NSInvocation invocationWithMethodSignature:[realDelegate methodSignatureForSelector:realSel]];
+			[inv setSelector:realSel];
+			[inv setArgument:&methCall atIndex:2];
+			[inv setArgument:&parsedResult atIndex:3];
+			[inv setArgument:&parsedError atIndex:4];
+			[inv invokeWithTarget:realDelegate];
 		} else {
-			NSObject<JSONRPCDelegate>* realDelegate = _delegate ?: methCall.service.delegate;
-			SEL realSel = _callbackSelector ?: @selector(methodCall:didReturn:error:);
-
-			if (realDelegate && [realDelegate respondsToSelector:realSel]) {
-				NSInvocation* inv = [NSInvocation invocationWithMethodSignature:[realDelegate methodSignatureForSelector:realSel]];
-				[inv setSelector:realSel];
-				[inv setArgument:&methCall atIndex:2];
-				[inv setArgument:&parsedResult atIndex:3];
-				[inv setArgument:&parsedError atIndex:4];
-				[inv invokeWithTarget:realDelegate];
-			} else {
-				NSLog(@"warning: JSONRPCResponseHandler did receive a response but no delegate defined: the response has been ignored"); 
-			}
+			NSLog(@"warning: JSONRPCResponseHandler did receive a response but no delegate defined: the response has been ignored"); 
+		}
+	}
+	_metrics.dispatchedTime = CFAbsoluteTimeGetCurrent();
+	if (_traceID) [self traceSpan:"dispatch" from:convertedTime attempt:-1 outcome:NULL];
+	[self reportCallEndWithError:parsedError];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Cached responses
+/////////////////////////////////////////////////////////////////////////////
+
+-(void)deliverCachedResponse:(NSData*)response {
+	// on the next run loop iteration, so that the delegate or the completion block can be set first
+	[self performSelector:@selector(dispatchCachedResponse:) withObject:response afterDelay:0];
+}
+
+-(void)dispatchCachedResponse:(NSData*)response {
+	if (_cancelled || _expired) return;
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(deadlineTimerFired) object:nil];
+	CFAbsoluteTime receivedTime = CFAbsoluteTimeGetCurrent();
+	if (_metrics) {
+		_metrics.fromCache = YES;
+		_metrics.lastByteTime = receivedTime;
+		_metrics.responseBytes = [response length];
+	}
+	
+	NSError* parsingError = nil;
+	id respObj = nil;
+	JSONRPCResultStreamParser* streamParser = nil;
+#if NS_BLOCKS_AVAILABLE
+	if (_resultElementBlock) {
+		streamParser = [[[JSONRPCResultStreamParser alloc] initWithDelegate:self] autorelease];
+		BOOL parsing = [streamParser parseBytes:[response bytes] length:[response length]];
+		if (_cancelled || _expired) return;
+		if (!parsing && !streamParser.error) {
+			[self cancel]; // stopped by the resultElementBlock
+			return;
 		}
-	}	
+		parsingError = streamParser.error;
+		if (!parsingError) respObj = [self parseResponseData:streamParser.envelopeData binary:NO error:&parsingError];
+	} else
+#endif
+	{
+		// parsed in place (from the mapped pages if it comes from the disk): the cached bytes are followed by a NUL byte
+		SBJsonParser* parser = [[SBJsonParser alloc] init];
+		respObj = [parser objectWithUTF8Bytes:[response bytes] length:[response length]];
+		if (!respObj) parsingError = [[parser errorTrace] lastObject];
+		[parser release];
+	}
+	CFAbsoluteTime parsedTime = CFAbsoluteTimeGetCurrent();
+	_metrics.parsedTime = parsedTime;
+	if (_traceID) {
+		[self.methodCall.service.tracer recordSpan:"parse" label:nil callID:_traceID
+											 start:receivedTime end:parsedTime attempt:-1 outcome:(parsingError ? "failed" : NULL)];
+	}
+	
+	if (parsingError) {
+		[self forwardConnectionError:parsingError];
+	} else {
+		[self dispatchResponseObject:respObj streamedResult:streamParser.streamedResult parsedTime:parsedTime];
+	}
+}
+
+-(id)parseResponseData:(NSData*)data binary:(BOOL)binary error:(NSError**)error {
+	if (binary) {
+		return [JSONRPCMessagePack objectWithData:data error:error];
+	}
+	
+	NSError* jsonParsingError = nil;
+	NSString* jsonStr = [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease];
+	SBJSON* parser = [[SBJSON alloc] init];
+	id respObj = [parser objectWithString:jsonStr error:&jsonParsingError];
+	[parser release];
+	
+	if (jsonParsingError) {
+		// raise an error regarding JSON Parsing
+		NSMutableDictionary* verboseUserInfo = [NSMutableDictionary dictionaryWithDictionary:[jsonParsingError userInfo]];
+		[verboseUserInfo setObject:jsonStr?:@"" forKey:JSONRPCErrorJSONObjectKey];
+		if (error) *error = [NSError errorWithDomain:[jsonParsingError domain] code:[jsonParsingError code] userInfo:verboseUserInfo];
+		return nil;
+	}
+	return respObj;
 }
 
 -(id)objectFromJson:(id)jsonObject {
@@ -239,7 +947,12 @@
 	{
 		if ([jsonObject isKindOfClass:[NSArray class]]) {
 			// Convert each object in the NSArray
-			return [NSArray arrayWithJson:jsonObject itemsClass:_resultClass];
+			if (_lazyResultConversion) {
+				return [JSONRPCLazyArray arrayWithJson:jsonObject itemsClass:_resultClass];
+			}
+			BOOL concurrently = _concurrentResultConversion
+				&& (![_resultClass respondsToSelector:@selector(allowsConcurrentJsonConversion)] || [_resultClass allowsConcurrentJsonConversion]);
+			return [NSArray arrayWithJson:jsonObject itemsClass:_resultClass concurrently:concurrently];
 		} else {
 			// not an NSArray
 			return [[[_resultClass alloc] initWithJson:jsonObject] autorelease];
@@ -0,0 +1,90 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCResultStreamParser.h
+//! @brief Incremental parsing of the elements of a JSON-RPC result array (see -[JSONRPCResponseHandler streamResultElements:])
+
+@class JSONRPCResultStreamParser;
+
+//! Receives the elements of the result array as soon as they are parsed
+@protocol JSONRPCResultStreamParserDelegate <NSObject>
+/** @brief Called for each element of the result array, in order
+ * @param element the parsed JSON element (NSDictionary, NSArray, NSString, NSNumber or NSNull). It is autoreleased in a
+ *        pool drained right after this call: retain it to keep it.
+ * @param index the index of the element in the result array
+ * @return NO to stop the parsing (the following bytes are ignored)
+ */
+-(BOOL)resultStreamParser:(JSONRPCResultStreamParser*)parser didParseElement:(id)element atIndex:(NSUInteger)index;
+@end
+
+/** @brief Parses a JSON-RPC response as its bytes arrive, delivering the elements of its result array one by one
+ *
+ * Each element is buffered until its last byte is received, parsed with SBJsonParser and passed to the delegate,
+ * then forgotten: the memory used depends on the largest element, not on the length of the array.
+ * The rest of the response (id, error, jsonrpc...) is kept, with an empty result array, in envelopeData,
+ * to be parsed as usual once the response is complete.
+ *
+ * If the result is not an array, or the response is not a JSON object (e.g. a batch), nothing is streamed and
+ * the whole response ends up in envelopeData.
+ */
+@interface JSONRPCResultStreamParser : NSObject
+{
+	//! @privatesection
+	id<JSONRPCResultStreamParserDelegate> _delegate;
+	int _state;
+	NSMutableData* _envelope;
+	NSMutableData* _element;
+	NSUInteger _depth;         // nesting in the envelope, or in the element
+	BOOL _inString, _escaped;
+	BOOL _expectKey, _capturingKey, _isResultKey;
+	char _key[8];              // the beginning of the last key of the envelope
+	NSUInteger _keyLength;
+	BOOL _sawResult;
+	BOOL _streamedResult;
+	int _elementKind;
+	NSUInteger _elementsCount;
+	NSUInteger _largestElementLength;
+	id _parser;
+	NSError* _error;
+	BOOL _stopped;
+}
+-(id)initWithDelegate:(id<JSONRPCResultStreamParserDelegate>)delegate; //!< Designed initializer. The delegate is not retained.
+/** @brief Parse the next bytes of the response
+ * @return NO if an element is not valid JSON (see error) or the delegate stopped the parsing. The following calls are then ignored.
+ */
+-(BOOL)parseBytes:(const void*)bytes length:(NSUInteger)length;
+@property(nonatomic, readonly) NSData* envelopeData; //!< the response without the elements of the result array
+@property(nonatomic, readonly) BOOL streamedResult; //!< YES if the result is an array, whose elements are streamed
+@property(nonatomic, readonly) NSUInteger elementsCount; //!< number of elements delivered so far
+@property(nonatomic, readonly) NSUInteger bufferedBytes; //!< bytes currently held: the envelope and the element being received
+@property(nonatomic, readonly) NSUInteger largestElementLength; //!< size in bytes of the largest element so far
+@property(nonatomic, readonly) NSError* error; //!< the parsing error of an element, if any
+@end
@@ -0,0 +1,232 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCResultStreamParser.h"
+#import "JSONRPCService.h"
+#import "JSON.h"
+
+enum {
+	kStateEnvelope,          // copying the response to the envelope
+	kStateAfterResultColon,  // between "result": and its value
+	kStateBetweenElements,   // in the result array, before an element, a comma or the closing bracket
+	kStateInElement          // buffering an element
+};
+enum {
+	kElementContainer, // object or array: ends with its closing bracket
+	kElementString,    // ends with its closing quote
+	kElementLiteral    // number, true, false, null: ends before the next comma or the closing bracket
+};
+
+static inline BOOL isJSONWhitespace(uint8_t ch) {
+	return (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r');
+}
+
+@interface JSONRPCResultStreamParser()
+-(void)scanEnvelopeByte:(uint8_t)ch; //!< @private @internal
+-(void)finishElement; //!< @private @internal
+@end
+
+@implementation JSONRPCResultStreamParser
+@synthesize envelopeData = _envelope, streamedResult = _streamedResult, elementsCount = _elementsCount;
+@synthesize largestElementLength = _largestElementLength, error = _error;
+
+-(id)initWithDelegate:(id<JSONRPCResultStreamParserDelegate>)delegate {
+	self = [super init];
+	if (self != nil) {
+		_delegate = delegate;
+		_state = kStateEnvelope;
+		_envelope = [[NSMutableData alloc] init];
+		_element = [[NSMutableData alloc] init];
+		_parser = [[SBJsonParser alloc] init];
+	}
+	return self;
+}
+
+-(NSUInteger)bufferedBytes {
+	return [_envelope length] + [_element length];
+}
+
+-(BOOL)parseBytes:(const void*)bytes length:(NSUInteger)length {
+	const uint8_t* p = bytes;
+	NSUInteger i = 0;
+	while (i < length && !_stopped) {
+		uint8_t ch = p[i];
+		switch (_state) {
+			case kStateEnvelope:
+				[self scanEnvelopeByte:ch];
+				++i;
+				break;
+				
+			case kStateAfterResultColon:
+				if (isJSONWhitespace(ch)) {
+					++i;
+				} else if (ch == '[') {
+					// the elements are streamed: the envelope only gets an empty array
+					[_envelope appendBytes:"[]" length:2];
+					_streamedResult = YES;
+					_state = kStateBetweenElements;
+					++i;
+				} else {
+					_state = kStateEnvelope; // not an array: kept in the envelope
+				}
+				break;
+				
+			case kStateBetweenElements:
+				if (isJSONWhitespace(ch) || ch == ',') {
+					++i;
+				} else if (ch == ']') {
+					_state = kStateEnvelope; // back to the envelope, at depth 1
+					++i;
+				} else {
+					// wrapped in brackets, so that SBJsonParser also accepts strings and literals
+					[_element setLength:0];
+					[_element appendBytes:"[" length:1];
+					_elementKind = (ch == '{' || ch == '[') ? kElementContainer : ((ch == '"') ? kElementString : kElementLiteral);
+					_depth = 0;
+					_inString = _escaped = NO;
+					_state = kStateInElement;
+				}
+				break;
+				
+			case kStateInElement: {
+				// scan as many bytes of the element as possible before copying them at once
+				NSUInteger start = i;
+				BOOL done = NO;
+				for(; i<length; ++i) {
+					ch = p[i];
+					if (_inString) {
+						if (_escaped) _escaped = NO;
+						else if (ch == '\\') _escaped = YES;
+						else if (ch == '"') {
+							_inString = NO;
+							if (_elementKind == kElementString) { ++i; done = YES; break; }
+						}
+					} else if (ch == '"') {
+						_inString = YES;
+					} else if (ch == '{' || ch == '[') {
+						++_depth;
+					} else if (ch == '}' || ch == ']') {
+						if (_depth == 0) { done = YES; break; } // the end of the array, after a literal
+						if (--_depth == 0) { ++i; done = YES; break; }
+					} else if (ch == ',' && _depth == 0) {
+						done = YES; break; // after a literal
+					}
+				}
+				[_element appendBytes:p+start length:i-start];
+				if (done) {
+					[self finishElement];
+					_state = kStateBetweenElements;
+				}
+				break;
+			}
+		}
+	}
+	return !_stopped;
+}
+
+-(void)scanEnvelopeByte:(uint8_t)ch {
+	[_envelope appendBytes:&ch length:1];
+	if (_inString) {
+		if (_escaped) {
+			_escaped = NO;
+		} else if (ch == '\\') {
+			_escaped = YES;
+			_keyLength = sizeof(_key); // an escaped key is not "result"
+		} else if (ch == '"') {
+			_inString = NO;
+			if (_capturingKey) {
+				_capturingKey = NO;
+				_isResultKey = (_keyLength == 6 && !memcmp(_key, "result", 6));
+			}
+		} else if (_capturingKey && _keyLength < sizeof(_key)) {
+			_key[_keyLength++] = ch;
+		}
+		return;
+	}
+	switch (ch) {
+		case '"':
+			_inString = YES;
+			_capturingKey = (_depth == 1 && _expectKey);
+			_expectKey = NO;
+			_keyLength = 0;
+			break;
+		case '{':
+		case '[':
+			++_depth;
+			_expectKey = (_depth == 1 && ch == '{');
+			break;
+		case '}':
+		case ']':
+			if (_depth) --_depth;
+			break;
+		case ',':
+			_expectKey = (_depth == 1);
+			break;
+		case ':':
+			if (_depth == 1 && _isResultKey && !_sawResult) {
+				_sawResult = YES;
+				_state = kStateAfterResultColon;
+			}
+			_isResultKey = NO;
+			break;
+		default:
+			break;
+	}
+}
+
+-(void)finishElement {
+	[_element appendBytes:"]" length:1];
+	_largestElementLength = MAX(_largestElementLength, [_element length]-2);
+	
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	NSString* json = [[NSString alloc] initWithBytesNoCopy:(void*)[_element bytes] length:[_element length]
+												  encoding:NSUTF8StringEncoding freeWhenDone:NO];
+	NSArray* wrapper = json ? [_parser objectWithString:json] : nil;
+	[json release];
+	if ([wrapper count] != 1) {
+		NSString* locDesc = [[NSBundle mainBundle] localizedStringForKey:@"JSONRPCFormatErrorString" value:JSONRPCFormatErrorString table:nil];
+		NSDictionary* userInfo = [NSDictionary dictionaryWithObject:locDesc forKey:NSLocalizedDescriptionKey];
+		_error = [[NSError alloc] initWithDomain:JSONRPCInternalErrorDomain code:JSONRPCFormatErrorCode userInfo:userInfo];
+		_stopped = YES;
+	} else if (![_delegate resultStreamParser:self didParseElement:[wrapper objectAtIndex:0] atIndex:_elementsCount++]) {
+		_stopped = YES;
+	}
+	[pool drain];
+	[_element setLength:0];
+}
+
+-(void)dealloc {
+	[_envelope release];
+	[_element release];
+	[_parser release];
+	[_error release];
+	[super dealloc];
+}
+
+@end
@@ -0,0 +1,87 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCRetryPolicy.h
+//! @brief Policy to space out and limit the automatic retries of method calls after network errors.
+
+/** @brief Policy for the automatic retries of method calls after network errors (see JSONRPCService#retryPolicy)
+ *
+ * <b>Backoff</b>: the n-th retry of a method call waits initialDelay * multiplier^(n-1), capped to maxDelay.
+ * A random part of this delay (jitter) is removed, so that clients which failed at the same time
+ * do not all retry at the same time.
+ *
+ * <b>Budget</b>: during an outage, retries multiply the load on the server when it needs it the least.
+ * So retries are only allowed up to retryBudgetRatio of the method calls made recently (plus minRetriesPerSecond,
+ * so that a client which makes few calls can still retry). When the budget is exhausted, the network error is forwarded
+ * without retrying, and retriesDeniedCount is incremented.
+ */
+@interface JSONRPCRetryPolicy : NSObject
+{
+	//! @privatesection
+	NSTimeInterval _initialDelay;
+	double _multiplier;
+	NSTimeInterval _maxDelay;
+	double _jitter;
+	double _retryBudgetRatio;
+	double _minRetriesPerSecond;
+	
+	double _budgetBalance;
+	CFAbsoluteTime _lastBudgetUpdate;
+	NSUInteger _retriesCount;
+	NSUInteger _retriesDeniedCount;
+}
+@property(nonatomic, assign) NSTimeInterval initialDelay; //!< delay before the first retry. Defaults to 0.5s.
+@property(nonatomic, assign) double multiplier; //!< factor applied to the delay for each subsequent retry. Defaults to 2.
+@property(nonatomic, assign) NSTimeInterval maxDelay; //!< the delay before a retry never exceeds this. Defaults to 30s.
+@property(nonatomic, assign) double jitter; //!< fraction (between 0 and 1) of the delay that is randomized. Defaults to 0.5.
+@property(nonatomic, assign) double retryBudgetRatio; //!< maximum number of retries per method call made. 0 disables the budget. Defaults to 0.2 (20%).
+@property(nonatomic, assign) double minRetriesPerSecond; //!< retries always allowed by the budget, whatever the traffic. Defaults to 1.
+
+@property(nonatomic, readonly) NSUInteger retriesCount; //!< number of retries allowed
+@property(nonatomic, readonly) NSUInteger retriesDeniedCount; //!< number of retries denied because the budget was exhausted
+
+//! Commodity constructor
++(id)policy;
+-(void)resetCounters; //!< reset retriesCount and retriesDeniedCount to zero
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Used by the framework
+/////////////////////////////////////////////////////////////////////////////
+
+/** @brief The delay to wait before retrying, including jitter. @internal
+ * @param retryIndex 1 for the first retry, 2 for the second, ...
+ * @param baseDelay the delay before the first retry, or 0 to use initialDelay
+ */
+-(NSTimeInterval)delayBeforeRetry:(NSUInteger)retryIndex baseDelay:(NSTimeInterval)baseDelay;
+-(void)methodCallDidStart; //!< @internal a new method call has been made: credits the retry budget
+-(BOOL)reserveRetry; //!< @internal YES if the retry budget allows to retry now. Counts it as a retry.
+@end
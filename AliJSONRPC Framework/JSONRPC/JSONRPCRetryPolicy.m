@@ -0,0 +1,120 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCRetryPolicy.h"
+#include <stdlib.h>
+
+static const double kRetryBudgetCapacity = 10; // max retries that can be saved up while the traffic is healthy
+
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCRetryPolicy
+@synthesize initialDelay = _initialDelay;
+@synthesize multiplier = _multiplier;
+@synthesize maxDelay = _maxDelay;
+@synthesize jitter = _jitter;
+@synthesize retryBudgetRatio = _retryBudgetRatio;
+@synthesize minRetriesPerSecond = _minRetriesPerSecond;
+@synthesize retriesCount = _retriesCount;
+@synthesize retriesDeniedCount = _retriesDeniedCount;
+
++(id)policy {
+	return [[[self alloc] init] autorelease];
+}
+
+- (id) init
+{
+	self = [super init];
+	if (self != nil) {
+		_initialDelay = 0.5;
+		_multiplier = 2;
+		_maxDelay = 30;
+		_jitter = 0.5;
+		_retryBudgetRatio = 0.2;
+		_minRetriesPerSecond = 1;
+		_budgetBalance = kRetryBudgetCapacity;
+		_lastBudgetUpdate = CFAbsoluteTimeGetCurrent();
+	}
+	return self;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ retries:%lu denied:%lu budget:%.1f>",NSStringFromClass([self class]),
+			(unsigned long)_retriesCount,(unsigned long)_retriesDeniedCount,_budgetBalance];
+}
+
+-(void)resetCounters {
+	_retriesCount = _retriesDeniedCount = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Backoff
+/////////////////////////////////////////////////////////////////////////////
+
+-(NSTimeInterval)delayBeforeRetry:(NSUInteger)retryIndex baseDelay:(NSTimeInterval)baseDelay {
+	NSTimeInterval delay = baseDelay ?: _initialDelay;
+	for(NSUInteger i=1; i<retryIndex && delay<_maxDelay; ++i) delay *= _multiplier;
+	delay = MIN(delay, _maxDelay);
+	
+	double j = MAX(0, MIN(_jitter, 1));
+	double rnd = (double)arc4random() / 0xFFFFFFFFu; // in [0,1]
+	return delay * (1 - j*rnd);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Budget
+/////////////////////////////////////////////////////////////////////////////
+
+-(void)refillBudget {
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	_budgetBalance = MIN(kRetryBudgetCapacity, _budgetBalance + (now-_lastBudgetUpdate)*_minRetriesPerSecond);
+	_lastBudgetUpdate = now;
+}
+
+-(void)methodCallDidStart {
+	[self refillBudget];
+	_budgetBalance = MIN(kRetryBudgetCapacity, _budgetBalance + _retryBudgetRatio);
+}
+
+-(BOOL)reserveRetry {
+	if (_retryBudgetRatio > 0) {
+		[self refillBudget];
+		if (_budgetBalance < 1) {
+			++_retriesDeniedCount;
+			return NO;
+		}
+		_budgetBalance -= 1;
+	}
+	++_retriesCount;
+	return YES;
+}
+
+@end
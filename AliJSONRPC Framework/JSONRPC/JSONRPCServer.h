@@ -0,0 +1,131 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+#import "JSONRPCService.h"
+
+//! @file JSONRPCServer.h
+//! @brief Serve JSON-RPC methods over HTTP, on a TCP port or a unix domain socket.
+
+//! Standard JSON-RPC error codes returned by JSONRPCServer
+typedef enum {
+	JSONRPCServerParseError     = -32700, //!< the request is not valid JSON
+	JSONRPCServerInvalidRequest = -32600, //!< the request is not a valid request object
+	JSONRPCServerMethodNotFound = -32601, //!< no method is registered with this name
+	JSONRPCServerInvalidParams  = -32602, //!< for your handlers to report invalid parameters
+	JSONRPCServerInternalError  = -32603  //!< the handler raised an exception, or its result could not be converted to JSON
+} JSONRPCServerErrorCode;
+
+#if NS_BLOCKS_AVAILABLE
+/** @brief A block implementing a method
+ * @param params the "params" of the request: an NSArray, an NSDictionary (JSON-RPC 2.0 named parameters) or nil
+ * @param error set it to return an error instead of a result
+ * @return the result, converted to JSON with SBJsonWriter (so it may be an object responding to -proxyForJson). nil is sent as null.
+ */
+typedef id (^JSONRPCServerMethodBlock)(id params, NSError** error);
+#endif
+
+/** @brief A JSON-RPC server, dispatching the requests to the methods registered on it
+ *
+ * Requests are read from HTTP/1.1 keep-alive connections (one thread per connection), parsed with SBJsonParser and
+ * executed on a pool of worker threads (see maxConcurrentHandlers); the responses are written with SBJsonWriter.
+ * Each request is answered in the version of JSON-RPC it uses (1.0, 1.1 or 2.0, including 2.0 batches and notifications).
+ * The elements of a batch are executed concurrently (see maxBatchConcurrency), so that a slow element does not delay the others.
+ *
+ * Methods are registered before starting the server, with a target and a selector or with a block.
+ * Their implementation (IMP or block) is looked up once at registration, so dispatching a request is a single hash table lookup.
+ *
+ * A handler reports an error by returning it through its NSError** parameter: the error is sent with its code and
+ * localizedDescription as the "code" and "message" of the JSON-RPC error, and the object under JSONRPCErrorJSONObjectKey
+ * in its userInfo, if any, as its "data".
+ */
+@interface JSONRPCServer : NSObject
+{
+	//! @privatesection
+	CFMutableDictionaryRef _methods; // method name -> JSONRPCServerMethod
+	NSOperationQueue* _workers;
+	int _listenFD;
+	unsigned short _port;
+	NSString* _socketPath;
+	NSMutableSet* _connections; // the file descriptors of the open connections, as NSNumbers
+	BOOL _running;
+	BOOL _loopbackOnly;
+	NSUInteger _maxBatchSize;
+	NSUInteger _maxBatchConcurrency;
+	NSUInteger _maxRequestSize;
+}
+/** @brief Register a method implemented by -(id)method:(id)params error:(NSError**)error
+ * @param name the name of the JSON-RPC method
+ * @param target the object implementing it (retained)
+ * @param selector a selector taking the params and an NSError**, and returning the result
+ * @note Methods can only be registered before the server is started.
+ */
+-(void)registerMethod:(NSString*)name target:(id)target selector:(SEL)selector;
+#if NS_BLOCKS_AVAILABLE
+//! Register a method implemented by a block. Methods can only be registered before the server is started.
+-(void)registerMethod:(NSString*)name block:(JSONRPCServerMethodBlock)block;
+#endif
+//! The number of method handlers executed at the same time. Defaults to the number of active processors.
+@property(nonatomic, assign) NSInteger maxConcurrentHandlers;
+/** @brief The largest number of elements accepted in a batch. Defaults to 1000. 0 means no limit.
+ * Larger batches are answered with a single JSONRPCServerInvalidRequest error, without executing any element.
+ */
+@property(nonatomic, assign) NSUInteger maxBatchSize;
+/** @brief The number of elements of a same batch executed at the same time. Defaults to 0, i.e. maxConcurrentHandlers.
+ * The handlers of all the requests and batches share the worker pool: this only prevents a large batch from using all of it.
+ * @note The elements of a batch must therefore be independent: their order of execution is not defined.
+ *       The responses are sent in the order of the requests, without the notifications (match them by "id").
+ */
+@property(nonatomic, assign) NSUInteger maxBatchConcurrency;
+/** @brief The largest request body accepted, in bytes. Defaults to 16MB. 0 means no limit.
+ * Larger requests are answered with "413 Request Entity Too Large" as soon as their headers are read, without reading their body.
+ * Requests without a valid Content-Length are answered with "400 Bad Request", and chunked ones with "411 Length Required".
+ * The connection is then closed.
+ */
+@property(nonatomic, assign) NSUInteger maxRequestSize;
+//! If YES (the default), startOnPort:error: only accepts connections from the loopback interface.
+@property(nonatomic, assign) BOOL loopbackOnly;
+@property(nonatomic, readonly) unsigned short port; //!< the TCP port the server listens on, once started
+@property(nonatomic, readonly, getter=isRunning) BOOL running;
+/** @brief Start listening on a TCP port
+ * @param port the port, or 0 to let the system choose one (see the port property)
+ * @param error set to the POSIX error if the socket could not be opened
+ */
+-(BOOL)startOnPort:(unsigned short)port error:(NSError**)error;
+//! Start listening on a unix domain socket, created at path (an existing file at this path is replaced)
+-(BOOL)startOnUnixSocket:(NSString*)path error:(NSError**)error;
+-(void)stop; //!< Stop accepting connections and close the open ones
+/** @brief Execute a request body (a request, a notification or a batch) and return the response body
+ *
+ * This is what the server does for each HTTP request; it can also be used to serve JSON-RPC over another transport,
+ * e.g. as a JSONRPCService#loopbackHandler. Thread-safe.
+ * @return the JSON response, or nil if no response is due (notifications)
+ */
+-(NSData*)responseDataForRequestData:(NSData*)requestData;
+@end
@@ -0,0 +1,554 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCServer.h"
+#import "JSON.h"
+#import <objc/runtime.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <limits.h>
+#include <dispatch/dispatch.h>
+
+typedef id (*JSONRPCServerMethodIMP)(id, SEL, id, NSError**); // -(id)method:(id)params error:(NSError**)error
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Registered methods
+/////////////////////////////////////////////////////////////////////////////
+
+//! @private A registered method, with its implementation resolved once
+@interface JSONRPCServerMethod : NSObject {
+@public
+	id _target;
+	SEL _selector;
+	JSONRPCServerMethodIMP _imp;
+#if NS_BLOCKS_AVAILABLE
+	JSONRPCServerMethodBlock _block;
+#endif
+}
+-(id)invokeWithParams:(id)params error:(NSError**)error;
+@end
+
+@implementation JSONRPCServerMethod
+-(id)invokeWithParams:(id)params error:(NSError**)error {
+#if NS_BLOCKS_AVAILABLE
+	if (_block) return _block(params, error);
+#endif
+	return _imp(_target, _selector, params, error);
+}
+-(void)dealloc {
+	[_target release];
+#if NS_BLOCKS_AVAILABLE
+	[_block release];
+#endif
+	[super dealloc];
+}
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Worker operation
+/////////////////////////////////////////////////////////////////////////////
+
+//! @private Executes a request on the worker pool
+@interface JSONRPCServerOperation : NSOperation {
+	JSONRPCServer* _server;
+	id _request;
+	id _response;
+	dispatch_semaphore_t _batchSlots; // signalled once executed, for the elements of a batch
+}
+-(id)initWithServer:(JSONRPCServer*)server request:(id)request;
+-(id)initWithServer:(JSONRPCServer*)server request:(id)request batchSlots:(dispatch_semaphore_t)batchSlots;
+@property(nonatomic, readonly) id response;
+@end
+
+@interface JSONRPCServer()
+-(id)responseForRequest:(id)request; //!< @private @internal
+-(id)responseForBatch:(NSArray*)batch; //!< @private @internal
+-(NSData*)responseDataForRequestData:(NSData*)requestData parser:(SBJsonParser*)parser writer:(SBJsonWriter*)writer; //!< @private @internal
+-(BOOL)listenOnSocket:(int)fd address:(const struct sockaddr*)address length:(socklen_t)length error:(NSError**)error; //!< @private @internal
+-(void)acceptConnections:(id)unused; //!< @private @internal
+-(void)serveConnection:(NSNumber*)fdNumber; //!< @private @internal
+@end
+
+@implementation JSONRPCServerOperation
+@synthesize response = _response;
+-(id)initWithServer:(JSONRPCServer*)server request:(id)request {
+	return [self initWithServer:server request:request batchSlots:NULL];
+}
+-(id)initWithServer:(JSONRPCServer*)server request:(id)request batchSlots:(dispatch_semaphore_t)batchSlots {
+	self = [super init];
+	if (self != nil) {
+		_server = [server retain];
+		_request = [request retain];
+		_batchSlots = batchSlots; // outlives the operation: the batch waits for all its elements
+	}
+	return self;
+}
+-(void)main {
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	_response = [[_server responseForRequest:_request] retain];
+	[pool drain];
+	if (_batchSlots) dispatch_semaphore_signal(_batchSlots);
+}
+-(void)dealloc {
+	[_server release];
+	[_request release];
+	[_response release];
+	[super dealloc];
+}
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Envelopes
+/////////////////////////////////////////////////////////////////////////////
+
+static JSONRPCVersion requestVersion(NSDictionary* request) {
+	if ([[request objectForKey:@"jsonrpc"] isEqual:@"2.0"]) return JSONRPCVersion_2_0;
+	if ([[request objectForKey:@"version"] isEqual:@"1.1"]) return JSONRPCVersion_1_1;
+	return JSONRPCVersion_1_0;
+}
+
+static NSDictionary* errorObject(JSONRPCVersion version, NSInteger code, NSString* message, id data) {
+	NSMutableDictionary* error = [NSMutableDictionary dictionaryWithCapacity:4];
+	[error setObject:[NSNumber numberWithInteger:code] forKey:@"code"];
+	[error setObject:(message ?: @"") forKey:@"message"];
+	if (version == JSONRPCVersion_1_1) {
+		[error setObject:@"JSONRPCError" forKey:@"name"];
+		if (data) [error setObject:data forKey:@"error"];
+	} else if (data) {
+		[error setObject:data forKey:@"data"];
+	}
+	return error;
+}
+
+// The response envelope of the given version, with either a result or an error
+static NSDictionary* responseObject(JSONRPCVersion version, id requestID, id result, NSDictionary* error) {
+	NSMutableDictionary* response = [NSMutableDictionary dictionaryWithCapacity:4];
+	[response setObject:(requestID ?: [NSNull null]) forKey:@"id"];
+	switch (version) {
+		case JSONRPCVersion_1_0:
+			// both members are always present
+			[response setObject:(error ? [NSNull null] : (result ?: [NSNull null])) forKey:@"result"];
+			[response setObject:(error ?: (id)[NSNull null]) forKey:@"error"];
+			break;
+		case JSONRPCVersion_1_1:
+			[response setObject:@"1.1" forKey:@"version"];
+			if (error) [response setObject:error forKey:@"error"];
+			else [response setObject:(result ?: [NSNull null]) forKey:@"result"];
+			break;
+		case JSONRPCVersion_2_0:
+			[response setObject:@"2.0" forKey:@"jsonrpc"];
+			if (error) [response setObject:error forKey:@"error"];
+			else [response setObject:(result ?: [NSNull null]) forKey:@"result"];
+			break;
+	}
+	return response;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Server
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCServer
+@synthesize port = _port, running = _running, loopbackOnly = _loopbackOnly;
+@synthesize maxBatchSize = _maxBatchSize, maxBatchConcurrency = _maxBatchConcurrency, maxRequestSize = _maxRequestSize;
+
+- (id) init
+{
+	self = [super init];
+	if (self != nil) {
+		_methods = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+		_workers = [[NSOperationQueue alloc] init];
+		[_workers setMaxConcurrentOperationCount:[[NSProcessInfo processInfo] activeProcessorCount]];
+		_connections = [[NSMutableSet alloc] init];
+		_listenFD = -1;
+		_loopbackOnly = YES;
+		_maxBatchSize = 1000;
+		_maxRequestSize = 16*1024*1024;
+	}
+	return self;
+}
+
+-(NSInteger)maxConcurrentHandlers {
+	return [_workers maxConcurrentOperationCount];
+}
+-(void)setMaxConcurrentHandlers:(NSInteger)count {
+	[_workers setMaxConcurrentOperationCount:MAX(count,1)];
+}
+
+-(void)registerMethod:(NSString*)name target:(id)target selector:(SEL)selector {
+	if (_running) [NSException raise:NSInternalInconsistencyException format:@"%@: register %@ before starting the server",[self class],name];
+	if (![target respondsToSelector:selector]) {
+		NSLog(@"%@ warning: %@ does not respond to selector %@",[self class],target,NSStringFromSelector(selector));
+		return;
+	}
+	JSONRPCServerMethod* method = [[JSONRPCServerMethod alloc] init];
+	method->_target = [target retain];
+	method->_selector = selector;
+	method->_imp = (JSONRPCServerMethodIMP)class_getMethodImplementation(object_getClass(target), selector);
+	CFDictionarySetValue(_methods, name, method);
+	[method release];
+}
+
+#if NS_BLOCKS_AVAILABLE
+-(void)registerMethod:(NSString*)name block:(JSONRPCServerMethodBlock)block {
+	if (_running) [NSException raise:NSInternalInconsistencyException format:@"%@: register %@ before starting the server",[self class],name];
+	JSONRPCServerMethod* method = [[JSONRPCServerMethod alloc] init];
+	method->_block = [block copy];
+	CFDictionarySetValue(_methods, name, method);
+	[method release];
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: Dispatch
+
+// Execute a request object. Returns nil for notifications.
+-(id)responseForRequest:(id)request {
+	if (![request isKindOfClass:[NSDictionary class]]) {
+		return responseObject(JSONRPCVersion_2_0, nil, nil, errorObject(JSONRPCVersion_2_0, JSONRPCServerInvalidRequest, @"Invalid Request", nil));
+	}
+	JSONRPCVersion version = requestVersion(request);
+	id requestID = [request objectForKey:@"id"];
+	BOOL notification = (version == JSONRPCVersion_1_0) ? (requestID == [NSNull null]) : (requestID == nil);
+	NSString* methodName = [request objectForKey:@"method"];
+	id params = [request objectForKey:@"params"];
+	if (params == [NSNull null]) params = nil;
+	
+	if (![methodName isKindOfClass:[NSString class]]
+		|| (params && ![params isKindOfClass:[NSArray class]] && ![params isKindOfClass:[NSDictionary class]])) {
+		return responseObject(version, requestID, nil, errorObject(version, JSONRPCServerInvalidRequest, @"Invalid Request", nil));
+	}
+	JSONRPCServerMethod* method = (JSONRPCServerMethod*)CFDictionaryGetValue(_methods, methodName); // immutable once started
+	if (!method) {
+		return notification ? nil : responseObject(version, requestID, nil, errorObject(version, JSONRPCServerMethodNotFound, @"Method not found", methodName));
+	}
+	
+	id result = nil;
+	NSError* error = nil;
+	NSDictionary* errorObj = nil;
+	@try {
+		result = [method invokeWithParams:params error:&error];
+		if (error) {
+			errorObj = errorObject(version, [error code], [error localizedDescription], [[error userInfo] objectForKey:JSONRPCErrorJSONObjectKey]);
+		}
+	}
+	@catch (NSException* exception) {
+		NSLog(@"%@: %@ raised %@",[self class],methodName,exception);
+		errorObj = errorObject(version, JSONRPCServerInternalError, [exception reason], nil);
+	}
+	return notification ? nil : responseObject(version, requestID, result, errorObj);
+}
+
+// Execute a JSON-RPC 2.0 batch, its elements concurrently on the worker pool. Returns nil if it only contains notifications.
+-(id)responseForBatch:(NSArray*)batch {
+	NSUInteger count = [batch count];
+	if (!count) {
+		return responseObject(JSONRPCVersion_2_0, nil, nil, errorObject(JSONRPCVersion_2_0, JSONRPCServerInvalidRequest, @"Invalid Request", nil));
+	}
+	if (_maxBatchSize && count > _maxBatchSize) {
+		return responseObject(JSONRPCVersion_2_0, nil, nil, errorObject(JSONRPCVersion_2_0, JSONRPCServerInvalidRequest, @"Batch too large",
+																		  [NSNumber numberWithUnsignedInteger:_maxBatchSize]));
+	}
+	
+	NSInteger workers = [_workers maxConcurrentOperationCount];
+	NSUInteger concurrency = _maxBatchConcurrency ?: (workers > 0 ? (NSUInteger)workers : count);
+	// at most "concurrency" elements of the batch are queued at the same time: the next one takes the first slot freed
+	dispatch_semaphore_t slots = dispatch_semaphore_create((long)MIN(concurrency, (NSUInteger)LONG_MAX));
+	NSMutableArray* operations = [NSMutableArray arrayWithCapacity:count];
+	for(id request in batch) {
+		dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
+		JSONRPCServerOperation* operation = [[JSONRPCServerOperation alloc] initWithServer:self request:request batchSlots:slots];
+		[_workers addOperation:operation];
+		[operations addObject:operation];
+		[operation release];
+	}
+	
+	NSMutableArray* responses = [NSMutableArray arrayWithCapacity:count];
+	for(JSONRPCServerOperation* operation in operations) {
+		[operation waitUntilFinished];
+		if (operation.response) [responses addObject:operation.response]; // notifications have none
+	}
+	dispatch_release(slots); // all the slots are back: every element has signalled before finishing
+	return [responses count] ? responses : nil;
+}
+
+-(NSData*)responseDataForRequestData:(NSData*)requestData {
+	SBJsonParser* parser = [[SBJsonParser alloc] init];
+	SBJsonWriter* writer = [[SBJsonWriter alloc] init];
+	NSData* response = [self responseDataForRequestData:requestData parser:parser writer:writer];
+	[parser release];
+	[writer release];
+	return response;
+}
+
+-(NSData*)responseDataForRequestData:(NSData*)requestData parser:(SBJsonParser*)parser writer:(SBJsonWriter*)writer {
+	NSString* json = [[NSString alloc] initWithData:requestData encoding:NSUTF8StringEncoding];
+	id request = json ? [parser objectWithString:json] : nil;
+	[json release];
+	id response = nil;
+	if (!request) {
+		response = responseObject(JSONRPCVersion_2_0, nil, nil, errorObject(JSONRPCVersion_2_0, JSONRPCServerParseError, @"Parse error", nil));
+	} else if ([request isKindOfClass:[NSArray class]]) {
+		response = [self responseForBatch:request];
+	} else {
+		// the handlers run on the worker pool, this thread only parses and writes
+		JSONRPCServerOperation* operation = [[JSONRPCServerOperation alloc] initWithServer:self request:request];
+		[_workers addOperation:operation];
+		[operation waitUntilFinished];
+		response = [[operation.response retain] autorelease];
+		[operation release];
+	}
+	if (!response) return nil;
+	
+	NSString* responseJSON = [writer stringWithObject:response];
+	if (!responseJSON) {
+		// a result which cannot be converted to JSON
+		JSONRPCVersion version = [request isKindOfClass:[NSDictionary class]] ? requestVersion(request) : JSONRPCVersion_2_0;
+		id requestID = [request isKindOfClass:[NSDictionary class]] ? [request objectForKey:@"id"] : nil;
+		responseJSON = [writer stringWithObject:responseObject(version, requestID, nil,
+															   errorObject(version, JSONRPCServerInternalError, @"Internal error", nil))];
+	}
+	return [responseJSON dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: Sockets
+
+-(BOOL)startOnPort:(unsigned short)port error:(NSError**)error {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(_loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+	if (![self listenOnSocket:socket(AF_INET, SOCK_STREAM, 0) address:(struct sockaddr*)&addr length:sizeof(addr) error:error]) return NO;
+	socklen_t addrLength = sizeof(addr);
+	getsockname(_listenFD, (struct sockaddr*)&addr, &addrLength);
+	_port = ntohs(addr.sin_port);
+	return YES;
+}
+
+-(BOOL)startOnUnixSocket:(NSString*)path error:(NSError**)error {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strlcpy(addr.sun_path, [path fileSystemRepresentation], sizeof(addr.sun_path));
+	unlink(addr.sun_path);
+	if (![self listenOnSocket:socket(AF_UNIX, SOCK_STREAM, 0) address:(struct sockaddr*)&addr length:sizeof(addr) error:error]) return NO;
+	_socketPath = [path copy];
+	return YES;
+}
+
+-(BOOL)listenOnSocket:(int)fd address:(const struct sockaddr*)address length:(socklen_t)length error:(NSError**)error {
+	if (_running) return NO;
+	int yes = 1;
+	if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	if (fd < 0 || bind(fd, address, length) || listen(fd, 1024)) {
+		if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		if (fd >= 0) close(fd);
+		return NO;
+	}
+	_listenFD = fd;
+	_running = YES;
+	[NSThread detachNewThreadSelector:@selector(acceptConnections:) toTarget:self withObject:nil];
+	return YES;
+}
+
+-(void)acceptConnections:(id)unused {
+	int listenFD = _listenFD;
+	while (_running) {
+		int fd = accept(listenFD, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			break; // closed by stop
+		}
+		int yes = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)); // fails harmlessly on unix sockets
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+		NSNumber* fdNumber = [[NSNumber alloc] initWithInt:fd];
+		@synchronized(_connections) {
+			[_connections addObject:fdNumber];
+		}
+		[NSThread detachNewThreadSelector:@selector(serveConnection:) toTarget:self withObject:fdNumber];
+		[fdNumber release];
+	}
+}
+
+// Largest request headers: a connection sending more without their end is answered with an error
+static const NSUInteger kMaxHeadersLength = 65536;
+
+static BOOL writeAll(int fd, const void* bytes, size_t length) {
+	while (length > 0) {
+		ssize_t n = write(fd, bytes, length);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return NO;
+		bytes = (const char*)bytes + n;
+		length -= n;
+	}
+	return YES;
+}
+
+// The value of a Content-Length header: digits only, without overflow
+static BOOL parseContentLength(NSString* value, unsigned long long* length) {
+	const char* s = [value UTF8String];
+	if (!s || !*s) return NO;
+	unsigned long long n = 0;
+	for(; *s; ++s) {
+		if (*s < '0' || *s > '9') return NO;
+		unsigned digit = *s - '0';
+		if (n > (ULLONG_MAX - digit) / 10) return NO;
+		n = n*10 + digit;
+	}
+	*length = n;
+	return YES;
+}
+
+// Answer a request that cannot be served, before closing the connection
+static void sendErrorStatus(int fd, const char* status) {
+	char response[128];
+	int length = snprintf(response, sizeof(response), "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+	writeAll(fd, response, length);
+}
+
+// Serve the HTTP/1.1 requests of a keep-alive connection
+-(void)serveConnection:(NSNumber*)fdNumber {
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	int fd = [fdNumber intValue];
+	SBJsonParser* parser = [[SBJsonParser alloc] init];
+	SBJsonWriter* writer = [[SBJsonWriter alloc] init];
+	NSMutableData* input = [NSMutableData dataWithCapacity:65536];
+	char chunk[65536];
+	BOOL open = YES;
+	while (open) {
+		ssize_t n = read(fd, chunk, sizeof(chunk));
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		[input appendBytes:chunk length:n];
+		
+		// process every complete request of the buffer
+		for(;;) {
+			const char* bytes = [input bytes];
+			const char* headersEnd = memmem(bytes, [input length], "\r\n\r\n", 4);
+			if (!headersEnd) {
+				if ([input length] > kMaxHeadersLength) {
+					sendErrorStatus(fd, "431 Request Header Fields Too Large");
+					open = NO;
+				}
+				break;
+			}
+			size_t headersLength = headersEnd + 4 - bytes;
+			NSString* headers = [[[NSString alloc] initWithBytes:bytes length:headersLength encoding:NSISOLatin1StringEncoding] autorelease];
+			unsigned long long contentLength = 0;
+			BOOL hasContentLength = NO;
+			const char* errorStatus = NULL;
+			BOOL close = ([headers rangeOfString:@" HTTP/1.0\r\n"].location != NSNotFound); // no keep-alive by default in HTTP/1.0
+			for(NSString* line in [headers componentsSeparatedByString:@"\r\n"]) {
+				NSRange colon = [line rangeOfString:@":"];
+				if (colon.location == NSNotFound) continue;
+				NSString* name = [[line substringToIndex:colon.location] lowercaseString];
+				NSString* value = [[line substringFromIndex:colon.location+1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+				if ([name isEqualToString:@"content-length"]) {
+					unsigned long long length = 0;
+					if (!parseContentLength(value, &length) || (hasContentLength && length != contentLength)) errorStatus = errorStatus ?: "400 Bad Request";
+					contentLength = length;
+					hasContentLength = YES;
+				} else if ([name isEqualToString:@"transfer-encoding"]) {
+					// the bodies are only framed by their Content-Length
+					BOOL chunked = ([value rangeOfString:@"chunked" options:NSCaseInsensitiveSearch].location != NSNotFound);
+					errorStatus = errorStatus ?: (chunked ? "411 Length Required" : "501 Not Implemented");
+				} else if ([name isEqualToString:@"connection"]) close = ([value caseInsensitiveCompare:@"close"] == NSOrderedSame);
+			}
+			if (!errorStatus && ((_maxRequestSize && contentLength > _maxRequestSize) || contentLength > NSUIntegerMax - headersLength)) {
+				errorStatus = "413 Request Entity Too Large";
+			}
+			if (errorStatus) {
+				// the bytes that follow cannot be framed: give up the connection
+				sendErrorStatus(fd, errorStatus);
+				open = NO;
+				break;
+			}
+			if ([input length] < headersLength + contentLength) break;
+			
+			NSAutoreleasePool* requestPool = [[NSAutoreleasePool alloc] init];
+			NSData* body = [NSData dataWithBytes:bytes+headersLength length:(NSUInteger)contentLength];
+			[input replaceBytesInRange:NSMakeRange(0, headersLength + (NSUInteger)contentLength) withBytes:NULL length:0];
+			NSData* responseBody = [self responseDataForRequestData:body parser:parser writer:writer];
+			NSString* responseHeaders = [NSString stringWithFormat:
+										 @"HTTP/1.1 %@\r\nContent-Type: application/json\r\nContent-Length: %lu\r\n%@\r\n",
+										 responseBody ? @"200 OK" : @"204 No Content", (unsigned long)[responseBody length],
+										 close ? @"Connection: close\r\n" : @""];
+			NSData* headersData = [responseHeaders dataUsingEncoding:NSISOLatin1StringEncoding];
+			open = writeAll(fd, [headersData bytes], [headersData length])
+				&& (!responseBody || writeAll(fd, [responseBody bytes], [responseBody length])) && !close;
+			[requestPool drain];
+			if (!open) break;
+		}
+	}
+	@synchronized(_connections) {
+		[_connections removeObject:fdNumber];
+	}
+	close(fd);
+	[parser release];
+	[writer release];
+	[pool drain];
+}
+
+-(void)stop {
+	if (!_running) return;
+	_running = NO;
+	// unblock the accepting thread and the connection threads
+	shutdown(_listenFD, SHUT_RDWR);
+	close(_listenFD);
+	_listenFD = -1;
+	@synchronized(_connections) {
+		for(NSNumber* fd in _connections) shutdown([fd intValue], SHUT_RDWR);
+	}
+	if (_socketPath) {
+		unlink([_socketPath fileSystemRepresentation]);
+		[_socketPath release];
+		_socketPath = nil;
+	}
+}
+
+-(void)dealloc {
+	[self stop];
+	CFRelease(_methods);
+	[_workers release];
+	[_connections release];
+	[_socketPath release];
+	[super dealloc];
+}
+
+@end
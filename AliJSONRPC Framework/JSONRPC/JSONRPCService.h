@@ -28,6 +28,18 @@
  */
 
 #import <Foundation/Foundation.h>
+#import "JSONRPCCallScheduler.h"
+#import "JSONRPCHedgingPolicy.h"
+#import "JSONRPCLoadBalancing.h"
+#import "JSONRPCRetryPolicy.h"
+#import "JSONRPCCompression.h"
+#import "JSONRPCMessagePack.h"
+#import "JSONRPCMetrics.h"
+#import "JSONRPCTracer.h"
+#import "JSONRPCLoopback.h"
+#import "JSONRPCTrafficRecorder.h"
+#import "JSONRPCBufferPool.h"
+#import "JSONRPCResponseCache.h"
 
 //! @file JSONRPCService.h
 //! @brief Represent a JSON-RPC WebService.
@@ -43,6 +55,16 @@ NSString* const JSONRPCFormatErrorString;     //!< English string for JSONRPCFor
 NSInteger const JSONRPCConversionErrorCode;   //!< The code for an NSError (JSONRPCInternalErrorDomain) that occurs when converting the JSON object to the resultClass instance
 NSString* const JSONRPCConversionErrorString; //!< English string for JSONRPCConversionErrorCode error. Define a localization for "JSONRPCConversionErrorString" in your Localizable.strings to provide a custom translation
 NSString* const JSONRPCErrorClassNameKey;     //!< the key used in NSError's userInfo dict to hold the class we expected to convert the JSON response to.
+NSInteger const JSONRPCTimeoutErrorCode;      //!< The code for an NSError (JSONRPCInternalErrorDomain) that occurs when the method call did not complete before its deadline
+NSString* const JSONRPCTimeoutErrorString;    //!< English string for JSONRPCTimeoutErrorCode error. Define a localization for "JSONRPCTimeoutErrorString" in your Localizable.strings to provide a custom translation
+NSInteger const JSONRPCCircuitOpenErrorCode;  //!< The code for an NSError (JSONRPCInternalErrorDomain) that occurs when the request was not sent because the circuit breaker of every endpoint is open
+NSString* const JSONRPCCircuitOpenErrorString; //!< English string for JSONRPCCircuitOpenErrorCode error. Define a localization for "JSONRPCCircuitOpenErrorString" in your Localizable.strings to provide a custom translation
+NSInteger const JSONRPCCompressionErrorCode;  //!< The code for an NSError (JSONRPCInternalErrorDomain) that occurs when the compressed response of the server is corrupted or truncated
+NSString* const JSONRPCCompressionErrorString; //!< English string for JSONRPCCompressionErrorCode error. Define a localization for "JSONRPCCompressionErrorString" in your Localizable.strings to provide a custom translation
+NSInteger const JSONRPCResponseTooLargeErrorCode;  //!< The code for an NSError (JSONRPCInternalErrorDomain) that occurs when the response is larger than JSONRPCService#maxResponseSize
+NSString* const JSONRPCResponseTooLargeErrorString; //!< English string for JSONRPCResponseTooLargeErrorCode error. Define a localization for "JSONRPCResponseTooLargeErrorString" in your Localizable.strings to provide a custom translation
+
+NSString* const JSONRPCTimeoutHeaderField;    //!< HTTP header used to send the remaining time budget (in milliseconds) to the server. See JSONRPCService#sendsTimeoutHeader
 
 
 @class JSONRPCMethodCall;
@@ -98,17 +120,113 @@ typedef enum {
 	JSONRPCVersion_2_0
 } JSONRPCVersion;
 
+//! Used to specify the encoding of the requests sent to the WebService (see JSONRPCService#contentType)
+typedef enum {
+	JSONRPCContentTypeJSON,       //!< JSON text (application/json)
+	JSONRPCContentTypeMessagePack //!< MessagePack binary encoding (application/msgpack), see JSONRPCMessagePack
+} JSONRPCContentType;
+
 
 //! The class representing a JSON-RPC WebService (identified by an URL to call methods to). It handle JSON-RPC v1.0 WebServices.
 @interface JSONRPCService : NSObject {
 	//! @privatesection
-	NSURL* _serviceURL;
+	NSArray* _endpoints;
+	id<JSONRPCLoadBalancingStrategy> _loadBalancingStrategy;
 	JSONRPCVersion _version;
 	NSObject<JSONRPCDelegate>* delegate;
+	JSONRPCCallScheduler* _scheduler;
+	NSTimeInterval _defaultTimeout;
+	BOOL _sendsTimeoutHeader;
+	JSONRPCHedgingPolicy* _hedgingPolicy;
+	JSONRPCRetryPolicy* _retryPolicy;
+	NSUInteger _requestCompressionThreshold;
+	JSONRPCContentEncoding _requestContentEncoding;
+	BOOL _acceptsCompressedResponses;
+	JSONRPCCompressionStats* _compressionStats;
+	JSONRPCContentType _contentType;
+	id<JSONRPCMetricsObserver> _metricsObserver;
+	JSONRPCTracer* _tracer;
+	JSONRPCTrafficRecorder* _trafficRecorder;
+	JSONRPCBufferPool* _bufferPool;
+	NSUInteger _maxResponseSize;
+	JSONRPCResponseCache* _responseCache;
+#if NS_BLOCKS_AVAILABLE
+	JSONRPCLoopbackHandler _loopbackHandler;
+#endif
 }
-@property(nonatomic, retain) NSURL* serviceURL; //!< The URL to forward JSONRPC method calls to.
+@property(nonatomic, retain) NSURL* serviceURL; //!< The URL to forward JSONRPC method calls to. If the service has multiple endpoints, this is the URL of the first one; setting it replaces all the endpoints.
+/** @brief The replicas of the WebService (JSONRPCEndpoint objects) among which the method calls are spread.
+ * Each request is sent to the endpoint chosen by the loadBalancingStrategy, among the endpoints whose circuit breaker is not open.
+ */
+@property(nonatomic, copy) NSArray* endpoints;
+@property(nonatomic, retain) id<JSONRPCLoadBalancingStrategy> loadBalancingStrategy; //!< The strategy used to choose the endpoint of each request. Defaults to a JSONRPCRoundRobinStrategy.
 @property(nonatomic, assign) JSONRPCVersion version; //!< The JSON-RPC version supported by the WebService
 @property(nonatomic, assign) NSObject<JSONRPCDelegate>* delegate; //!< Object to handle errors if not handled by JSONRPCResponseHandler#delegate .
+@property(nonatomic, readonly) JSONRPCCallScheduler* scheduler; //!< The scheduler that orders and throttles the method calls sent to this service.
+/** @brief The time budget of the method calls for which no JSONRPCResponseHandler#timeout is set. 0 (the default) means no deadline.
+ * @see JSONRPCResponseHandler#timeout
+ */
+@property(nonatomic, assign) NSTimeInterval defaultTimeout;
+/** @brief If YES, the remaining time budget of the method call is sent to the server (in milliseconds) in the JSONRPCTimeoutHeaderField HTTP header,
+ * so that it can give up on requests the client will not wait for anyway. Defaults to NO.
+ */
+@property(nonatomic, assign) BOOL sendsTimeoutHeader;
+/** @brief Opt-in policy to send a duplicate request when an idempotent method call is slow to respond. nil (the default) disables hedging.
+ * @see JSONRPCHedgingPolicy
+ */
+@property(nonatomic, retain) JSONRPCHedgingPolicy* hedgingPolicy;
+/** @brief The backoff and budget of the automatic retries after network errors. nil retries after a fixed JSONRPCResponseHandler#delayBeforeRetry, without budget.
+ * @see JSONRPCRetryPolicy
+ */
+@property(nonatomic, retain) JSONRPCRetryPolicy* retryPolicy;
+/** @brief Request bodies of at least this size (in bytes) are compressed with the requestContentEncoding. 0 (the default) never compresses.
+ * @note Only enable this if the server accepts compressed request bodies (Content-Encoding request header).
+ */
+@property(nonatomic, assign) NSUInteger requestCompressionThreshold;
+@property(nonatomic, assign) JSONRPCContentEncoding requestContentEncoding; //!< The compression of the request bodies above requestCompressionThreshold. Defaults to gzip.
+@property(nonatomic, assign) BOOL acceptsCompressedResponses; //!< If YES (the default), gzip and deflate responses are accepted and inflated as they are received.
+@property(nonatomic, readonly) JSONRPCCompressionStats* compressionStats; //!< Compression ratios and CPU time of the requests and responses of this service.
+/** @brief The encoding of the requests. Defaults to JSONRPCContentTypeJSON.
+ * With JSONRPCContentTypeMessagePack, the requests are sent in MessagePack and the server is asked to respond in MessagePack,
+ * or in JSON if it does not support it. Responses are decoded according to their Content-Type, whatever this setting.
+ */
+@property(nonatomic, assign) JSONRPCContentType contentType;
+/** @brief Object receiving the timings of every method call (one JSONRPCCallMetrics per call). nil (the default) disables the measures.
+ * @see JSONRPCMetricsAggregator to get per-method latency histograms
+ */
+@property(nonatomic, retain) id<JSONRPCMetricsObserver> metricsObserver;
+/** @brief Records the stages of the method calls as spans that can be opened in chrome://tracing. nil (the default) disables tracing.
+ * @note Only the method calls made after setting the tracer are traced.
+ */
+@property(nonatomic, retain) JSONRPCTracer* tracer;
+/** @brief Opt-in capture of the request/response pairs to a file, to replay real payloads offline. nil (the default) records nothing.
+ * @see JSONRPCTrafficRecorder
+ */
+@property(nonatomic, retain) JSONRPCTrafficRecorder* trafficRecorder;
+@property(nonatomic, readonly) JSONRPCBufferPool* bufferPool; //!< The buffers the responses are received into, presized from their Content-Length and reused from call to call.
+/** @brief The largest response accepted, in bytes (after inflation if it is compressed). 0 (the default) means no limit.
+ * A larger response is aborted as soon as its Content-Length or its received bytes exceed it, and the method call
+ * fails with a JSONRPCResponseTooLargeErrorCode error (it is not retried).
+ */
+@property(nonatomic, assign) NSUInteger maxResponseSize;
+/** @brief Opt-in cache of the responses of the read-only methods. nil (the default) caches nothing.
+ * A method call whose response is cached is answered (asynchronously, as usual) without sending any request.
+ * Create the cache with a directory to keep the responses across restarts of the process.
+ * @see JSONRPCResponseCache
+ */
+@property(nonatomic, retain) JSONRPCResponseCache* responseCache;
+/** @brief The identity of the service in its responseCache: its JSON-RPC version and the URLs of its endpoints.
+ * Services sharing a cache only share the responses of the same servers.
+ */
+@property(nonatomic, readonly) NSString* responseCacheNamespace;
+#if NS_BLOCKS_AVAILABLE
+/** @brief If set, the requests are not sent over the network but answered in-process by this block, and the replies go through
+ * the normal parse, conversion and dispatch path. nil (the default) uses the network.
+ * Useful to measure the overhead of the framework alone, and to run tests deterministically without a server.
+ * @see JSONRPCLoopbackHandler
+ */
+@property(nonatomic, copy) JSONRPCLoopbackHandler loopbackHandler;
+#endif
 @property(nonatomic, readonly) id proxy; //!< A proxy object on which you can call any Obj-C message (without any param or with an NSArray as a parameter), and which will be forwarded as a JSONRPC method call.
 
 
@@ -123,12 +241,29 @@ typedef enum {
  * @param version the JSON-RPC version supported by the WebService
  */
 +(id)serviceWithURL:(NSURL*)url version:(JSONRPCVersion)version;
-/** Designed initializer
+/** Constructor
  * @param url the URL of the WebService.
  * @param version the JSON-RPC version supported by the WebService
  */
 -(id)initWithURL:(NSURL*)url version:(JSONRPCVersion)version;
 
+/** Commodity constructor for a WebService replicated on multiple endpoints
+ * @param urls the NSArray of the NSURL of each replica of the WebService.
+ * @param version the JSON-RPC version supported by the WebService
+ */
++(id)serviceWithURLs:(NSArray*)urls version:(JSONRPCVersion)version;
+/** Designed initializer
+ * @param urls the NSArray of the NSURL of each replica of the WebService.
+ * @param version the JSON-RPC version supported by the WebService
+ */
+-(id)initWithURLs:(NSArray*)urls version:(JSONRPCVersion)version;
+
+/** @brief Choose the endpoint to send a request to, using the loadBalancingStrategy. @internal
+ * @param excluded an endpoint to avoid if others are available (e.g. the endpoint of the original request when hedging), or nil
+ * @return the chosen endpoint, or nil if the circuit breaker of every endpoint is open
+ */
+-(JSONRPCEndpoint*)selectEndpointExcluding:(JSONRPCEndpoint*)excluded;
+
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -199,6 +334,10 @@ typedef enum {
  * It is a nice way to have a somewhat transparent way to manipulate the WebService's API, <b>but has the drawback
  * that it will generate warnings on compilation</b> such as "xxx may not respond to selector yyy"
  * (as the message you will call on this proxy object are not declared but instead automatically forwarded using forwardInvocation:)
+ *
+ * @note The first time a selector is called on a proxy, a method is added for it to the JSONRPCServiceProxy class, and its JSON-RPC method name is cached:
+ *  the following calls with the same selector are dispatched directly to the service, without NSMethodSignature nor NSInvocation.
+ *  Selectors also implemented by JSONRPCService (and selectors with more than one parameter) still go through the forwarding.
  */
 @interface JSONRPCServiceProxy : NSProxy
 {
@@ -32,6 +32,8 @@
 
 #import "JSONRPCMethodCall.h"
 #import "JSONRPCResponseHandler.h"
+#import <objc/runtime.h>
+#include <pthread.h>
 
 NSString* const JSONRPCServerErrorDomain = @"JSONRPCServerError";
 NSString* const JSONRPCServerErrorNotification = @"JSONRPCServerErrorNotification";
@@ -42,15 +44,44 @@ NSInteger const JSONRPCFormatErrorCode = 8;
 NSString* const JSONRPCFormatErrorString = @"Server JSON-RPC response invalid : expected dictionary ({id,result,error})";
 NSInteger const JSONRPCConversionErrorCode = 10;
 NSString* const JSONRPCConversionErrorString = @"Error while converting received JSON data to requested resultClass";
+NSInteger const JSONRPCTimeoutErrorCode = 12;
+NSString* const JSONRPCTimeoutErrorString = @"The WebService did not respond in time";
+NSInteger const JSONRPCCircuitOpenErrorCode = 13;
+NSString* const JSONRPCCircuitOpenErrorString = @"The WebService is unavailable after repeated failures";
+NSInteger const JSONRPCCompressionErrorCode = 14;
+NSString* const JSONRPCCompressionErrorString = @"The compressed response of the server is corrupted";
+NSInteger const JSONRPCResponseTooLargeErrorCode = 15;
+NSString* const JSONRPCResponseTooLargeErrorString = @"The response of the server is too large";
+NSString* const JSONRPCTimeoutHeaderField = @"X-JSONRPC-Timeout";
 
 
 /////////////////////////////////////////////////////////////////////////////
 
 
 @implementation JSONRPCService
-@synthesize serviceURL = _serviceURL;
+@synthesize endpoints = _endpoints;
+@synthesize loadBalancingStrategy = _loadBalancingStrategy;
 @synthesize version = _version;
 @synthesize delegate;
+@synthesize scheduler = _scheduler;
+@synthesize defaultTimeout = _defaultTimeout;
+@synthesize sendsTimeoutHeader = _sendsTimeoutHeader;
+@synthesize hedgingPolicy = _hedgingPolicy;
+@synthesize retryPolicy = _retryPolicy;
+@synthesize requestCompressionThreshold = _requestCompressionThreshold;
+@synthesize requestContentEncoding = _requestContentEncoding;
+@synthesize acceptsCompressedResponses = _acceptsCompressedResponses;
+@synthesize compressionStats = _compressionStats;
+@synthesize contentType = _contentType;
+@synthesize metricsObserver = _metricsObserver;
+@synthesize tracer = _tracer;
+@synthesize trafficRecorder = _trafficRecorder;
+@synthesize bufferPool = _bufferPool;
+@synthesize maxResponseSize = _maxResponseSize;
+@synthesize responseCache = _responseCache;
+#if NS_BLOCKS_AVAILABLE
+@synthesize loopbackHandler = _loopbackHandler;
+#endif
 
 -(id)proxy {
 	return [[[JSONRPCServiceProxy alloc] initWithService:self] autorelease];	
@@ -69,55 +100,158 @@ NSString* const JSONRPCConversionErrorString = @"Error while converting received
 }
 
 - (id) initWithURL:(NSURL*)url  version:(JSONRPCVersion)version
+{
+	return [self initWithURLs:[NSArray arrayWithObject:url] version:version];
+}
+
++(id)serviceWithURLs:(NSArray*)urls version:(JSONRPCVersion)version
+{
+	return [[[JSONRPCService alloc] initWithURLs:urls version:version] autorelease];
+}
+
+- (id) initWithURLs:(NSArray*)urls version:(JSONRPCVersion)version
 {
 	self = [super init];
 	if (self != nil) {
-		_serviceURL = [url retain];
+		NSMutableArray* endpoints = [NSMutableArray arrayWithCapacity:[urls count]];
+		for(NSURL* url in urls) [endpoints addObject:[JSONRPCEndpoint endpointWithURL:url]];
+		_endpoints = [endpoints copy];
+		_loadBalancingStrategy = [[JSONRPCRoundRobinStrategy alloc] init];
 		_version = version;
+		_scheduler = [[JSONRPCCallScheduler alloc] init];
+		_retryPolicy = [[JSONRPCRetryPolicy alloc] init];
+		_requestContentEncoding = JSONRPCContentEncodingGzip;
+		_acceptsCompressedResponses = YES;
+		_compressionStats = [[JSONRPCCompressionStats alloc] init];
+		_bufferPool = [[JSONRPCBufferPool alloc] init];
 	}
 	return self;
 }
 
 
 -(NSString*)description {
+	if ([_endpoints count]>1) {
+		return [NSString stringWithFormat:@"<%@ %@>",NSStringFromClass([self class]),[_endpoints valueForKey:@"URL"]];
+	}
 	return [NSString stringWithFormat:@"<%@ %@>",NSStringFromClass([self class]),self.serviceURL];
 }
 
 -(void)dealloc
 {
-	[_serviceURL release];
+	[_endpoints release];
+	[_loadBalancingStrategy release];
+	[_scheduler release];
+	[_hedgingPolicy release];
+	[_retryPolicy release];
+	[_compressionStats release];
+	[_metricsObserver release];
+	[_tracer release];
+	[_trafficRecorder release];
+	[_bufferPool release];
+	[_responseCache release];
+#if NS_BLOCKS_AVAILABLE
+	[_loopbackHandler release];
+#endif
 	[super dealloc];
 }
 
 
 
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Endpoints
+/////////////////////////////////////////////////////////////////////////////
+
+-(NSURL*)serviceURL {
+	return [_endpoints count] ? [[_endpoints objectAtIndex:0] URL] : nil;
+}
+-(void)setServiceURL:(NSURL*)url {
+	self.endpoints = url ? [NSArray arrayWithObject:[JSONRPCEndpoint endpointWithURL:url]] : nil;
+}
+
+-(JSONRPCEndpoint*)selectEndpointExcluding:(JSONRPCEndpoint*)excluded {
+	NSMutableArray* candidates = [NSMutableArray arrayWithCapacity:[_endpoints count]];
+	for(JSONRPCEndpoint* ep in _endpoints) {
+		if (ep != excluded && [ep isAvailable]) [candidates addObject:ep];
+	}
+	if (![candidates count]) {
+		// No other endpoint: use the excluded one rather than nothing, unless its circuit is open too
+		return [excluded isAvailable] ? excluded : nil;
+	}
+	return [_loadBalancingStrategy endpointAmongEndpoints:candidates];
+}
+
+
+
 /////////////////////////////////////////////////////////////////////////////
 // MARK: -
 // MARK: Call a RPC method
 /////////////////////////////////////////////////////////////////////////////
 
+-(NSString*)responseCacheNamespace {
+	NSArray* urls = [[_endpoints valueForKeyPath:@"URL.absoluteString"] sortedArrayUsingSelector:@selector(compare:)];
+	return [NSString stringWithFormat:@"%d %@",(int)_version,[urls componentsJoinedByString:@" "]];
+}
+
 - (JSONRPCResponseHandler*)callMethod:(JSONRPCMethodCall*)methodCall {
 	return [self callMethod:methodCall reuseResponseHandler:nil];
 }
 - (JSONRPCResponseHandler*)callMethod:(JSONRPCMethodCall*)methodCall reuseResponseHandler:(JSONRPCResponseHandler*)responseHandler
 {
+	CFAbsoluteTime callTime = CFAbsoluteTimeGetCurrent();
 	methodCall.service = self;
-	NSString* jsonStr = [[methodCall proxyForJson] JSONRepresentation];
 	
 	if ((self.version<JSONRPCVersion_1_1) && ([methodCall.parameters isKindOfClass:[NSDictionary class]])) {
 		NSLog(@"JSON-RPC: warning: named parameters are only supported by JSON-RPC Service version 1.1 or higher");
 	}
 	
+	NSData* cachedResponse = (responseHandler || !_responseCache) ? nil : [_responseCache responseForMethodName:methodCall.methodName parameters:methodCall.parameters
+																		  serviceNamespace:self.responseCacheNamespace];
+	if (cachedResponse) {
+		// no request to send
+		JSONRPCResponseHandler* d = [[[JSONRPCResponseHandler alloc] init] autorelease];
+		d.methodCall = methodCall;
+		[d startDeadlineTimer];
+		if (_metricsObserver) [d startMetricsAtTime:callTime requestBytes:0];
+		if (_tracer) [d startTraceAtTime:callTime];
+		[d deliverCachedResponse:cachedResponse];
+		return d;
+	}
+	
 	NSMutableURLRequest* req = [NSMutableURLRequest requestWithURL:self.serviceURL];
 	[req setHTTPMethod:@"POST"];
-	[req setHTTPBody:[jsonStr dataUsingEncoding:NSUTF8StringEncoding]];
-	[req setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-	[req setValue:@"application/json" forHTTPHeaderField:@"Accept"];
+	NSData* body = nil;
+	if (_contentType == JSONRPCContentTypeMessagePack) {
+		NSError* encodingError = nil;
+		body = [JSONRPCMessagePack dataWithObject:[methodCall proxyForJson] error:&encodingError];
+		if (!body) NSLog(@"-JSONRPCService callMethod: MessagePack encoding failed. Error is: %@", [encodingError localizedDescription]);
+		[req setValue:JSONRPCMessagePackMIMEType forHTTPHeaderField:@"Content-Type"];
+		[req setValue:[JSONRPCMessagePackMIMEType stringByAppendingString:@", application/json;q=0.5"] forHTTPHeaderField:@"Accept"];
+	} else {
+		body = [methodCall JSONData];
+		[req setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+		[req setValue:@"application/json" forHTTPHeaderField:@"Accept"];
+	}
+	if (_requestCompressionThreshold && [body length] >= _requestCompressionThreshold) {
+		NSData* compressedBody = [JSONRPCCompression compressData:body encoding:_requestContentEncoding stats:_compressionStats];
+		if (compressedBody && [compressedBody length] < [body length]) {
+			body = compressedBody;
+			[req setValue:[JSONRPCCompression nameOfEncoding:_requestContentEncoding] forHTTPHeaderField:@"Content-Encoding"];
+		}
+	}
+	[req setHTTPBody:body];
+	[req setValue:(_acceptsCompressedResponses ? @"gzip, deflate" : @"identity") forHTTPHeaderField:@"Accept-Encoding"];
 	
 	JSONRPCResponseHandler* d = responseHandler ?: [[[JSONRPCResponseHandler alloc] init] autorelease];
 	d.methodCall = methodCall;
-	[NSURLConnection connectionWithRequest:req delegate:d];
-	[UIApplication sharedApplication].networkActivityIndicatorVisible = YES;
+	d.request = req;
+	if (!responseHandler) {
+		[d startDeadlineTimer]; // retries share the deadline of the first attempt
+		[_retryPolicy methodCallDidStart];
+		if (_metricsObserver) [d startMetricsAtTime:callTime requestBytes:[body length]];
+		if (_tracer) [d startTraceAtTime:callTime];
+	}
+	[_scheduler enqueueResponseHandler:d];
 	return d;
 	
 }
@@ -165,6 +299,40 @@ NSString* const JSONRPCConversionErrorString = @"Error while converting received
 // MARK: JSONRPC Service Proxy
 /////////////////////////////////////////////////////////////////////////////
 
+// Cache of the JSON-RPC method names of the selectors called on proxies (SEL -> NSString)
+static CFMutableDictionaryRef gProxyMethodNames = NULL;
+static pthread_mutex_t gProxyMethodNamesLock = PTHREAD_MUTEX_INITIALIZER;
+
+static NSString* proxyMethodNameForSelector(SEL sel) {
+	pthread_mutex_lock(&gProxyMethodNamesLock);
+	if (!gProxyMethodNames) gProxyMethodNames = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+	NSString* methodName = (NSString*)CFDictionaryGetValue(gProxyMethodNames, sel);
+	pthread_mutex_unlock(&gProxyMethodNamesLock);
+	if (methodName) return methodName; // entries are never replaced nor removed: no need to retain it
+	
+	methodName = [[NSString stringWithUTF8String:sel_getName(sel)] stringByReplacingOccurrencesOfString:@":" withString:@""];
+	pthread_mutex_lock(&gProxyMethodNamesLock);
+	CFDictionaryAddValue(gProxyMethodNames, sel, methodName); // no-op if another thread added it meanwhile
+	methodName = (NSString*)CFDictionaryGetValue(gProxyMethodNames, sel);
+	pthread_mutex_unlock(&gProxyMethodNamesLock);
+	return methodName;
+}
+
+// Implementations installed on JSONRPCServiceProxy for the selectors called on it, so that they skip the forwarding machinery
+static id proxyCallWithoutParameters(JSONRPCServiceProxy* self, SEL _cmd) {
+	return [self.service callMethodWithName:proxyMethodNameForSelector(_cmd) parameters:nil];
+}
+static id proxyCallWithParameters(JSONRPCServiceProxy* self, SEL _cmd, id params) {
+	if (!params || [params isKindOfClass:[NSArray class]]) {
+		return [self.service callMethodWithName:proxyMethodNameForSelector(_cmd) parameters:params];
+	} else if ([params isKindOfClass:[NSDictionary class]]) {
+		return [self.service callMethodWithName:proxyMethodNameForSelector(_cmd) namedParameters:params];
+	}
+	[NSException raise:NSInvalidArgumentException format:@"-[%@ %s]: the parameter must be an NSArray or an NSDictionary, not %@",
+	 NSStringFromClass([self class]),sel_getName(_cmd),NSStringFromClass([params class])];
+	return nil;
+}
+
 @implementation JSONRPCServiceProxy
 @synthesize service = _service;
 - (id) initWithService:(JSONRPCService*)service
@@ -172,6 +340,22 @@ NSString* const JSONRPCConversionErrorString = @"Error while converting received
 	_service = service;
 	return self;
 }
+
+// Install a real method for the selector on first use: later calls with this selector are dispatched directly
++ (BOOL)resolveInstanceMethod:(SEL)aSelector {
+	if ([JSONRPCService instancesRespondToSelector:aSelector]) return NO; // keep the forwarding behavior
+	const char* name = sel_getName(aSelector);
+	const char* colon = strchr(name, ':');
+	if (!colon) {
+		proxyMethodNameForSelector(aSelector);
+		return class_addMethod(self, aSelector, (IMP)proxyCallWithoutParameters, "@@:");
+	} else if (colon[1] == '\0') {
+		proxyMethodNameForSelector(aSelector);
+		return class_addMethod(self, aSelector, (IMP)proxyCallWithParameters, "@@:@");
+	}
+	return NO;
+}
+
 - (NSMethodSignature *)methodSignatureForSelector:(SEL)aSelector {
 	NSMethodSignature *ret = nil;
 	if (! (ret = [_service methodSignatureForSelector:aSelector])) { 
@@ -193,8 +377,7 @@ NSString* const JSONRPCConversionErrorString = @"Error while converting received
 
 - (void)forwardInvocation:(NSInvocation *)anInvocation
 {
-	NSString* methodName = [[NSString stringWithUTF8String:sel_getName([anInvocation selector])]
-							stringByReplacingOccurrencesOfString:@":" withString:@""];
+	NSString* methodName = proxyMethodNameForSelector([anInvocation selector]);
 	
 	id params = nil;
 	int nbArgs = [[anInvocation methodSignature] numberOfArguments];
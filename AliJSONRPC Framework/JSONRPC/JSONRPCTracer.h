@@ -0,0 +1,86 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+//! @file JSONRPCTracer.h
+//! @brief Records the stages of the method calls as spans, exportable to the Chrome trace-event format.
+
+/** @brief Records begin/end spans of the stages of each method call into a fixed-size ring buffer (see JSONRPCService#tracer)
+ *
+ * The spans recorded for each method call are: the whole call (named after the method), "serialize", "queue",
+ * each "attempt" (with its retry index and outcome), each "backoff" delay before a retry, "hedge" requests,
+ * "parse", "convert" and "dispatch". Each method call is shown on its own track, so you can see how concurrent
+ * calls overlap and wait in the queue.
+ *
+ * When the buffer is full, the oldest spans are overwritten. Dump the spans with traceEventsJSON or writeToFile:error:
+ * and open the file in chrome://tracing or https://ui.perfetto.dev
+ *
+ * When the JSONRPCService has no tracer (the default), the cost is a single test per stage.
+ */
+@interface JSONRPCTracer : NSObject
+{
+	//! @privatesection
+	void* _events;
+	NSUInteger _capacity;
+	NSUInteger _next;
+	NSUInteger _count;
+	_Atomic(uint32_t) _lastCallID;
+	CFAbsoluteTime _startTime;
+	pthread_mutex_t _lock;
+}
++(id)tracer; //!< Commodity constructor, with a capacity of 4096 spans
+-(id)initWithCapacity:(NSUInteger)capacity; //!< Designed initializer
+@property(nonatomic, readonly) NSUInteger capacity; //!< maximum number of spans kept
+@property(nonatomic, readonly) NSUInteger count; //!< number of spans currently in the buffer
+
+-(NSString*)traceEventsJSON; //!< the recorded spans, as Chrome trace-event JSON
+-(BOOL)writeToFile:(NSString*)path error:(NSError**)error; //!< write traceEventsJSON to a file
+-(void)clear; //!< forget all the recorded spans
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Used by the framework
+/////////////////////////////////////////////////////////////////////////////
+
+-(uint32_t)newCallID; //!< @internal a new track identifier for a method call (never 0)
+/** @brief Record a span. @internal
+ * @param name static C string naming the stage (not copied)
+ * @param label if not nil, used instead of name (e.g. the method name)
+ * @param callID the track of the method call
+ * @param start the beginning of the span
+ * @param end the end of the span
+ * @param attempt the retry index for "attempt" spans (0 for the first attempt), or -1
+ * @param outcome static C string describing the outcome (not copied), or NULL
+ */
+-(void)recordSpan:(const char*)name label:(NSString*)label callID:(uint32_t)callID
+			start:(CFAbsoluteTime)start end:(CFAbsoluteTime)end attempt:(int)attempt outcome:(const char*)outcome;
+@end
@@ -0,0 +1,172 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCTracer.h"
+#import "JSON.h"
+
+typedef struct {
+	const char* name;
+	NSString* label;
+	uint32_t callID;
+	int attempt;
+	const char* outcome;
+	CFAbsoluteTime start;
+	CFAbsoluteTime end;
+} TraceSpan;
+
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCTracer
+@synthesize capacity = _capacity;
+
++(id)tracer {
+	return [[[self alloc] initWithCapacity:4096] autorelease];
+}
+
+-(id)initWithCapacity:(NSUInteger)capacity
+{
+	self = [super init];
+	if (self != nil) {
+		_capacity = MAX(capacity, 1);
+		_events = calloc(_capacity, sizeof(TraceSpan));
+		_startTime = CFAbsoluteTimeGetCurrent();
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+-(id)init {
+	return [self initWithCapacity:4096];
+}
+
+-(void)dealloc {
+	[self clear];
+	free(_events);
+	pthread_mutex_destroy(&_lock);
+	[super dealloc];
+}
+
+-(NSUInteger)count {
+	return _count;
+}
+
+-(uint32_t)newCallID {
+	uint32_t callID;
+	do {
+		callID = atomic_fetch_add_explicit(&_lastCallID, 1, memory_order_relaxed) + 1;
+	} while (!callID);
+	return callID;
+}
+
+-(void)recordSpan:(const char*)name label:(NSString*)label callID:(uint32_t)callID
+			start:(CFAbsoluteTime)start end:(CFAbsoluteTime)end attempt:(int)attempt outcome:(const char*)outcome
+{
+	[label retain];
+	pthread_mutex_lock(&_lock);
+	TraceSpan* span = (TraceSpan*)_events + _next;
+	NSString* overwritten = span->label;
+	span->name = name;
+	span->label = label;
+	span->callID = callID;
+	span->attempt = attempt;
+	span->outcome = outcome;
+	span->start = start;
+	span->end = end;
+	_next = (_next+1) % _capacity;
+	if (_count < _capacity) ++_count;
+	pthread_mutex_unlock(&_lock);
+	[overwritten release];
+}
+
+-(void)clear {
+	pthread_mutex_lock(&_lock);
+	TraceSpan* spans = _events;
+	for(NSUInteger i=0; i<_capacity; ++i) {
+		[spans[i].label release];
+		spans[i].label = nil;
+	}
+	_next = _count = 0;
+	pthread_mutex_unlock(&_lock);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Export
+/////////////////////////////////////////////////////////////////////////////
+
+-(NSString*)traceEventsJSON {
+	// copy the spans out of the lock, so that recording is never blocked by the JSON formatting
+	pthread_mutex_lock(&_lock);
+	NSUInteger count = _count;
+	NSUInteger first = (_next + _capacity - count) % _capacity;
+	TraceSpan* spans = malloc(MAX(count,1) * sizeof(TraceSpan));
+	for(NSUInteger i=0; i<count; ++i) {
+		spans[i] = ((TraceSpan*)_events)[(first+i) % _capacity];
+		[spans[i].label retain];
+	}
+	pthread_mutex_unlock(&_lock);
+	
+	NSMutableArray* events = [NSMutableArray arrayWithCapacity:count];
+	NSNumber* pid = [NSNumber numberWithInt:1];
+	for(NSUInteger i=0; i<count; ++i) {
+		TraceSpan* span = &spans[i];
+		NSMutableDictionary* ev = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+								   span->label ?: [NSString stringWithUTF8String:span->name],@"name",
+								   @"jsonrpc",@"cat",
+								   @"X",@"ph",
+								   [NSNumber numberWithLongLong:(long long)((span->start-_startTime)*1e6)],@"ts",
+								   [NSNumber numberWithLongLong:(long long)(MAX(0,span->end-span->start)*1e6)],@"dur",
+								   pid,@"pid",
+								   [NSNumber numberWithUnsignedInt:span->callID],@"tid",
+								   nil];
+		if (span->attempt >= 0 || span->outcome) {
+			NSMutableDictionary* args = [NSMutableDictionary dictionaryWithCapacity:2];
+			if (span->attempt >= 0) [args setObject:[NSNumber numberWithInt:span->attempt] forKey:@"retry"];
+			if (span->outcome) [args setObject:[NSString stringWithUTF8String:span->outcome] forKey:@"outcome"];
+			[ev setObject:args forKey:@"args"];
+		}
+		[events addObject:ev];
+		[span->label release];
+	}
+	free(spans);
+	
+	SBJsonWriter* writer = [[SBJsonWriter alloc] init];
+	NSString* json = [writer stringWithObject:[NSDictionary dictionaryWithObjectsAndKeys:
+											   events,@"traceEvents",
+											   @"ms",@"displayTimeUnit",
+											   nil]];
+	[writer release];
+	return json;
+}
+
+-(BOOL)writeToFile:(NSString*)path error:(NSError**)error {
+	return [[self traceEventsJSON] writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:error];
+}
+
+@end
@@ -0,0 +1,104 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//! @file JSONRPCTrafficRecorder.h
+//! @brief Captures the request/response pairs of a JSONRPCService to a file, to replay real payloads offline.
+
+/** @brief A request/response pair read from a capture file (see JSONRPCTrafficRecorder)
+ */
+@interface JSONRPCTrafficRecord : NSObject
+{
+	//! @privatesection
+	NSString* _methodName;
+	CFAbsoluteTime _callTime;
+	NSTimeInterval _duration;
+	NSData* _requestBody;
+	NSData* _responseBody;
+	BOOL _binaryRequest;
+	BOOL _binaryResponse;
+}
+@property(nonatomic, copy) NSString* methodName;
+@property(nonatomic, assign) CFAbsoluteTime callTime;     //!< when the method was called
+@property(nonatomic, assign) NSTimeInterval duration;     //!< from the call to the last byte of the response (including the retries)
+@property(nonatomic, retain) NSData* requestBody;         //!< the serialized method call, uncompressed
+@property(nonatomic, retain) NSData* responseBody;        //!< the body of the response, inflated
+@property(nonatomic, assign) BOOL binaryRequest;          //!< YES if requestBody is encoded in MessagePack, NO for JSON
+@property(nonatomic, assign) BOOL binaryResponse;         //!< YES if responseBody is encoded in MessagePack, NO for JSON
+-(id)decodedRequest:(NSError**)error;  //!< the JSON object of the method call (with "method" and "params")
+-(id)decodedResponse:(NSError**)error; //!< the JSON object of the response (with "result" and "error")
+@end
+
+
+
+/** @brief Appends the request/response pairs of the method calls of a JSONRPCService to a capture file (see JSONRPCService#trafficRecorder)
+ *
+ * Each response received is written with its request, the method name, the call time and the duration of the call, in a compact
+ * binary format: the file starts with the 8-byte signature "JRPCTRC1", followed by the records. Each record is made of:
+ *  - its length (uint32, not including these 4 bytes),
+ *  - flags (uint8: 1 if the request is in MessagePack, 2 if the response is in MessagePack),
+ *  - the call time (CFAbsoluteTime) and the duration (float64),
+ *  - the method name, the request body and the response body, each prefixed by its length (uint32).
+ *
+ * All numbers are little-endian. Each record is appended with a single write, so an interrupted capture only loses its last record,
+ * and several recorders (or processes) can append to the same file.
+ *
+ * Read the records back with recordsWithContentsOfFile:error:, e.g. to replay them with Benchmarks/ReplayBenchmark.
+ * @note The capture contains the full payloads of the method calls: take care of where you store it.
+ */
+@interface JSONRPCTrafficRecorder : NSObject
+{
+	//! @privatesection
+	NSString* _path;
+	int _fd;
+	NSUInteger _recordsCount;
+}
+@property(nonatomic, readonly) NSString* path;
+@property(nonatomic, readonly) NSUInteger recordsCount; //!< the number of records written by this recorder
++(id)recorderWithFile:(NSString*)path error:(NSError**)error; //!< Commodity constructor
+/** @brief Designed initializer. Opens the capture file to append records to it, and creates it if needed.
+ * @return nil if the file cannot be opened (the error is in the NSPOSIXErrorDomain)
+ */
+-(id)initWithFile:(NSString*)path error:(NSError**)error;
+-(void)close; //!< Close the file. Nothing is recorded afterwards. Done automatically on dealloc.
+
+/** @brief Append a record. Called by the JSONRPCResponseHandler when a response is received.
+ * @param request the request as sent. Its body is inflated if it was compressed.
+ * @param response the body of the response, inflated
+ */
+-(void)recordMethodName:(NSString*)methodName request:(NSURLRequest*)request
+			   response:(NSData*)response binaryResponse:(BOOL)binaryResponse
+			   callTime:(CFAbsoluteTime)callTime duration:(NSTimeInterval)duration;
+
+/** @brief Read the records of a capture file
+ * @return JSONRPCTrafficRecord objects, in the order they were recorded. nil if the file cannot be read or is not a capture file.
+ */
++(NSArray*)recordsWithContentsOfFile:(NSString*)path error:(NSError**)error;
+@end
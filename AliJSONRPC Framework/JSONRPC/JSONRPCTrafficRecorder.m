@@ -0,0 +1,257 @@
+/*
+ Copyright (C) 2009 Olivier Halligon. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used
+ to endorse or promote products derived from this software without specific
+ prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "JSONRPCTrafficRecorder.h"
+#import "JSON.h"
+#import "JSONRPCCompression.h"
+#import "JSONRPCMessagePack.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+static const char kCaptureSignature[8] = { 'J','R','P','C','T','R','C','1' };
+enum { kBinaryRequestFlag = 1, kBinaryResponseFlag = 2 };
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Encoding helpers
+/////////////////////////////////////////////////////////////////////////////
+
+static void appendUInt32(NSMutableData* data, uint32_t value) {
+	uint32_t le = NSSwapHostIntToLittle(value);
+	[data appendBytes:&le length:sizeof(le)];
+}
+static void appendDouble(NSMutableData* data, double value) {
+	NSSwappedDouble le = NSSwapHostDoubleToLittle(value);
+	[data appendBytes:&le length:sizeof(le)];
+}
+static void appendBytes(NSMutableData* data, NSData* bytes) {
+	appendUInt32(data, (uint32_t)[bytes length]);
+	[data appendData:bytes];
+}
+
+// Bounds-checked reads: return NO when the record is truncated
+static BOOL readUInt32(const uint8_t** p, const uint8_t* end, uint32_t* value) {
+	if (end - *p < (ptrdiff_t)sizeof(uint32_t)) return NO;
+	uint32_t le;
+	memcpy(&le, *p, sizeof(le));
+	*value = NSSwapLittleIntToHost(le);
+	*p += sizeof(le);
+	return YES;
+}
+static BOOL readDouble(const uint8_t** p, const uint8_t* end, double* value) {
+	if (end - *p < (ptrdiff_t)sizeof(NSSwappedDouble)) return NO;
+	NSSwappedDouble le;
+	memcpy(&le, *p, sizeof(le));
+	*value = NSSwapLittleDoubleToHost(le);
+	*p += sizeof(le);
+	return YES;
+}
+static NSData* readBytes(const uint8_t** p, const uint8_t* end) {
+	uint32_t length;
+	if (!readUInt32(p, end, &length) || (uint32_t)(end - *p) < length) return nil;
+	NSData* data = [NSData dataWithBytes:*p length:length];
+	*p += length;
+	return data;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Records
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCTrafficRecord
+@synthesize methodName = _methodName, callTime = _callTime, duration = _duration;
+@synthesize requestBody = _requestBody, responseBody = _responseBody;
+@synthesize binaryRequest = _binaryRequest, binaryResponse = _binaryResponse;
+
+static id decodeBody(NSData* body, BOOL binary, NSError** error) {
+	if (binary) {
+		return [JSONRPCMessagePack objectWithData:body error:error];
+	}
+	SBJSON* parser = [[SBJSON alloc] init];
+	NSString* json = [[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding];
+	id obj = [parser objectWithString:json error:error];
+	[json release];
+	[parser release];
+	return obj;
+}
+
+-(id)decodedRequest:(NSError**)error {
+	return decodeBody(_requestBody, _binaryRequest, error);
+}
+-(id)decodedResponse:(NSError**)error {
+	return decodeBody(_responseBody, _binaryResponse, error);
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@ %.1fms, %lu bytes -> %lu bytes>",NSStringFromClass([self class]),_methodName,
+			_duration*1000,(unsigned long)[_requestBody length],(unsigned long)[_responseBody length]];
+}
+
+-(void)dealloc {
+	[_methodName release];
+	[_requestBody release];
+	[_responseBody release];
+	[super dealloc];
+}
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Recorder
+/////////////////////////////////////////////////////////////////////////////
+
+@implementation JSONRPCTrafficRecorder
+@synthesize path = _path, recordsCount = _recordsCount;
+
++(id)recorderWithFile:(NSString*)path error:(NSError**)error {
+	return [[[self alloc] initWithFile:path error:error] autorelease];
+}
+
+-(id)initWithFile:(NSString*)path error:(NSError**)error {
+	self = [super init];
+	if (self != nil) {
+		_path = [path copy];
+		_fd = open([path fileSystemRepresentation], O_WRONLY|O_APPEND|O_CREAT, 0600);
+		// other recorders (or processes) may open the same empty file: only the first one writes the signature
+		BOOL ok = (_fd >= 0) && (flock(_fd, LOCK_EX) == 0);
+		if (ok) {
+			struct stat st;
+			ok = (fstat(_fd, &st) == 0);
+			if (ok && st.st_size == 0) {
+				ssize_t written = write(_fd, kCaptureSignature, sizeof(kCaptureSignature));
+				ok = (written == (ssize_t)sizeof(kCaptureSignature));
+				if (!ok && written >= 0) errno = EIO; // short write
+			}
+			int err = errno;
+			flock(_fd, LOCK_UN);
+			errno = err;
+		}
+		if (!ok) {
+			if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno
+												userInfo:[NSDictionary dictionaryWithObject:path forKey:NSFilePathErrorKey]];
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+-(void)close {
+	if (_fd >= 0) close(_fd);
+	_fd = -1;
+}
+
+-(void)recordMethodName:(NSString*)methodName request:(NSURLRequest*)request
+			   response:(NSData*)response binaryResponse:(BOOL)binaryResponse
+			   callTime:(CFAbsoluteTime)callTime duration:(NSTimeInterval)duration
+{
+	if (_fd < 0) return;
+	NSData* requestBody = [request HTTPBody];
+	if ([request valueForHTTPHeaderField:@"Content-Encoding"]) {
+		// record the method call, not its compressed form
+		NSMutableData* inflated = [NSMutableData dataWithCapacity:[requestBody length]*4];
+		JSONRPCInflater* inflater = [[JSONRPCInflater alloc] initWithStats:nil];
+		[inflater inflateChunk:requestBody into:inflated];
+		if (![inflater finish]) requestBody = inflated;
+		[inflater release];
+	}
+	BOOL binaryRequest = [[request valueForHTTPHeaderField:@"Content-Type"] hasPrefix:JSONRPCMessagePackMIMEType];
+	NSData* nameData = [methodName dataUsingEncoding:NSUTF8StringEncoding];
+	
+	NSMutableData* record = [[NSMutableData alloc] initWithCapacity:32+[nameData length]+[requestBody length]+[response length]];
+	appendUInt32(record, 0); // length, set below
+	uint8_t flags = (binaryRequest ? kBinaryRequestFlag : 0) | (binaryResponse ? kBinaryResponseFlag : 0);
+	[record appendBytes:&flags length:1];
+	appendDouble(record, callTime);
+	appendDouble(record, duration);
+	appendBytes(record, nameData);
+	appendBytes(record, requestBody);
+	appendBytes(record, response);
+	uint32_t length = NSSwapHostIntToLittle((uint32_t)[record length] - sizeof(uint32_t));
+	[record replaceBytesInRange:NSMakeRange(0, sizeof(length)) withBytes:&length];
+	
+	// a single write, so that the records of concurrent writers don't interleave
+	if (write(_fd, [record bytes], [record length]) == (ssize_t)[record length]) {
+		++_recordsCount;
+	} else {
+		NSLog(@"JSONRPCTrafficRecorder: cannot write to %@: %s", _path, strerror(errno));
+	}
+	[record release];
+}
+
++(NSArray*)recordsWithContentsOfFile:(NSString*)path error:(NSError**)error {
+	NSData* data = [NSData dataWithContentsOfFile:path options:NSMappedRead error:error];
+	if (!data) return nil;
+	const uint8_t* p = [data bytes];
+	const uint8_t* end = p + [data length];
+	if ([data length] < sizeof(kCaptureSignature) || memcmp(p, kCaptureSignature, sizeof(kCaptureSignature))) {
+		if (error) *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError
+											userInfo:[NSDictionary dictionaryWithObject:path forKey:NSFilePathErrorKey]];
+		return nil;
+	}
+	p += sizeof(kCaptureSignature);
+	
+	NSMutableArray* records = [NSMutableArray array];
+	uint32_t length;
+	while (readUInt32(&p, end, &length) && (uint32_t)(end - p) >= length) {
+		const uint8_t* recordEnd = p + length;
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		JSONRPCTrafficRecord* record = [[JSONRPCTrafficRecord alloc] init];
+		double callTime, duration;
+		NSData *nameData, *requestBody, *responseBody;
+		uint8_t flags = (p < recordEnd) ? *p++ : 0;
+		if (readDouble(&p, recordEnd, &callTime) && readDouble(&p, recordEnd, &duration)
+			&& (nameData = readBytes(&p, recordEnd)) && (requestBody = readBytes(&p, recordEnd)) && (responseBody = readBytes(&p, recordEnd)))
+		{
+			record.methodName = [[[NSString alloc] initWithData:nameData encoding:NSUTF8StringEncoding] autorelease];
+			record.callTime = callTime;
+			record.duration = duration;
+			record.requestBody = requestBody;
+			record.responseBody = responseBody;
+			record.binaryRequest = (flags & kBinaryRequestFlag) != 0;
+			record.binaryResponse = (flags & kBinaryResponseFlag) != 0;
+			[records addObject:record];
+		}
+		[record release];
+		[pool drain];
+		p = recordEnd; // skip what a newer version may have added to the record
+	}
+	return records;
+}
+
+-(void)dealloc {
+	[self close];
+	[_path release];
+	[super dealloc];
+}
+
+@end
@@ -63,4 +63,42 @@
 +(id)arrayWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass;
 //! Designed initializer to create an NSArray of itemsClass objects from an NSArray of JSON (typically NSDictionary) objects
 -(id)initWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass;
+//! Commodity constructor, see initWithJson:itemsClass:concurrently:
++(id)arrayWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass concurrently:(BOOL)concurrently;
+/** @brief Same as initWithJson:itemsClass:, but large arrays are converted on all the cores if concurrently is YES
+ *
+ * The array is split in chunks of a few hundred objects, converted in parallel on GCD's global queue (this method
+ * returns once all the chunks are converted). The order of the objects is preserved.
+ * Small arrays, single-core devices and systems without blocks are converted serially.
+ * @warning The initWithJson: method of itemsClass must then be thread-safe.
+ */
+-(id)initWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass concurrently:(BOOL)concurrently;
+@end
+
+
+/** @brief NSArray converting its JSON objects to itemsClass instances only when they are first accessed
+ *
+ * Create it with the methods of the NSArray(JSON) category, e.g. [JSONRPCLazyArray arrayWithJson:jsonObjects itemsClass:[Person class]].
+ * It keeps the NSArray of JSON objects, and calls "initWithJson:" for an index the first time objectAtIndex: (or fast enumeration)
+ * reaches it; the converted object is cached for the following accesses. This way, only the rows of a large result that
+ * are actually displayed are converted.
+ *
+ * As with NSArray(JSON), the JSON objects for which "initWithJson:" returns nil are converted to [NSNull null].
+ * Accessing the array from several threads is safe: if two threads convert the same index at the same time, only one
+ * of the converted objects is kept.
+ * The "concurrently" variants of the NSArray(JSON) methods create a lazy array too: the objects are still converted on access.
+ *
+ * @see JSONRPCResponseHandler#lazyResultConversion
+ */
+@interface JSONRPCLazyArray : NSArray
+{
+	//! @privatesection
+	NSArray* _jsonObjects;
+	Class _itemsClass;
+	NSUInteger _count;
+	id* _items; // converted objects, nil until converted
+}
+//! Convert the objects in the range now, e.g. the rows about to be displayed, so that accessing them later does not convert them
+-(void)prefetchRange:(NSRange)range;
+-(BOOL)isConvertedAtIndex:(NSUInteger)index; //!< YES if the object at this index has already been converted
 @end
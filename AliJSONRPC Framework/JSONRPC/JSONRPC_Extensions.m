@@ -29,6 +29,13 @@
 
 #import "JSONRPC_Extensions.h"
 #import "JSONRPC.h"
+#include <stdatomic.h>
+#if NS_BLOCKS_AVAILABLE
+#include <dispatch/dispatch.h>
+#endif
+
+// Number of objects converted by each concurrent task: below this, the dispatching costs more than it saves
+static const NSUInteger kConcurrentConversionChunkSize = 256;
 
 /////////////////////////////////////////////////////////////////////////////
 // MARK: -
@@ -57,16 +64,146 @@
 }
 -(id)initWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass
 {
-	NSMutableArray* tab = [[NSMutableArray alloc] initWithCapacity:[arrayOfJsonObjects count]];
+	// convert into a C array rather than into a temporary NSMutableArray that would be copied
+	NSUInteger count = [arrayOfJsonObjects count];
+	id* items = malloc(MAX(count,1) * sizeof(id));
+	NSUInteger i = 0;
 	for(id jsonObj in arrayOfJsonObjects)
 	{
-		id obj = [[[itemsClass alloc] initWithJson:jsonObj] autorelease];
-		if (!obj) obj = [NSNull null];
-		[tab addObject:obj];
+		id obj = [[itemsClass alloc] initWithJson:jsonObj];
+		items[i++] = obj ?: [[NSNull null] retain];
 	}
-	self = [self initWithArray:tab];
-	[tab release];
+	self = [self initWithObjects:items count:count];
+	for(i=0; i<count; ++i) [items[i] release];
+	free(items);
 	
 	return self;
 }
+
++(id)arrayWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass concurrently:(BOOL)concurrently {
+	return [[[self alloc] initWithJson:arrayOfJsonObjects itemsClass:itemsClass concurrently:concurrently] autorelease];
+}
+-(id)initWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass concurrently:(BOOL)concurrently
+{
+#if NS_BLOCKS_AVAILABLE
+	NSUInteger count = [arrayOfJsonObjects count];
+	NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+	if (concurrently && cores > 1 && count >= 2*kConcurrentConversionChunkSize) {
+		// a few chunks per core, so that a slower chunk does not leave the other cores idle
+		NSUInteger chunkSize = MAX(kConcurrentConversionChunkSize, count/(4*cores) + 1);
+		size_t chunks = (count + chunkSize - 1) / chunkSize;
+		id* jsonItems = malloc(count * sizeof(id));
+		id* items = malloc(count * sizeof(id));
+		[arrayOfJsonObjects getObjects:jsonItems range:NSMakeRange(0,count)];
+		// each task writes its own range of the C array, so the order is preserved without locking
+		dispatch_apply(chunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t chunk) {
+			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+			NSUInteger end = MIN((chunk+1)*chunkSize, count);
+			for(NSUInteger i = chunk*chunkSize; i<end; ++i) {
+				id obj = [[itemsClass alloc] initWithJson:jsonItems[i]];
+				items[i] = obj ?: [[NSNull null] retain];
+			}
+			[pool drain];
+		});
+		self = [self initWithObjects:items count:count];
+		for(NSUInteger i=0; i<count; ++i) [items[i] release];
+		free(items);
+		free(jsonItems);
+		return self;
+	}
+#endif
+	return [self initWithJson:arrayOfJsonObjects itemsClass:itemsClass];
+}
+@end
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Lazy converting array
+/////////////////////////////////////////////////////////////////////////////
+
+@interface JSONRPCLazyArray()
+-(id)convertObjectAtIndex:(NSUInteger)index; //!< @private @internal
+@end
+
+// The cached object at an index, read and published atomically (the ivar is a plain id* so that the header stays C99/ObjC++)
+static inline _Atomic(id)* itemAt(id* items, NSUInteger index) {
+	return (_Atomic(id)*)&items[index];
+}
+
+@implementation JSONRPCLazyArray
+
+-(id)initWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass {
+	self = [super init];
+	if (self != nil) {
+		_jsonObjects = [arrayOfJsonObjects copy];
+		_itemsClass = itemsClass;
+		_count = [_jsonObjects count];
+		_items = calloc(MAX(_count,1), sizeof(id));
+	}
+	return self;
+}
+
+// Nothing to convert upfront: the inherited parallel conversion would build a plain NSArray, which this subclass can't be
+-(id)initWithJson:(NSArray *)arrayOfJsonObjects itemsClass:(Class)itemsClass concurrently:(BOOL)concurrently {
+	return [self initWithJson:arrayOfJsonObjects itemsClass:itemsClass];
+}
+
+-(NSUInteger)count {
+	return _count;
+}
+
+-(id)objectAtIndex:(NSUInteger)index {
+	if (index >= _count) {
+		[NSException raise:NSRangeException format:@"-[%@ objectAtIndex:]: index %lu beyond bounds [0 .. %ld]",
+		 NSStringFromClass([self class]),(unsigned long)index,(long)_count-1];
+	}
+	return atomic_load_explicit(itemAt(_items,index), memory_order_acquire) ?: [self convertObjectAtIndex:index];
+}
+
+-(id)convertObjectAtIndex:(NSUInteger)index {
+	id obj = [[_itemsClass alloc] initWithJson:[_jsonObjects objectAtIndex:index]];
+	if (!obj) obj = [[NSNull null] retain];
+	id converted = nil;
+	if (!atomic_compare_exchange_strong_explicit(itemAt(_items,index), &converted, obj, memory_order_acq_rel, memory_order_acquire)) {
+		// converted concurrently by another thread: keep its object
+		[obj release];
+		obj = converted;
+	}
+	return obj;
+}
+
+-(void)prefetchRange:(NSRange)range {
+	if (NSMaxRange(range) > _count) {
+		[NSException raise:NSRangeException format:@"-[%@ prefetchRange:]: range %@ beyond bounds [0 .. %ld]",
+		 NSStringFromClass([self class]),NSStringFromRange(range),(long)_count-1];
+	}
+	for(NSUInteger i=range.location; i<NSMaxRange(range); ++i) {
+		if (!atomic_load_explicit(itemAt(_items,i), memory_order_acquire)) [self convertObjectAtIndex:i];
+	}
+}
+
+-(BOOL)isConvertedAtIndex:(NSUInteger)index {
+	return (index < _count) && (atomic_load_explicit(itemAt(_items,index), memory_order_acquire) != nil);
+}
+
+// Enumerate the cached objects directly, converting them by batches of the size the caller asks for
+-(NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState *)state objects:(id *)buffer count:(NSUInteger)len {
+	NSUInteger start = state->state;
+	if (start >= _count) return 0;
+	NSUInteger n = MIN(MAX(len,1), _count-start);
+	[self prefetchRange:NSMakeRange(start, n)];
+	state->itemsPtr = _items + start;
+	state->mutationsPtr = &state->extra[0]; // immutable
+	state->state = start + n;
+	return n;
+}
+
+-(void)dealloc {
+	for(NSUInteger i=0; i<_count; ++i) [_items[i] release];
+	free(_items);
+	[_jsonObjects release];
+	[super dealloc];
+}
+
 @end
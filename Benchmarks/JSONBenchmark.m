@@ -0,0 +1,365 @@
+//
+//  JSONBenchmark.m
+//  AliJSONRPC Benchmarks
+//
+//  Micro-benchmark of SBJsonParser and SBJsonWriter over a fixed corpus of documents.
+//  For each document and operation, reports the throughput (MB/s of JSON text), the number of JSON values
+//  parsed or written per second, and the number of memory allocations per document.
+//
+//  Build with ./build.sh, then run:
+//    ./build/JSONBenchmark [--format text|json|csv] [--min-time seconds] [--corpus dir]
+//    ./build/JSONBenchmark --file path [--file-mode string|mapped|referenced] [--format text|json]
+//
+//  The json format writes one JSON object per line, with a stable set of keys, so that runs can be stored and compared.
+//  --corpus adds the *.json files of the given directory to the built-in corpus.
+//  --file parses a single (large) file once and reports the time and the peak resident memory of the process:
+//  read into an NSString and parsed with JSONValue (string), memory-mapped with -[SBJsonParser objectWithContentsOfFile:]
+//  (mapped), or memory-mapped with strings referencing the mapping (referenced). Run one mode per process.
+//
+
+#import <Foundation/Foundation.h>
+#import <malloc/malloc.h>
+#import <mach/mach.h>
+#include <sys/resource.h>
+#include <stdatomic.h>
+#import "JSON.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Allocation counting
+/////////////////////////////////////////////////////////////////////////////
+
+// Count the allocations by hooking the default malloc zone (Objective-C objects are allocated there too)
+static _Atomic(int64_t) gAllocationsCount = 0; // the hook runs on every thread that allocates
+static void* (*gOriginalMalloc)(malloc_zone_t*, size_t);
+static void* (*gOriginalCalloc)(malloc_zone_t*, size_t, size_t);
+static void* (*gOriginalRealloc)(malloc_zone_t*, void*, size_t);
+
+static void* countingMalloc(malloc_zone_t* zone, size_t size) {
+	atomic_fetch_add_explicit(&gAllocationsCount, 1, memory_order_relaxed);
+	return gOriginalMalloc(zone, size);
+}
+static void* countingCalloc(malloc_zone_t* zone, size_t count, size_t size) {
+	atomic_fetch_add_explicit(&gAllocationsCount, 1, memory_order_relaxed);
+	return gOriginalCalloc(zone, count, size);
+}
+static void* countingRealloc(malloc_zone_t* zone, void* ptr, size_t size) {
+	atomic_fetch_add_explicit(&gAllocationsCount, 1, memory_order_relaxed);
+	return gOriginalRealloc(zone, ptr, size);
+}
+
+static BOOL installAllocationCounter() {
+	malloc_zone_t* zone = malloc_default_zone();
+	// the zone structure is read-only on recent systems: make it writable just the time to patch it
+	vm_address_t region = (vm_address_t)zone;
+	vm_size_t regionSize = 0;
+	vm_region_basic_info_data_64_t info;
+	mach_msg_type_number_t infoCount = VM_REGION_BASIC_INFO_COUNT_64;
+	mach_port_t objectName = MACH_PORT_NULL;
+	if (vm_region_64(mach_task_self(), &region, &regionSize, VM_REGION_BASIC_INFO_64,
+					 (vm_region_info_t)&info, &infoCount, &objectName) != KERN_SUCCESS) {
+		return NO;
+	}
+	if (vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(malloc_zone_t), 0, VM_PROT_READ|VM_PROT_WRITE) != KERN_SUCCESS) {
+		return NO;
+	}
+	gOriginalMalloc = zone->malloc;
+	gOriginalCalloc = zone->calloc;
+	gOriginalRealloc = zone->realloc;
+	zone->malloc = countingMalloc;
+	zone->calloc = countingCalloc;
+	zone->realloc = countingRealloc;
+	vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(malloc_zone_t), 0, info.protection);
+	return YES;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Corpus
+/////////////////////////////////////////////////////////////////////////////
+
+// Deterministic pseudo-random generator, so that the corpus is the same for every run
+static uint32_t gSeed;
+static uint32_t nextRandom() {
+	gSeed = gSeed * 1103515245 + 12345;
+	return (gSeed >> 8);
+}
+
+static NSString* randomWord() {
+	static const char* const words[] = { "lorem","ipsum","dolor","sit","amet","consectetur","adipiscing","elit","sed","do",
+		"eiusmod","tempor","incididunt","ut","labore","et","dolore","magna","aliqua" };
+	return [NSString stringWithUTF8String:words[nextRandom() % (sizeof(words)/sizeof(*words))]];
+}
+
+static NSString* rpcEnvelope() {
+	gSeed = 1;
+	NSDictionary* result = [NSDictionary dictionaryWithObjectsAndKeys:
+							@"John Appleseed",@"name",
+							[NSNumber numberWithInt:42],@"age",
+							[NSNumber numberWithBool:YES],@"active",
+							[NSArray arrayWithObjects:@"admin",@"editor",nil],@"roles",
+							nil];
+	NSDictionary* envelope = [NSDictionary dictionaryWithObjectsAndKeys:
+							  @"2.0",@"jsonrpc",
+							  @"4D7F1A2B-5C3E-4F60-8A9B-0C1D2E3F4A5B",@"id",
+							  result,@"result",
+							  nil];
+	return [envelope JSONRepresentation];
+}
+
+static NSString* numericArray() {
+	gSeed = 2;
+	NSMutableArray* numbers = [NSMutableArray arrayWithCapacity:10000];
+	for(int i=0; i<5000; ++i) {
+		[numbers addObject:[NSNumber numberWithInt:(int)(nextRandom() % 2000000) - 1000000]];
+		[numbers addObject:[NSNumber numberWithDouble:(nextRandom() % 10000000) / 997.0]];
+	}
+	return [numbers JSONRepresentation];
+}
+
+static NSString* stringHeavy() {
+	gSeed = 3;
+	NSMutableArray* records = [NSMutableArray arrayWithCapacity:500];
+	for(int i=0; i<500; ++i) {
+		NSMutableArray* words = [NSMutableArray arrayWithCapacity:40];
+		int n = 5 + nextRandom() % 35;
+		for(int w=0; w<n; ++w) [words addObject:randomWord()];
+		[records addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+							randomWord(),@"title",
+							[words componentsJoinedByString:@" "],@"text",
+							[NSString stringWithFormat:@"line1\nline2\t\"quoted\" %u",nextRandom()],@"escaped",
+							nil]];
+	}
+	return [records JSONRepresentation];
+}
+
+static NSString* deeplyNested() {
+	gSeed = 4;
+	id obj = [NSNumber numberWithInt:0];
+	for(int depth=0; depth<200; ++depth) {
+		if (depth % 2) {
+			obj = [NSArray arrayWithObjects:obj,[NSNumber numberWithInt:depth],randomWord(),nil];
+		} else {
+			obj = [NSDictionary dictionaryWithObjectsAndKeys:obj,@"child",randomWord(),@"name",[NSNull null],@"extra",nil];
+		}
+	}
+	return [obj JSONRepresentation];
+}
+
+static NSString* unicodeEscapes() {
+	gSeed = 5;
+	// Escaped text, as produced by servers that escape every non-ASCII character
+	static const char* const chunks[] = { "\\u00e9t\\u00e9", "\\u4e2d\\u6587", "\\u0420\\u0443\\u0441", "caf\\u00e9",
+		"\\ud83d\\ude00", "\\u03b1\\u03b2\\u03b3", "\\u00fcber", "na\\u00efve" };
+	NSMutableString* json = [NSMutableString stringWithString:@"["];
+	for(int i=0; i<2000; ++i) {
+		if (i) [json appendString:@","];
+		[json appendString:@"\""];
+		int n = 1 + nextRandom() % 8;
+		for(int c=0; c<n; ++c) {
+			if (c) [json appendString:@" "];
+			[json appendFormat:@"%s",chunks[nextRandom() % (sizeof(chunks)/sizeof(*chunks))]];
+		}
+		[json appendString:@"\""];
+	}
+	[json appendString:@"]"];
+	return json;
+}
+
+// Number of JSON values in a document
+static NSUInteger countValues(id obj) {
+	NSUInteger n = 1;
+	if ([obj isKindOfClass:[NSDictionary class]]) {
+		for(id key in obj) n += 1 + countValues([obj objectForKey:key]);
+	} else if ([obj isKindOfClass:[NSArray class]]) {
+		for(id item in obj) n += countValues(item);
+	}
+	return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Benchmark
+/////////////////////////////////////////////////////////////////////////////
+
+typedef enum { FormatText, FormatJSON, FormatCSV } OutputFormat;
+
+typedef struct {
+	NSUInteger iterations;
+	double seconds;
+	int64_t allocations;
+} Measure;
+
+// Run the block until minTime is elapsed (at least 3 iterations), in batches to keep the timing overhead low
+static Measure measure(double minTime, void(^run)(void)) {
+	Measure m = { 0, 0, 0 };
+	NSUInteger batch = 1;
+	int64_t allocs0 = atomic_load_explicit(&gAllocationsCount, memory_order_relaxed);
+	double t0 = CFAbsoluteTimeGetCurrent();
+	while (m.seconds < minTime || m.iterations < 3) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		for(NSUInteger i=0; i<batch; ++i) run();
+		[pool drain];
+		m.iterations += batch;
+		m.seconds = CFAbsoluteTimeGetCurrent() - t0;
+		if (m.seconds < minTime/10) batch *= 2;
+	}
+	m.allocations = atomic_load_explicit(&gAllocationsCount, memory_order_relaxed) - allocs0;
+	return m;
+}
+
+// A CSV field (RFC 4180): quoted, with its quotes doubled, so that the commas and quotes of a file name don't shift the columns
+static NSString* csvField(NSString* s) {
+	return [NSString stringWithFormat:@"\"%@\"",[s stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""]];
+}
+
+static void report(OutputFormat format, BOOL countsAllocations, const char* operation, NSString* document,
+				   NSUInteger bytes, NSUInteger values, Measure m) {
+	double mbps = bytes * m.iterations / m.seconds / 1e6;
+	double valuesPerSec = values * m.iterations / m.seconds;
+	double allocsPerDoc = countsAllocations ? (double)m.allocations / m.iterations : -1;
+	switch (format) {
+		case FormatJSON: {
+			// document names come from the corpus file names: let the writer quote and escape them
+			// (as a fragment: stringWithObject: only writes arrays and objects)
+			SBJsonWriter* writer = [[SBJsonWriter alloc] init];
+			NSString* documentJSON = [writer stringWithFragment:document] ?: @"null";
+			[writer release];
+			printf("{\"operation\":\"%s\",\"document\":%s,\"bytes\":%lu,\"values\":%lu,\"iterations\":%lu,"
+				   "\"seconds\":%.6f,\"mb_per_s\":%.3f,\"values_per_s\":%.0f,\"allocations_per_doc\":%.1f}\n",
+				   operation, [documentJSON UTF8String], (unsigned long)bytes, (unsigned long)values, (unsigned long)m.iterations,
+				   m.seconds, mbps, valuesPerSec, allocsPerDoc);
+			break;
+		}
+		case FormatCSV:
+			printf("%s,%s,%lu,%lu,%lu,%.6f,%.3f,%.0f,%.1f\n", operation, [csvField(document) UTF8String], (unsigned long)bytes,
+				   (unsigned long)values, (unsigned long)m.iterations, m.seconds, mbps, valuesPerSec, allocsPerDoc);
+			break;
+		default:
+			printf("%-6s %-20s %9lu B %9.1f MB/s %12.0f values/s %10.1f allocs/doc\n", operation, [document UTF8String],
+				   (unsigned long)bytes, mbps, valuesPerSec, allocsPerDoc);
+			break;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Large files
+/////////////////////////////////////////////////////////////////////////////
+
+// Peak resident memory of the process (it never decreases)
+static unsigned long long peakResidentBytes() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (unsigned long long)usage.ru_maxrss; // in bytes on Mac OS X
+}
+
+static int parseFile(NSString* path, const char* mode, OutputFormat format) {
+	SBJsonParser* parser = [[SBJsonParser alloc] init];
+	unsigned long long bytes = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL] fileSize];
+	double t0 = CFAbsoluteTimeGetCurrent();
+	id obj = nil;
+	if (!strcmp(mode, "string")) {
+		obj = [[NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL] JSONValue];
+	} else {
+		parser.stringsReferenceFile = !strcmp(mode, "referenced");
+		obj = [parser objectWithContentsOfFile:path];
+	}
+	double seconds = CFAbsoluteTimeGetCurrent() - t0;
+	unsigned long long peak = peakResidentBytes(); // the parsed objects are still alive
+	if (!obj) {
+		fprintf(stderr, "error: cannot parse %s: %s\n", [path UTF8String], [[[parser errorTrace] description] UTF8String]);
+		[parser release];
+		return 1;
+	}
+	
+	NSUInteger values = countValues(obj);
+	double mbps = bytes / seconds / 1e6;
+	if (format == FormatJSON) {
+		printf("{\"operation\":\"parse_file\",\"mode\":\"%s\",\"bytes\":%llu,\"values\":%lu,\"seconds\":%.6f,"
+			   "\"mb_per_s\":%.3f,\"peak_resident_bytes\":%llu}\n",
+			   mode, bytes, (unsigned long)values, seconds, mbps, peak);
+	} else {
+		printf("parse_file %-10s %12llu B %9.1f MB/s %10.3f s %12lu values %8.1f MB peak resident (%.2fx the file)\n",
+			   mode, bytes, mbps, seconds, (unsigned long)values, peak/1e6, bytes ? (double)peak/bytes : 0);
+	}
+	[parser release];
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	
+	OutputFormat format = FormatText;
+	double minTime = 1.0;
+	NSString* corpusDir = nil;
+	NSString* file = nil;
+	const char* fileMode = "mapped";
+	for(int i=1; i<argc; ++i) {
+		if (!strcmp(argv[i], "--format") && i+1<argc) {
+			++i;
+			format = !strcmp(argv[i],"json") ? FormatJSON : (!strcmp(argv[i],"csv") ? FormatCSV : FormatText);
+		} else if (!strcmp(argv[i], "--min-time") && i+1<argc) {
+			minTime = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--corpus") && i+1<argc) {
+			corpusDir = [NSString stringWithUTF8String:argv[++i]];
+		} else if (!strcmp(argv[i], "--file") && i+1<argc) {
+			file = [NSString stringWithUTF8String:argv[++i]];
+		} else if (!strcmp(argv[i], "--file-mode") && i+1<argc) {
+			fileMode = argv[++i];
+		} else {
+			fprintf(stderr, "usage: %s [--format text|json|csv] [--min-time seconds] [--corpus dir]\n"
+					"       %s --file path [--file-mode string|mapped|referenced] [--format text|json]\n", argv[0], argv[0]);
+			return 1;
+		}
+	}
+	if (file) {
+		int status = parseFile(file, fileMode, format);
+		[pool release];
+		return status;
+	}
+	
+	// The corpus: name -> JSON text. Names are sorted so that the output order is stable.
+	NSMutableDictionary* corpus = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+								   rpcEnvelope(),@"rpc_envelope",
+								   numericArray(),@"numeric_array",
+								   stringHeavy(),@"string_heavy",
+								   deeplyNested(),@"deeply_nested",
+								   unicodeEscapes(),@"unicode_escapes",
+								   nil];
+	for(NSString* file in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:corpusDir error:NULL]) {
+		if (![[file pathExtension] isEqualToString:@"json"]) continue;
+		NSString* json = [NSString stringWithContentsOfFile:[corpusDir stringByAppendingPathComponent:file]
+												   encoding:NSUTF8StringEncoding error:NULL];
+		if (json) [corpus setObject:json forKey:[file stringByDeletingPathExtension]];
+	}
+	
+	BOOL countsAllocations = installAllocationCounter();
+	if (!countsAllocations) fprintf(stderr, "warning: cannot count the allocations on this system (reported as -1)\n");
+	if (format == FormatCSV) printf("operation,document,bytes,values,iterations,seconds,mb_per_s,values_per_s,allocations_per_doc\n");
+	
+	SBJsonParser* parser = [[SBJsonParser alloc] init];
+	SBJsonWriter* writer = [[SBJsonWriter alloc] init];
+	for(NSString* name in [[corpus allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		NSString* json = [corpus objectForKey:name];
+		id obj = [parser objectWithString:json];
+		if (!obj) {
+			fprintf(stderr, "error: cannot parse document %s: %s\n", [name UTF8String], [[[parser errorTrace] description] UTF8String]);
+			continue;
+		}
+		NSUInteger bytes = [json lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+		NSUInteger values = countValues(obj);
+		
+		Measure parse = measure(minTime, ^{ [parser objectWithString:json]; });
+		report(format, countsAllocations, "parse", name, bytes, values, parse);
+		
+		NSUInteger writtenBytes = [[writer stringWithObject:obj] lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+		Measure write = measure(minTime, ^{ [writer stringWithObject:obj]; });
+		report(format, countsAllocations, "write", name, writtenBytes, values, write);
+	}
+	[parser release];
+	[writer release];
+	
+	[pool release];
+	return 0;
+}
@@ -0,0 +1,525 @@
+//
+//  LoadGenerator.m
+//  AliJSONRPC Benchmarks
+//
+//  End-to-end load generator for the whole JSONRPCService pipeline: callMethod: -> JSONRPCCallScheduler ->
+//  NSURLConnection -> JSONRPCResponseHandler, against a bundled stub JSON-RPC server on the loopback interface.
+//  Reports the throughput, the p50/p90/p99/p999 latencies, the error and retry rates, the CPU and memory
+//  used by the client and the allocations of receive buffers (JSONRPCService#bufferPool).
+//
+//  Build with ./build.sh, then run:
+//    ./build/LoadGenerator [options]
+//      --concurrency n     calls in flight (closed loop: each response triggers the next call). Defaults to 16.
+//      --rate r            open loop: issue r calls per second, whatever the responses (concurrency caps the calls in flight).
+//                          Each call has an intended start time, and its latency is measured from it: when the client
+//                          falls behind, the late calls are issued at once and their delay counts (no coordinated omission).
+//      --duration s        measured duration in seconds. Defaults to 10.
+//      --warmup s          duration before the measure starts. Defaults to 1.
+//      --params n          number of elements in the params array of each call. Defaults to 10.
+//      --response file     canned result (a JSON file) returned by the stub server, instead of echoing the params
+//      --latency ms        delay added by the stub server before each response
+//      --fault-rate p      fraction (0..1) of the requests for which the stub server drops the connection
+//      --url url           target an external server instead of starting the stub server
+//      --loopback          answer the calls in-process (JSONRPCService#loopbackHandler) instead of using the network,
+//                          to measure the overhead of the framework alone. --latency does not apply.
+//      --server stub|jsonrpc  the server answering the calls: the minimal stub (the default), or a JSONRPCServer with an
+//                          "echo" method, to benchmark the framework's server side. --fault-rate only applies to the stub.
+//                          With --loopback, the JSONRPCServer is called in-process (JSONRPCServer#responseDataForRequestData:).
+//      --max-response-size bytes  sets JSONRPCService#maxResponseSize (the larger responses count as errors)
+//      --no-buffer-pool    allocate a new receive buffer for each response, to compare with the pooled buffers
+//      --format text|json  output format. json writes a single line, with a stable set of keys.
+//
+//  The stub server runs in a child process (./build/LoadGenerator --serve [--port p] [--server stub|jsonrpc] [--response file]
+//  [--latency ms] [--fault-rate p]) so that its CPU and memory are not accounted to the client. It can also be started alone.
+//
+
+#import <Foundation/Foundation.h>
+#import <sys/socket.h>
+#import <sys/resource.h>
+#import <netinet/in.h>
+#import <netinet/tcp.h>
+#import <arpa/inet.h>
+#import <mach/mach.h>
+#import <pthread.h>
+#import "JSON.h"
+#import "JSONRPC.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Stub server
+/////////////////////////////////////////////////////////////////////////////
+
+static id gCannedResult = nil;
+static useconds_t gServerLatency = 0;
+static double gFaultRate = 0;
+
+static BOOL writeAll(int fd, const void* bytes, size_t length) {
+	while (length > 0) {
+		ssize_t n = write(fd, bytes, length);
+		if (n <= 0) return NO;
+		bytes = (const char*)bytes + n;
+		length -= n;
+	}
+	return YES;
+}
+
+// Echo the params as the result, or return the canned result, with the id (and the version) of the request
+static NSData* stubResponseBody(SBJsonParser* parser, SBJsonWriter* writer, NSData* requestBody) {
+	NSString* json = [[[NSString alloc] initWithData:requestBody encoding:NSUTF8StringEncoding] autorelease];
+	NSDictionary* request = [parser objectWithString:json];
+	NSMutableDictionary* response = [NSMutableDictionary dictionaryWithCapacity:4];
+	[response setObject:([request objectForKey:@"id"] ?: [NSNull null]) forKey:@"id"];
+	[response setObject:(gCannedResult ?: [request objectForKey:@"params"] ?: [NSNull null]) forKey:@"result"];
+	if ([request objectForKey:@"jsonrpc"]) {
+		[response setObject:@"2.0" forKey:@"jsonrpc"];
+	} else {
+		[response setObject:[NSNull null] forKey:@"error"];
+	}
+	return [[writer stringWithObject:response] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// Serve the HTTP/1.1 requests of a keep-alive connection
+static void* stubServeConnection(void* arg) {
+	int fd = (int)(intptr_t)arg;
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	SBJsonParser* parser = [[SBJsonParser alloc] init];
+	SBJsonWriter* writer = [[SBJsonWriter alloc] init];
+	NSMutableData* input = [NSMutableData dataWithCapacity:65536];
+	char chunk[65536];
+	BOOL open = YES;
+	while (open) {
+		ssize_t n = read(fd, chunk, sizeof(chunk));
+		if (n <= 0) break;
+		[input appendBytes:chunk length:n];
+		
+		// process every complete request of the buffer
+		for(;;) {
+			const char* bytes = [input bytes];
+			const char* headersEnd = memmem(bytes, [input length], "\r\n\r\n", 4);
+			if (!headersEnd) break;
+			size_t headersLength = headersEnd + 4 - bytes;
+			NSString* headers = [[[NSString alloc] initWithBytes:bytes length:headersLength encoding:NSISOLatin1StringEncoding] autorelease];
+			NSUInteger contentLength = 0;
+			BOOL close = ([headers rangeOfString:@" HTTP/1.0\r\n"].location != NSNotFound); // no keep-alive by default in HTTP/1.0
+			for(NSString* line in [headers componentsSeparatedByString:@"\r\n"]) {
+				NSRange colon = [line rangeOfString:@":"];
+				if (colon.location == NSNotFound) continue;
+				NSString* name = [[line substringToIndex:colon.location] lowercaseString];
+				NSString* value = [[line substringFromIndex:colon.location+1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+				if ([name isEqualToString:@"content-length"]) contentLength = [value integerValue];
+				else if ([name isEqualToString:@"connection"]) close = ([value caseInsensitiveCompare:@"close"] == NSOrderedSame);
+			}
+			if ([input length] < headersLength + contentLength) break;
+			
+			NSAutoreleasePool* requestPool = [[NSAutoreleasePool alloc] init];
+			NSData* body = [NSData dataWithBytes:bytes+headersLength length:contentLength];
+			[input replaceBytesInRange:NSMakeRange(0, headersLength + contentLength) withBytes:NULL length:0];
+			if (gServerLatency) usleep(gServerLatency);
+			if (gFaultRate > 0 && arc4random() < gFaultRate * 4294967296.0) {
+				// simulate a network failure
+				open = NO;
+			} else {
+				NSData* responseBody = stubResponseBody(parser, writer, body);
+				NSString* responseHeaders = [NSString stringWithFormat:
+											 @"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %lu\r\n%@\r\n",
+											 (unsigned long)[responseBody length], close ? @"Connection: close\r\n" : @""];
+				NSData* headersData = [responseHeaders dataUsingEncoding:NSISOLatin1StringEncoding];
+				// answer first, then close the connection if the client asked for it
+				open = writeAll(fd, [headersData bytes], [headersData length])
+					&& writeAll(fd, [responseBody bytes], [responseBody length]) && !close;
+			}
+			[requestPool drain];
+			if (!open) break;
+		}
+	}
+	close(fd);
+	[parser release];
+	[writer release];
+	[pool drain];
+	return NULL;
+}
+
+// A JSONRPCServer with the same "echo" method as the stub server
+static JSONRPCServer* newEchoServer() {
+	JSONRPCServer* server = [[JSONRPCServer alloc] init];
+	[server registerMethod:@"echo" block:^id(id params, NSError** error) {
+		if (gServerLatency) usleep(gServerLatency);
+		return gCannedResult ?: params;
+	}];
+	return server;
+}
+
+// Serve with a JSONRPCServer on the loopback interface and print the port on stdout. Never returns, unless the socket cannot be opened.
+static int runJSONRPCServer(unsigned short port) {
+	JSONRPCServer* server = newEchoServer();
+	NSError* error = nil;
+	if (![server startOnPort:port error:&error]) {
+		fprintf(stderr, "JSONRPCServer: %s\n", [[error localizedDescription] UTF8String]);
+		return 1;
+	}
+	printf("%d\n", server.port);
+	fflush(stdout);
+	for(;;) pause();
+	return 0;
+}
+
+// Listen on the loopback interface and print the port on stdout. Never returns, unless the socket cannot be opened.
+static int runStubServer(unsigned short port) {
+	int listenFD = socket(AF_INET, SOCK_STREAM, 0);
+	int yes = 1;
+	setsockopt(listenFD, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addrLength = sizeof(addr);
+	if (listenFD < 0 || bind(listenFD, (struct sockaddr*)&addr, sizeof(addr)) || listen(listenFD, 1024)
+		|| getsockname(listenFD, (struct sockaddr*)&addr, &addrLength)) {
+		perror("stub server");
+		return 1;
+	}
+	printf("%d\n", ntohs(addr.sin_port));
+	fflush(stdout);
+	
+	for(;;) {
+		int fd = accept(listenFD, NULL, NULL);
+		if (fd < 0) continue;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, stubServeConnection, (void*)(intptr_t)fd) == 0) {
+			pthread_detach(thread);
+		} else {
+			close(fd);
+		}
+	}
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Client
+/////////////////////////////////////////////////////////////////////////////
+
+@interface LoadGenerator : NSObject <JSONRPCMetricsObserver> {
+	JSONRPCService* _service;
+	JSONRPCMetricsAggregator* _aggregator;
+	NSArray* _params;
+	double _rate;
+	BOOL _running;
+	CFAbsoluteTime _scheduleStartTime;
+	unsigned long long _scheduledCount;
+	NSMutableDictionary* _intendedTimes; // JSONRPCMethodCall (non retained) -> intended start time of the call
+	NSMutableData* _latencies; // NSTimeInterval of each completed call of the open loop, from its intended start time
+	NSUInteger _callsCount;
+	NSUInteger _completedCount;
+	NSUInteger _errorsCount;
+}
+@property(nonatomic, readonly) JSONRPCService* service;
+@property(nonatomic, readonly) JSONRPCMetricsAggregator* aggregator;
+@property(nonatomic, readonly) NSUInteger callsCount;
+@property(nonatomic, readonly) NSUInteger completedCount;
+@property(nonatomic, readonly) NSUInteger errorsCount;
+-(id)initWithURL:(NSURL*)url concurrency:(NSUInteger)concurrency rate:(double)rate paramsCount:(NSUInteger)paramsCount; //!< rate <= 0 for a closed loop
+-(void)start;
+-(void)issueCall;
+-(void)issueScheduledCalls;
+-(void)resetCounters;
+-(NSTimeInterval)latencyAtPercentile:(double)percentile; //!< from the intended start times in open loop, from the metrics in closed loop
+-(void)stop; //!< stop issuing calls, and break the retain cycle with the aggregator
+@end
+
+@implementation LoadGenerator
+@synthesize service = _service, aggregator = _aggregator;
+@synthesize callsCount = _callsCount, completedCount = _completedCount, errorsCount = _errorsCount;
+
+-(id)initWithURL:(NSURL*)url concurrency:(NSUInteger)concurrency rate:(double)rate paramsCount:(NSUInteger)paramsCount {
+	if ((self = [super init])) {
+		_service = [[JSONRPCService alloc] initWithURL:url version:JSONRPCVersion_2_0];
+		_service.scheduler.maxConcurrentCalls = concurrency;
+		_service.retryPolicy.initialDelay = 0.05;
+		_aggregator = [[JSONRPCMetricsAggregator alloc] init];
+		_aggregator.nextObserver = self;
+		_service.metricsObserver = _aggregator;
+		_rate = rate;
+		_intendedTimes = [[NSMutableDictionary alloc] init];
+		_latencies = [[NSMutableData alloc] init];
+		NSMutableArray* params = [NSMutableArray arrayWithCapacity:paramsCount];
+		for(NSUInteger i=0; i<paramsCount; ++i) {
+			[params addObject:(i%2 ? (id)[NSString stringWithFormat:@"param %lu",(unsigned long)i] : (id)[NSNumber numberWithUnsignedInteger:i])];
+		}
+		_params = [params copy];
+	}
+	return self;
+}
+
+-(void)start {
+	_running = YES;
+	if (_rate > 0) {
+		_scheduleStartTime = CFAbsoluteTimeGetCurrent();
+		_scheduledCount = 0;
+		[self issueScheduledCalls];
+	} else {
+		for(NSUInteger i=0; i<_service.scheduler.maxConcurrentCalls; ++i) [self issueCall];
+	}
+}
+
+-(void)issueCall {
+	++_callsCount;
+	[_service callMethodWithName:@"echo" parameters:_params];
+}
+
+// Open loop: issue every call whose intended start time has passed. A timer would silently skip the calls it is late for,
+// and hide the very delays the open loop is meant to measure.
+-(void)issueScheduledCalls {
+	if (!_running) return;
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	CFAbsoluteTime intended;
+	while ((intended = _scheduleStartTime + _scheduledCount / _rate) <= now) {
+		++_scheduledCount;
+		++_callsCount;
+		JSONRPCResponseHandler* handler = [_service callMethodWithName:@"echo" parameters:_params];
+		[_intendedTimes setObject:[NSNumber numberWithDouble:intended] forKey:[NSValue valueWithNonretainedObject:handler.methodCall]];
+	}
+	[self performSelector:@selector(issueScheduledCalls) withObject:nil afterDelay:intended - now];
+}
+
+-(void)methodCall:(JSONRPCMethodCall*)methodCall didFinishWithMetrics:(JSONRPCCallMetrics*)metrics {
+	++_completedCount;
+	if (metrics.error) ++_errorsCount;
+	if (_rate > 0) {
+		NSValue* key = [NSValue valueWithNonretainedObject:methodCall];
+		NSNumber* intended = [_intendedTimes objectForKey:key];
+		if (intended && !metrics.cancelled) {
+			NSTimeInterval latency = CFAbsoluteTimeGetCurrent() - [intended doubleValue];
+			[_latencies appendBytes:&latency length:sizeof(latency)];
+		}
+		[_intendedTimes removeObjectForKey:key];
+	} else if (_running) {
+		// defer the next call so that the response handler finishes first
+		[self performSelector:@selector(issueCall) withObject:nil afterDelay:0];
+	}
+}
+
+-(void)resetCounters {
+	_callsCount = _completedCount = _errorsCount = 0;
+	[_latencies setLength:0];
+	[_aggregator reset];
+	[_service.retryPolicy resetCounters];
+}
+
+-(void)stop {
+	_running = NO;
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(issueCall) object:nil];
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(issueScheduledCalls) object:nil];
+	_aggregator.nextObserver = nil;
+}
+
+static int compareTimeIntervals(const void* a, const void* b) {
+	NSTimeInterval x = *(const NSTimeInterval*)a, y = *(const NSTimeInterval*)b;
+	return (x<y) ? -1 : (x>y);
+}
+
+-(NSTimeInterval)latencyAtPercentile:(double)percentile {
+	if (_rate <= 0) {
+		JSONRPCLatencyHistogram* histogram = [[_aggregator snapshot] objectForKey:@"echo"];
+		return (percentile >= 1) ? histogram.maxLatency : [histogram latencyAtPercentile:percentile];
+	}
+	NSUInteger count = [_latencies length] / sizeof(NSTimeInterval);
+	if (!count) return 0;
+	NSMutableData* sorted = [[_latencies mutableCopy] autorelease];
+	qsort([sorted mutableBytes], count, sizeof(NSTimeInterval), compareTimeIntervals);
+	NSUInteger idx = MIN((NSUInteger)(percentile * count), count-1);
+	return ((const NSTimeInterval*)[sorted bytes])[idx];
+}
+
+-(void)dealloc {
+	[_aggregator release];
+	[_service release];
+	[_params release];
+	[_intendedTimes release];
+	[_latencies release];
+	[super dealloc];
+}
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Main
+/////////////////////////////////////////////////////////////////////////////
+
+static double cpuTime() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec/1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec/1e6;
+}
+
+static double residentMB() {
+	struct task_basic_info info;
+	mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return -1;
+	return info.resident_size / 1048576.0;
+}
+
+static void runFor(NSTimeInterval duration) {
+	NSDate* end = [NSDate dateWithTimeIntervalSinceNow:duration];
+	while ([end timeIntervalSinceNow] > 0) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:end];
+		[pool drain];
+	}
+}
+
+static void usage(const char* tool) {
+	fprintf(stderr, "usage: %s [--concurrency n] [--rate r] [--duration s] [--warmup s] [--params n] [--response file]\n"
+			"          [--latency ms] [--fault-rate p] [--url url | --loopback] [--server stub|jsonrpc] [--max-response-size bytes]\n"
+			"          [--no-buffer-pool] [--format text|json]\n"
+			"       %s --serve [--port p] [--server stub|jsonrpc] [--response file] [--latency ms] [--fault-rate p]\n", tool, tool);
+}
+
+int main(int argc, char *argv[]) {
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	
+	BOOL serve = NO, json = NO, loopback = NO, bufferPool = YES, frameworkServer = NO;
+	NSUInteger maxResponseSize = 0;
+	unsigned short port = 0;
+	NSUInteger concurrency = 16, paramsCount = 10;
+	double rate = 0, duration = 10, warmup = 1;
+	NSString* url = nil;
+	// the options forwarded to the stub server
+	NSMutableArray* serverArgs = [NSMutableArray arrayWithObject:@"--serve"];
+	for(int i=1; i<argc; ++i) {
+		const char* arg = argv[i];
+		BOOL hasValue = (i+1<argc);
+		if (!strcmp(arg, "--serve")) serve = YES;
+		else if (!strcmp(arg, "--loopback")) loopback = YES;
+		else if (!strcmp(arg, "--no-buffer-pool")) bufferPool = NO;
+		else if (!strcmp(arg, "--server") && hasValue) {
+			frameworkServer = !strcmp(argv[++i], "jsonrpc");
+			[serverArgs addObject:@"--server"];
+			[serverArgs addObject:[NSString stringWithUTF8String:argv[i]]];
+		}
+		else if (!strcmp(arg, "--max-response-size") && hasValue) maxResponseSize = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(arg, "--port") && hasValue) port = atoi(argv[++i]);
+		else if (!strcmp(arg, "--concurrency") && hasValue) concurrency = MAX(atoi(argv[++i]), 1);
+		else if (!strcmp(arg, "--rate") && hasValue) rate = atof(argv[++i]);
+		else if (!strcmp(arg, "--duration") && hasValue) duration = atof(argv[++i]);
+		else if (!strcmp(arg, "--warmup") && hasValue) warmup = atof(argv[++i]);
+		else if (!strcmp(arg, "--params") && hasValue) paramsCount = atoi(argv[++i]);
+		else if (!strcmp(arg, "--url") && hasValue) url = [NSString stringWithUTF8String:argv[++i]];
+		else if (!strcmp(arg, "--format") && hasValue) json = !strcmp(argv[++i], "json");
+		else if ((!strcmp(arg, "--response") || !strcmp(arg, "--latency") || !strcmp(arg, "--fault-rate")) && hasValue) {
+			NSString* value = [NSString stringWithUTF8String:argv[++i]];
+			if (!strcmp(arg, "--response")) {
+				gCannedResult = [[[[[SBJsonParser alloc] init] autorelease] objectWithString:
+								  [NSString stringWithContentsOfFile:value encoding:NSUTF8StringEncoding error:NULL]] retain];
+				if (!gCannedResult) { fprintf(stderr, "error: invalid JSON in %s\n", argv[i]); return 1; }
+			}
+			else if (!strcmp(arg, "--latency")) gServerLatency = (useconds_t)(atof(argv[i]) * 1000);
+			else gFaultRate = atof(argv[i]);
+			[serverArgs addObject:[NSString stringWithUTF8String:arg]];
+			[serverArgs addObject:value];
+		}
+		else { usage(argv[0]); return 1; }
+	}
+	if (serve) return frameworkServer ? runJSONRPCServer(port) : runStubServer(port);
+	
+	NSTask* server = nil;
+	if (loopback) {
+		url = @"http://loopback.invalid/";
+	} else if (!url) {
+		// start the stub server in a child process and read its port
+		NSPipe* pipe = [NSPipe pipe];
+		server = [[[NSTask alloc] init] autorelease];
+		server.launchPath = [[NSBundle mainBundle] executablePath];
+		server.arguments = serverArgs;
+		server.standardOutput = pipe;
+		[server launch];
+		NSMutableData* portLine = [NSMutableData data];
+		while (![portLine length] || ((const char*)[portLine bytes])[[portLine length]-1] != '\n') {
+			NSData* data = [[pipe fileHandleForReading] availableData];
+			if (![data length]) {
+				fprintf(stderr, "error: the stub server did not start\n");
+				[server terminate];
+				return 1;
+			}
+			[portLine appendData:data];
+		}
+		int serverPort = atoi([[[[NSString alloc] initWithData:portLine encoding:NSUTF8StringEncoding] autorelease] UTF8String]);
+		url = [NSString stringWithFormat:@"http://127.0.0.1:%d/", serverPort];
+	}
+	
+	LoadGenerator* generator = [[LoadGenerator alloc] initWithURL:[NSURL URLWithString:url] concurrency:concurrency
+															 rate:rate paramsCount:paramsCount];
+	if (loopback && frameworkServer) {
+		JSONRPCServer* echoServer = [newEchoServer() autorelease];
+		generator.service.loopbackHandler = ^NSData*(NSURLRequest* request, NSString** MIMEType) {
+			return [echoServer responseDataForRequestData:[request HTTPBody]];
+		};
+	} else if (loopback) {
+		SBJsonParser* parser = [[[SBJsonParser alloc] init] autorelease];
+		SBJsonWriter* writer = [[[SBJsonWriter alloc] init] autorelease];
+		generator.service.loopbackHandler = ^NSData*(NSURLRequest* request, NSString** MIMEType) {
+			if (gFaultRate > 0 && arc4random() < gFaultRate * 4294967296.0) return nil;
+			return stubResponseBody(parser, writer, [request HTTPBody]);
+		};
+	}
+	generator.service.maxResponseSize = maxResponseSize;
+	if (!bufferPool) generator.service.bufferPool.maxBuffersPerSizeClass = 0;
+	// open loop: the calls are issued at their intended start times, and queued by the scheduler when concurrency is reached
+	[generator start];
+	
+	runFor(warmup);
+	[generator resetCounters];
+	[generator.service.bufferPool resetCounters];
+	double cpu0 = cpuTime();
+	CFAbsoluteTime t0 = CFAbsoluteTimeGetCurrent();
+	runFor(duration);
+	double elapsed = CFAbsoluteTimeGetCurrent() - t0;
+	double cpu = cpuTime() - cpu0;
+	
+	[generator stop];
+	NSUInteger completed = generator.completedCount;
+	NSUInteger retries = generator.service.retryPolicy.retriesCount;
+	double throughput = completed / elapsed;
+	double errorRate = completed ? (double)generator.errorsCount / completed : 0;
+	double retryRate = completed ? (double)retries / completed : 0;
+	double p50 = [generator latencyAtPercentile:0.5]*1000, p90 = [generator latencyAtPercentile:0.9]*1000;
+	double p99 = [generator latencyAtPercentile:0.99]*1000, p999 = [generator latencyAtPercentile:0.999]*1000;
+	double maxLatency = [generator latencyAtPercentile:1]*1000;
+	double cpuPercent = cpu / elapsed * 100;
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	double maxResidentMB = usage.ru_maxrss / 1048576.0; // bytes on Mac OS X
+	JSONRPCBufferPool* buffers = generator.service.bufferPool;
+	double buffersPerCall = completed ? (double)buffers.allocationsCount / completed : 0;
+	
+	if (json) {
+		printf("{\"mode\":\"%s\",\"concurrency\":%lu,\"rate\":%.1f,\"duration\":%.3f,\"calls\":%lu,\"completed\":%lu,"
+			   "\"throughput\":%.1f,\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"p999_ms\":%.3f,\"max_ms\":%.3f,"
+			   "\"error_rate\":%.5f,\"retry_rate\":%.5f,\"retries_denied\":%lu,\"cpu_percent\":%.1f,\"cpu_us_per_call\":%.1f,"
+			   "\"resident_mb\":%.1f,\"max_resident_mb\":%.1f,\"buffer_allocations\":%lu,\"buffer_reuses\":%lu,"
+			   "\"buffer_allocations_per_call\":%.4f,\"buffer_peak_bytes\":%llu}\n",
+			   rate > 0 ? "open" : "closed", (unsigned long)concurrency, rate, elapsed, (unsigned long)generator.callsCount,
+			   (unsigned long)completed, throughput, p50, p90, p99, p999, maxLatency, errorRate, retryRate,
+			   (unsigned long)generator.service.retryPolicy.retriesDeniedCount, cpuPercent,
+			   completed ? cpu / completed * 1e6 : 0, residentMB(), maxResidentMB, (unsigned long)buffers.allocationsCount,
+			   (unsigned long)buffers.reusesCount, buffersPerCall, buffers.peakOutstandingBytes);
+	} else {
+		printf("%s loop, concurrency %lu%s, %.1fs against %s\n", rate > 0 ? "Open" : "Closed", (unsigned long)concurrency,
+			   rate > 0 ? [[NSString stringWithFormat:@", %.0f calls/s", rate] UTF8String] : "", elapsed, [url UTF8String]);
+		printf("  throughput  %10.1f calls/s (%lu completed)\n", throughput, (unsigned long)completed);
+		printf("  latency     p50 %.3fms  p90 %.3fms  p99 %.3fms  p999 %.3fms  max %.3fms\n", p50, p90, p99, p999, maxLatency);
+		printf("  errors      %.3f%%   retries %.3f%% (%lu denied by the budget)\n", errorRate*100, retryRate*100,
+			   (unsigned long)generator.service.retryPolicy.retriesDeniedCount);
+		printf("  client CPU  %.1f%% (%.1fus per call)   memory %.1fMB resident, %.1fMB max\n", cpuPercent,
+			   completed ? cpu / completed * 1e6 : 0, residentMB(), maxResidentMB);
+		printf("  buffers     %lu allocated (%.4f per call), %lu reused, peak %.1fKB in use\n", (unsigned long)buffers.allocationsCount,
+			   buffersPerCall, (unsigned long)buffers.reusesCount, buffers.peakOutstandingBytes / 1024.0);
+	}
+	
+	[generator release];
+	[server terminate];
+	[pool release];
+	return 0;
+}
@@ -0,0 +1,133 @@
+//
+//  MessagePackBenchmark.m
+//  AliJSONRPC Benchmarks
+//
+//  Compares the MessagePack encoding (JSONRPCMessagePack) with the JSON text encoding (SBJsonWriter/SBJsonParser)
+//  on the same payloads: encoded size, encoding and decoding throughput.
+//
+//  Build with ./build.sh, then run ./build/MessagePackBenchmark [iterations]
+//
+
+#import <Foundation/Foundation.h>
+#import "JSON.h"
+#import "JSONRPCMessagePack.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Payloads
+/////////////////////////////////////////////////////////////////////////////
+
+// Deterministic pseudo-random generator, so that every run uses the same payloads
+static uint32_t gSeed = 42;
+static uint32_t nextRandom() {
+	gSeed = gSeed * 1103515245 + 12345;
+	return (gSeed >> 8);
+}
+
+// JSON-RPC response with a result made of numbers only (e.g. time series)
+static id numericPayload() {
+	NSMutableArray* points = [NSMutableArray arrayWithCapacity:2000];
+	for(int i=0; i<2000; ++i) {
+		[points addObject:[NSArray arrayWithObjects:
+						   [NSNumber numberWithInt:1275000000+i*60],
+						   [NSNumber numberWithDouble:(nextRandom()%100000)/1000.0],
+						   [NSNumber numberWithInt:nextRandom()%5000],
+						   nil]];
+	}
+	return [NSDictionary dictionaryWithObjectsAndKeys:@"1",@"id",points,@"result",[NSNull null],@"error",nil];
+}
+
+// JSON-RPC response with a result made of records mixing strings, numbers and booleans
+static id recordsPayload() {
+	NSMutableArray* records = [NSMutableArray arrayWithCapacity:500];
+	for(int i=0; i<500; ++i) {
+		[records addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+							[NSString stringWithFormat:@"Person %u",nextRandom()%10000],@"name",
+							[NSString stringWithFormat:@"%u Main Street, Springfield",nextRandom()%1000],@"address",
+							[NSNumber numberWithInt:nextRandom()%100],@"age",
+							[NSNumber numberWithBool:nextRandom()%2],@"active",
+							nil]];
+	}
+	return [NSDictionary dictionaryWithObjectsAndKeys:@"2",@"id",records,@"result",[NSNull null],@"error",nil];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Benchmark
+/////////////////////////////////////////////////////////////////////////////
+
+static double now() {
+	return CFAbsoluteTimeGetCurrent();
+}
+
+static void runBenchmark(NSString* name, id payload, int iterations) {
+	SBJsonWriter* writer = [[SBJsonWriter alloc] init];
+	SBJsonParser* parser = [[SBJsonParser alloc] init];
+	NSString* json = [writer stringWithObject:payload];
+	NSUInteger jsonSize = [json lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+	NSData* mp = [JSONRPCMessagePack dataWithObject:payload error:NULL];
+	NSUInteger mpSize = [mp length];
+	
+	double t0, jsonEnc, jsonDec, mpEnc, mpDec;
+	
+	t0 = now();
+	for(int i=0; i<iterations; ++i) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		[[writer stringWithObject:payload] dataUsingEncoding:NSUTF8StringEncoding];
+		[pool drain];
+	}
+	jsonEnc = now()-t0;
+	
+	NSData* jsonData = [json dataUsingEncoding:NSUTF8StringEncoding];
+	t0 = now();
+	for(int i=0; i<iterations; ++i) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		// same path as JSONRPCResponseHandler: bytes -> NSString -> objects
+		NSString* str = [[NSString alloc] initWithData:jsonData encoding:NSUTF8StringEncoding];
+		[parser objectWithString:str];
+		[str release];
+		[pool drain];
+	}
+	jsonDec = now()-t0;
+	
+	t0 = now();
+	for(int i=0; i<iterations; ++i) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		[JSONRPCMessagePack dataWithObject:payload error:NULL];
+		[pool drain];
+	}
+	mpEnc = now()-t0;
+	
+	t0 = now();
+	for(int i=0; i<iterations; ++i) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		[JSONRPCMessagePack objectWithData:mp error:NULL];
+		[pool drain];
+	}
+	mpDec = now()-t0;
+	
+	BOOL roundTrip = [[JSONRPCMessagePack objectWithData:mp error:NULL] isEqual:payload];
+	
+	printf("%s (%d iterations)%s\n", [name UTF8String], iterations, roundTrip ? "" : "  [WARNING: decoded objects differ]");
+	printf("  %-12s %10s %14s %14s\n", "", "size", "encode MB/s", "decode MB/s");
+	printf("  %-12s %10u %14.1f %14.1f\n", "JSON", (unsigned)jsonSize,
+		   jsonSize*iterations/jsonEnc/1e6, jsonSize*iterations/jsonDec/1e6);
+	printf("  %-12s %10u %14.1f %14.1f\n", "MessagePack", (unsigned)mpSize,
+		   mpSize*iterations/mpEnc/1e6, mpSize*iterations/mpDec/1e6);
+	printf("  MessagePack is %.1fx smaller, encodes %.1fx faster, decodes %.1fx faster (per document)\n\n",
+		   (double)jsonSize/mpSize, jsonEnc/mpEnc, jsonDec/mpDec);
+	
+	[writer release];
+	[parser release];
+}
+
+int main(int argc, char *argv[]) {
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	int iterations = (argc > 1) ? atoi(argv[1]) : 50;
+	
+	runBenchmark(@"Numeric result", numericPayload(), iterations);
+	runBenchmark(@"Records result", recordsPayload(), iterations);
+	
+	[pool release];
+	return 0;
+}
@@ -0,0 +1,271 @@
+//
+//  ReplayBenchmark.m
+//  AliJSONRPC Benchmarks
+//
+//  Replays a capture of real traffic, recorded with JSONRPCService#trafficRecorder (see JSONRPCTrafficRecorder), offline:
+//   - parse mode (the default): pushes every captured response through the decoder (SBJSON or JSONRPCMessagePack) and,
+//     with --result-class, through the resultClass conversion, as fast as possible. Reports MB/s, responses/s and the
+//     p50/p90/p99 time per response, per method.
+//   - service mode: calls the captured methods on a JSONRPCService whose loopback handler answers with the captured responses,
+//     at the original pace (--speed 1), accelerated (--speed 10) or as fast as possible (--speed 0). Reports the latency
+//     percentiles of the whole pipeline, per method.
+//
+//  Build with ./build.sh, then run:
+//    ./build/ReplayBenchmark capture-file [--mode parse|service] [--iterations n] [--speed x] [--result-class name] [--format text|json]
+//
+//  --result-class names a class conforming to JSONInitializer: add its source file to the ReplayBenchmark command in build.sh.
+//  The json format writes one JSON object per method, with a stable set of keys, so that runs can be compared over time.
+//
+
+#import <Foundation/Foundation.h>
+#import "JSON.h"
+#import "JSONRPC.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Report
+/////////////////////////////////////////////////////////////////////////////
+
+static double percentile(NSArray* sortedDurations, double p) {
+	if (![sortedDurations count]) return 0;
+	NSUInteger index = MIN((NSUInteger)(p * [sortedDurations count]), [sortedDurations count]-1);
+	return [[sortedDurations objectAtIndex:index] doubleValue];
+}
+
+static void report(BOOL json, const char* mode, NSString* methodName, NSUInteger count, NSUInteger errors, NSUInteger bytes,
+				   double seconds, double p50, double p90, double p99) {
+	double mbps = seconds > 0 ? bytes / seconds / 1e6 : 0;
+	double perSecond = seconds > 0 ? count / seconds : 0;
+	if (json) {
+		printf("{\"mode\":\"%s\",\"method\":\"%s\",\"count\":%lu,\"errors\":%lu,\"bytes\":%lu,\"seconds\":%.6f,"
+			   "\"mb_per_s\":%.3f,\"per_s\":%.1f,\"p50_ms\":%.4f,\"p90_ms\":%.4f,\"p99_ms\":%.4f}\n",
+			   mode, [methodName UTF8String], (unsigned long)count, (unsigned long)errors, (unsigned long)bytes, seconds,
+			   mbps, perSecond, p50*1000, p90*1000, p99*1000);
+	} else {
+		printf("%-24s %8lu calls %6lu errors %9.1f MB/s %10.1f/s   p50 %.3fms  p90 %.3fms  p99 %.3fms\n", [methodName UTF8String],
+			   (unsigned long)count, (unsigned long)errors, mbps, perSecond, p50*1000, p90*1000, p99*1000);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Parse mode
+/////////////////////////////////////////////////////////////////////////////
+
+// Decode the response and convert its result, as JSONRPCResponseHandler does
+static BOOL decodeResponse(JSONRPCTrafficRecord* record, Class resultClass) {
+	NSError* error = nil;
+	id response = [record decodedResponse:&error];
+	if (!response) return NO;
+	id result = [response isKindOfClass:[NSDictionary class]] ? [response objectForKey:@"result"] : nil;
+	if (resultClass && result && result != [NSNull null]) {
+		if ([result isKindOfClass:[NSArray class]]) {
+			result = [NSArray arrayWithJson:result itemsClass:resultClass];
+		} else {
+			result = [[[resultClass alloc] initWithJson:result] autorelease];
+		}
+	}
+	return YES;
+}
+
+static void replayParse(NSArray* records, NSUInteger iterations, Class resultClass, BOOL json) {
+	NSMutableDictionary* durations = [NSMutableDictionary dictionary]; // method name -> NSMutableArray of NSNumber
+	NSMutableDictionary* bytes = [NSMutableDictionary dictionary];
+	NSMutableDictionary* errors = [NSMutableDictionary dictionary];
+	for(NSUInteger i=0; i<iterations; ++i) {
+		for(JSONRPCTrafficRecord* record in records) {
+			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+			CFAbsoluteTime t0 = CFAbsoluteTimeGetCurrent();
+			BOOL ok = decodeResponse(record, resultClass);
+			CFAbsoluteTime t1 = CFAbsoluteTimeGetCurrent();
+			[pool drain];
+			
+			NSString* name = record.methodName;
+			NSMutableArray* list = [durations objectForKey:name];
+			if (!list) {
+				list = [NSMutableArray array];
+				[durations setObject:list forKey:name];
+			}
+			[list addObject:[NSNumber numberWithDouble:t1-t0]];
+			[bytes setObject:[NSNumber numberWithUnsignedInteger:[[bytes objectForKey:name] unsignedIntegerValue]+[record.responseBody length]] forKey:name];
+			if (!ok) [errors setObject:[NSNumber numberWithUnsignedInteger:[[errors objectForKey:name] unsignedIntegerValue]+1] forKey:name];
+		}
+	}
+	for(NSString* name in [[durations allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		NSArray* sorted = [[durations objectForKey:name] sortedArrayUsingSelector:@selector(compare:)];
+		double total = 0;
+		for(NSNumber* d in sorted) total += [d doubleValue];
+		report(json, "parse", name, [sorted count], [[errors objectForKey:name] unsignedIntegerValue],
+			   [[bytes objectForKey:name] unsignedIntegerValue], total,
+			   percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99));
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Service mode
+/////////////////////////////////////////////////////////////////////////////
+
+@interface Replayer : NSObject <JSONRPCMetricsObserver> {
+	NSArray* _records;
+	JSONRPCService* _service;
+	JSONRPCMetricsAggregator* _aggregator;
+	NSMutableArray* _pendingResponses; // the records whose response the loopback handler answers next
+	Class _resultClass;
+	NSUInteger _completedCount;
+	NSMutableDictionary* _bytes;
+}
+@property(nonatomic, readonly) JSONRPCMetricsAggregator* aggregator;
+@property(nonatomic, readonly) NSUInteger completedCount;
+@property(nonatomic, readonly) NSDictionary* bytes; //!< method name -> response bytes
+-(id)initWithRecords:(NSArray*)records resultClass:(Class)resultClass;
+-(void)startWithSpeed:(double)speed;
+-(void)stop;
+@end
+
+@implementation Replayer
+@synthesize aggregator = _aggregator, completedCount = _completedCount, bytes = _bytes;
+
+-(id)initWithRecords:(NSArray*)records resultClass:(Class)resultClass {
+	if ((self = [super init])) {
+		_records = [records retain];
+		_resultClass = resultClass;
+		_bytes = [[NSMutableDictionary alloc] init];
+		_pendingResponses = [[NSMutableArray alloc] init];
+		_service = [[JSONRPCService alloc] initWithURL:[NSURL URLWithString:@"http://replay.invalid/"] version:JSONRPCVersion_2_0];
+		_service.scheduler.maxConcurrentCalls = 0; // the calls reach the loopback handler in the order they are made
+		_aggregator = [[JSONRPCMetricsAggregator alloc] init];
+		_aggregator.nextObserver = self;
+		_service.metricsObserver = _aggregator;
+		NSMutableArray* pending = _pendingResponses;
+		_service.loopbackHandler = ^NSData*(NSURLRequest* request, NSString** MIMEType) {
+			JSONRPCTrafficRecord* record = [[[pending objectAtIndex:0] retain] autorelease];
+			[pending removeObjectAtIndex:0];
+			// decoded as it was captured, whatever the format of the request
+			*MIMEType = record.binaryResponse ? JSONRPCMessagePackMIMEType : @"application/json";
+			return record.responseBody;
+		};
+	}
+	return self;
+}
+
+-(void)callRecord:(JSONRPCTrafficRecord*)record {
+	id request = [record decodedRequest:NULL];
+	id params = [request objectForKey:@"params"];
+	JSONRPCMethodCall* call = [params isKindOfClass:[NSDictionary class]]
+		? [JSONRPCMethodCall methodCallWithMethodName:record.methodName namedParameters:params]
+		: [JSONRPCMethodCall methodCallWithMethodName:record.methodName parameters:params];
+	[_pendingResponses addObject:record];
+	// each request is sent in its captured format: the content type is read when the call is serialized
+	_service.contentType = record.binaryRequest ? JSONRPCContentTypeMessagePack : JSONRPCContentTypeJSON;
+	[_service callMethod:call].resultClass = _resultClass;
+	[_bytes setObject:[NSNumber numberWithUnsignedInteger:[[_bytes objectForKey:record.methodName] unsignedIntegerValue]+[record.responseBody length]]
+			   forKey:record.methodName];
+}
+
+-(void)startWithSpeed:(double)speed {
+	CFAbsoluteTime firstCallTime = [(JSONRPCTrafficRecord*)[_records objectAtIndex:0] callTime];
+	for(JSONRPCTrafficRecord* record in _records) {
+		if (speed > 0) {
+			[self performSelector:@selector(callRecord:) withObject:record afterDelay:(record.callTime-firstCallTime)/speed];
+		} else {
+			[self callRecord:record];
+		}
+	}
+}
+
+-(void)methodCall:(JSONRPCMethodCall*)methodCall didFinishWithMetrics:(JSONRPCCallMetrics*)metrics {
+	++_completedCount;
+}
+
+-(void)stop {
+	[NSObject cancelPreviousPerformRequestsWithTarget:self];
+	_aggregator.nextObserver = nil; // break the retain cycle
+}
+
+-(void)dealloc {
+	[_records release];
+	[_service release];
+	[_aggregator release];
+	[_pendingResponses release];
+	[_bytes release];
+	[super dealloc];
+}
+@end
+
+static void replayService(NSArray* records, NSUInteger iterations, double speed, Class resultClass, BOOL json) {
+	NSMutableArray* allRecords = [NSMutableArray arrayWithCapacity:[records count]*iterations];
+	for(NSUInteger i=0; i<iterations; ++i) [allRecords addObjectsFromArray:records];
+	
+	Replayer* replayer = [[Replayer alloc] initWithRecords:allRecords resultClass:resultClass];
+	CFAbsoluteTime t0 = CFAbsoluteTimeGetCurrent();
+	[replayer startWithSpeed:speed];
+	while (replayer.completedCount < [allRecords count]) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+		[pool drain];
+	}
+	double seconds = CFAbsoluteTimeGetCurrent() - t0;
+	[replayer stop];
+	
+	NSDictionary* snapshot = [replayer.aggregator snapshot];
+	for(NSString* name in [[snapshot allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		JSONRPCLatencyHistogram* h = [snapshot objectForKey:name];
+		report(json, "service", name, h.count, h.errorsCount, [[replayer.bytes objectForKey:name] unsignedIntegerValue], seconds,
+			   [h latencyAtPercentile:0.5], [h latencyAtPercentile:0.9], [h latencyAtPercentile:0.99]);
+	}
+	[replayer release];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Main
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[]) {
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	
+	NSString* path = nil;
+	BOOL serviceMode = NO, json = NO;
+	NSUInteger iterations = 1;
+	double speed = 0;
+	Class resultClass = Nil;
+	for(int i=1; i<argc; ++i) {
+		const char* arg = argv[i];
+		BOOL hasValue = (i+1<argc);
+		if (!strcmp(arg, "--mode") && hasValue) serviceMode = !strcmp(argv[++i], "service");
+		else if (!strcmp(arg, "--iterations") && hasValue) iterations = MAX(atoi(argv[++i]), 1);
+		else if (!strcmp(arg, "--speed") && hasValue) speed = atof(argv[++i]);
+		else if (!strcmp(arg, "--format") && hasValue) json = !strcmp(argv[++i], "json");
+		else if (!strcmp(arg, "--result-class") && hasValue) {
+			resultClass = NSClassFromString([NSString stringWithUTF8String:argv[++i]]);
+			if (!resultClass) { fprintf(stderr, "error: unknown class %s\n", argv[i]); return 1; }
+		}
+		else if (arg[0] != '-' && !path) path = [NSString stringWithUTF8String:arg];
+		else { path = nil; break; }
+	}
+	if (!path) {
+		fprintf(stderr, "usage: %s capture-file [--mode parse|service] [--iterations n] [--speed x] [--result-class name] [--format text|json]\n", argv[0]);
+		return 1;
+	}
+	
+	NSError* error = nil;
+	NSArray* records = [JSONRPCTrafficRecorder recordsWithContentsOfFile:path error:&error];
+	if (!records) {
+		fprintf(stderr, "error: cannot read %s: %s\n", [path UTF8String], [[error localizedDescription] UTF8String]);
+		return 1;
+	}
+	if (![records count]) {
+		fprintf(stderr, "error: %s contains no records\n", [path UTF8String]);
+		return 1;
+	}
+	
+	if (serviceMode) {
+		replayService(records, iterations, speed, resultClass, json);
+	} else {
+		replayParse(records, iterations, resultClass, json);
+	}
+	
+	[pool release];
+	return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Build the benchmark tools of AliJSONRPC (Mac OS X command line tools, MRC) into ./build
+set -e
+cd "$(dirname "$0")"
+FW="../AliJSONRPC Framework"
+CFLAGS="-O2 -fno-objc-arc -I$FW/JSON -I$FW/JSONRPC"
+mkdir -p build
+
+clang $CFLAGS -framework Foundation -o build/MessagePackBenchmark \
+	MessagePackBenchmark.m "$FW"/JSON/*.m "$FW/JSONRPC/JSONRPCMessagePack.m"
+
+clang $CFLAGS -framework Foundation -o build/JSONBenchmark \
+	JSONBenchmark.m "$FW"/JSON/*.m
+
+clang $CFLAGS -framework Foundation -lz -o build/LoadGenerator \
+	LoadGenerator.m "$FW"/JSON/*.m "$FW"/JSONRPC/*.m
+
+clang $CFLAGS -framework Foundation -lz -o build/ReplayBenchmark \
+	ReplayBenchmark.m "$FW"/JSON/*.m "$FW"/JSONRPC/*.m
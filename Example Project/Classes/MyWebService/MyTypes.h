@@ -8,29 +8,21 @@
 
 #import <Foundation/Foundation.h>
 #import <CoreLocation/CoreLocation.h>
+#import "JSONRPCMappedObject.h"
 
 typedef NSInteger FourSquareID;
 
 
 
-/////////////////////////////////////////////////////////////////////////////
-// MARK: Parent class to wrap JSON-based objects
-/////////////////////////////////////////////////////////////////////////////
-
-@interface ValueObject : NSObject {
-	NSDictionary* _jsonData;
-}
--(id)initWithJson:(NSDictionary*)dict;
--(id)proxyForJson;
-@end
-
-
 /////////////////////////////////////////////////////////////////////////////
 // MARK: -
 // MARK: Person
 /////////////////////////////////////////////////////////////////////////////
 
-@interface Person : ValueObject
+@interface Person : JSONRPCMappedObject {
+	NSString* _firstName;
+	NSString* _lastName;
+}
 @property(nonatomic, readonly) NSString* firstName;
 @property(nonatomic, readonly) NSString* lastName;
 @end
@@ -41,7 +33,10 @@ typedef NSInteger FourSquareID;
 // MARK: Couple
 /////////////////////////////////////////////////////////////////////////////
 
-@interface Couple : ValueObject
+@interface Couple : JSONRPCMappedObject {
+	Person* _husband;
+	Person* _wife;
+}
 @property(nonatomic, readonly) Person* husband;
 @property(nonatomic, readonly) Person* wife;
 @end
@@ -52,17 +47,26 @@ typedef NSInteger FourSquareID;
 // MARK: ServiceDef
 /////////////////////////////////////////////////////////////////////////////
 
-@interface ServiceDef : ValueObject
+@interface ServiceDef : JSONRPCMappedObject {
+	NSString* _objectName;
+	NSURL* _serviceURL;
+	NSArray* _methods;
+}
 @property(nonatomic, readonly) NSString* objectName;
 @property(nonatomic, readonly) NSURL* serviceURL;
 @property(nonatomic, readonly) NSArray* methods;
 @end
 
-@interface MethodDef : ValueObject
+@interface MethodDef : JSONRPCMappedObject {
+	NSString* _name;
+	NSArray* _parameters;
+}
 @property(nonatomic, readonly) NSString* name;
 @property(nonatomic, readonly) NSArray* parameters;
 @end
 
-@interface ParamDef : ValueObject
+@interface ParamDef : JSONRPCMappedObject {
+	NSString* _name;
+}
 @property(nonatomic, readonly) NSString* name;
 @end
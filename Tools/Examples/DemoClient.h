@@ -0,0 +1,56 @@
+//
+//  DemoClient.h
+//
+//  Generated by SMDGen from Jayrock.smd. Do not edit: edit the annotations and generate it again.
+//
+
+#import <Foundation/Foundation.h>
+#import "JSONRPC.h"
+#import "DemoTypes.h"
+
+//! Typed client of the Demo JSON-RPC WebService
+@interface DemoClient : NSObject {
+	//! @privatesection
+	JSONRPCService* _service;
+}
+@property(nonatomic, readonly) JSONRPCService* service; //!< the service the method calls are sent to
++(id)client; //!< Commodity constructor, for the URL of the SMD
++(id)clientWithService:(JSONRPCService*)service; //!< Commodity constructor
+-(id)initWithService:(JSONRPCService*)service; //!< Designed initializer
+
+//! echo(text) -> NSString*
+-(JSONRPCResponseHandler*)echoWithText:(NSString*)text;
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)echoWithText:(NSString*)text completion:(void(^)(NSString* result, NSError* error))completion;
+#endif
+
+//! getAuthor() -> DemoPerson*
+-(JSONRPCResponseHandler*)getAuthor;
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)getAuthorWithCompletion:(void(^)(DemoPerson* result, NSError* error))completion;
+#endif
+
+//! getCouple() -> DemoCouple*
+-(JSONRPCResponseHandler*)getCouple;
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)getCoupleWithCompletion:(void(^)(DemoCouple* result, NSError* error))completion;
+#endif
+
+//! wadd(a, b) -> NSInteger
+-(JSONRPCResponseHandler*)waddWithA:(NSInteger)a b:(NSInteger)b;
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)waddWithA:(NSInteger)a b:(NSInteger)b completion:(void(^)(NSNumber* result, NSError* error))completion;
+#endif
+
+//! total(values) -> double
+-(JSONRPCResponseHandler*)totalWithValues:(NSArray*)values;
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)totalWithValues:(NSArray*)values completion:(void(^)(NSNumber* result, NSError* error))completion;
+#endif
+
+//! system.smd() -> DemoServiceDef*
+-(JSONRPCResponseHandler*)systemSmd;
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)systemSmdWithCompletion:(void(^)(DemoServiceDef* result, NSError* error))completion;
+#endif
+@end
@@ -0,0 +1,178 @@
+//
+//  DemoClient.m
+//
+//  Generated by SMDGen from Jayrock.smd. Do not edit: edit the annotations and generate it again.
+//
+
+#import "DemoClient.h"
+#import "JSON.h"
+
+static NSString* const kEchoMethodName = @"echo";
+static NSString* const kGetAuthorMethodName = @"getAuthor";
+static NSString* const kGetCoupleMethodName = @"getCouple";
+static NSString* const kWaddMethodName = @"wadd";
+static NSString* const kTotalMethodName = @"total";
+static NSString* const kSystemSmdMethodName = @"system.smd";
+
+// The request envelopes, up to the parameters
+static const char kEchoEnvelope[] = "{\"version\":\"1.1\",\"method\":\"echo\",\"params\":";
+static const char kGetAuthorEnvelope[] = "{\"version\":\"1.1\",\"method\":\"getAuthor\",\"params\":";
+static const char kGetCoupleEnvelope[] = "{\"version\":\"1.1\",\"method\":\"getCouple\",\"params\":";
+static const char kWaddEnvelope[] = "{\"version\":\"1.1\",\"method\":\"wadd\",\"params\":";
+static const char kTotalEnvelope[] = "{\"version\":\"1.1\",\"method\":\"total\",\"params\":";
+static const char kSystemSmdEnvelope[] = "{\"version\":\"1.1\",\"method\":\"system.smd\",\"params\":";
+
+
+//! Method call encoded from an envelope built beforehand: only the parameters and the id are encoded for each call
+@interface DemoMethodCall : JSONRPCMethodCall {
+	const char* _envelope;
+}
+-(id)initWithEnvelope:(const char*)envelope methodName:(NSString*)methodName parameters:(NSArray*)params;
+@end
+
+@implementation DemoMethodCall
+-(id)initWithEnvelope:(const char*)envelope methodName:(NSString*)methodName parameters:(NSArray*)params {
+	self = [super initWithMethodName:methodName parameters:params];
+	if (self != nil) {
+		_envelope = envelope;
+	}
+	return self;
+}
+
+-(NSData*)JSONData {
+	NSString* params = self.parameters ? [self.parameters JSONRepresentation] : @"null";
+	if (self.service.version != JSONRPCVersion_1_1 || !params) return [super JSONData]; // the envelopes are for JSONRPCVersion_1_1 only
+	NSMutableData* data = [NSMutableData dataWithBytes:_envelope length:strlen(_envelope)];
+	[data appendData:[params dataUsingEncoding:NSUTF8StringEncoding]];
+	[data appendData:[[NSString stringWithFormat:@",\"id\":\"%@\"}",self.uuid] dataUsingEncoding:NSUTF8StringEncoding]];
+	return data;
+}
+@end
+
+
+@implementation DemoClient
+@synthesize service = _service;
+
++(id)client {
+	return [self clientWithService:[JSONRPCService serviceWithURL:[NSURL URLWithString:@"http://www.raboof.com/Projects/Jayrock/Demo.ashx"] version:JSONRPCVersion_1_1]];
+}
+
++(id)clientWithService:(JSONRPCService*)service {
+	return [[[self alloc] initWithService:service] autorelease];
+}
+
+-(id)initWithService:(JSONRPCService*)service {
+	self = [super init];
+	if (self != nil) {
+		_service = [service retain];
+	}
+	return self;
+}
+
+-(JSONRPCResponseHandler*)echoWithText:(NSString*)text {
+	NSArray* params = [NSArray arrayWithObjects:(text ?: (id)[NSNull null]),nil];
+	DemoMethodCall* methodCall = [[DemoMethodCall alloc] initWithEnvelope:kEchoEnvelope methodName:kEchoMethodName parameters:params];
+	JSONRPCResponseHandler* handler = [_service callMethod:methodCall];
+	[methodCall release];
+	return handler;
+}
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)echoWithText:(NSString*)text completion:(void(^)(NSString* result, NSError* error))completion {
+	JSONRPCResponseHandler* handler = [self echoWithText:text];
+	[handler completion:^(JSONRPCMethodCall* methodCall, id result, NSError* error) {
+		completion((result == [NSNull null]) ? nil : result, error);
+	}];
+	return handler;
+}
+#endif
+
+-(JSONRPCResponseHandler*)getAuthor {
+	DemoMethodCall* methodCall = [[DemoMethodCall alloc] initWithEnvelope:kGetAuthorEnvelope methodName:kGetAuthorMethodName parameters:nil];
+	JSONRPCResponseHandler* handler = [_service callMethod:methodCall];
+	[methodCall release];
+	handler.resultClass = [DemoPerson class];
+	return handler;
+}
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)getAuthorWithCompletion:(void(^)(DemoPerson* result, NSError* error))completion {
+	JSONRPCResponseHandler* handler = [self getAuthor];
+	[handler completion:^(JSONRPCMethodCall* methodCall, id result, NSError* error) {
+		completion((result == [NSNull null]) ? nil : result, error);
+	}];
+	return handler;
+}
+#endif
+
+-(JSONRPCResponseHandler*)getCouple {
+	DemoMethodCall* methodCall = [[DemoMethodCall alloc] initWithEnvelope:kGetCoupleEnvelope methodName:kGetCoupleMethodName parameters:nil];
+	JSONRPCResponseHandler* handler = [_service callMethod:methodCall];
+	[methodCall release];
+	handler.resultClass = [DemoCouple class];
+	return handler;
+}
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)getCoupleWithCompletion:(void(^)(DemoCouple* result, NSError* error))completion {
+	JSONRPCResponseHandler* handler = [self getCouple];
+	[handler completion:^(JSONRPCMethodCall* methodCall, id result, NSError* error) {
+		completion((result == [NSNull null]) ? nil : result, error);
+	}];
+	return handler;
+}
+#endif
+
+-(JSONRPCResponseHandler*)waddWithA:(NSInteger)a b:(NSInteger)b {
+	NSArray* params = [NSArray arrayWithObjects:[NSNumber numberWithInteger:a],[NSNumber numberWithInteger:b],nil];
+	DemoMethodCall* methodCall = [[DemoMethodCall alloc] initWithEnvelope:kWaddEnvelope methodName:kWaddMethodName parameters:params];
+	JSONRPCResponseHandler* handler = [_service callMethod:methodCall];
+	[methodCall release];
+	return handler;
+}
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)waddWithA:(NSInteger)a b:(NSInteger)b completion:(void(^)(NSNumber* result, NSError* error))completion {
+	JSONRPCResponseHandler* handler = [self waddWithA:a b:b];
+	[handler completion:^(JSONRPCMethodCall* methodCall, id result, NSError* error) {
+		completion((result == [NSNull null]) ? nil : result, error);
+	}];
+	return handler;
+}
+#endif
+
+-(JSONRPCResponseHandler*)totalWithValues:(NSArray*)values {
+	NSArray* params = [NSArray arrayWithObjects:(values ?: (id)[NSNull null]),nil];
+	DemoMethodCall* methodCall = [[DemoMethodCall alloc] initWithEnvelope:kTotalEnvelope methodName:kTotalMethodName parameters:params];
+	JSONRPCResponseHandler* handler = [_service callMethod:methodCall];
+	[methodCall release];
+	return handler;
+}
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)totalWithValues:(NSArray*)values completion:(void(^)(NSNumber* result, NSError* error))completion {
+	JSONRPCResponseHandler* handler = [self totalWithValues:values];
+	[handler completion:^(JSONRPCMethodCall* methodCall, id result, NSError* error) {
+		completion((result == [NSNull null]) ? nil : result, error);
+	}];
+	return handler;
+}
+#endif
+
+-(JSONRPCResponseHandler*)systemSmd {
+	DemoMethodCall* methodCall = [[DemoMethodCall alloc] initWithEnvelope:kSystemSmdEnvelope methodName:kSystemSmdMethodName parameters:nil];
+	JSONRPCResponseHandler* handler = [_service callMethod:methodCall];
+	[methodCall release];
+	handler.resultClass = [DemoServiceDef class];
+	return handler;
+}
+#if NS_BLOCKS_AVAILABLE
+-(JSONRPCResponseHandler*)systemSmdWithCompletion:(void(^)(DemoServiceDef* result, NSError* error))completion {
+	JSONRPCResponseHandler* handler = [self systemSmd];
+	[handler completion:^(JSONRPCMethodCall* methodCall, id result, NSError* error) {
+		completion((result == [NSNull null]) ? nil : result, error);
+	}];
+	return handler;
+}
+#endif
+
+-(void)dealloc {
+	[_service release];
+	[super dealloc];
+}
+@end
@@ -0,0 +1,78 @@
+//
+//  DemoTypes.h
+//
+//  Generated by SMDGen from Jayrock.smd. Do not edit: edit the annotations and generate it again.
+//
+
+#import <Foundation/Foundation.h>
+
+@class DemoCouple;
+@class DemoMethodDef;
+@class DemoParamDef;
+@class DemoPerson;
+@class DemoServiceDef;
+
+
+//! Result class decoding the "Couple" JSON objects
+@interface DemoCouple : NSObject {
+	//! @privatesection
+	DemoPerson* _husband;
+	DemoPerson* _wife;
+}
+@property(nonatomic, retain) DemoPerson* husband; //!< "husband"
+@property(nonatomic, retain) DemoPerson* wife; //!< "wife"
+-(id)initWithJson:(NSDictionary*)dict; //!< @return nil if dict is not an NSDictionary
+-(id)proxyForJson; //!< the JSON object, to send an instance as a parameter
+@end
+
+
+//! Result class decoding the "MethodDef" JSON objects
+@interface DemoMethodDef : NSObject {
+	//! @privatesection
+	NSString* _name;
+	NSArray* _parameters;
+}
+@property(nonatomic, copy) NSString* name; //!< "name"
+@property(nonatomic, retain) NSArray* parameters; //!< "parameters"
+-(id)initWithJson:(NSDictionary*)dict; //!< @return nil if dict is not an NSDictionary
+-(id)proxyForJson; //!< the JSON object, to send an instance as a parameter
+@end
+
+
+//! Result class decoding the "ParamDef" JSON objects
+@interface DemoParamDef : NSObject {
+	//! @privatesection
+	NSString* _name;
+}
+@property(nonatomic, copy) NSString* name; //!< "name"
+-(id)initWithJson:(NSDictionary*)dict; //!< @return nil if dict is not an NSDictionary
+-(id)proxyForJson; //!< the JSON object, to send an instance as a parameter
+@end
+
+
+//! Result class decoding the "Person" JSON objects
+@interface DemoPerson : NSObject {
+	//! @privatesection
+	NSString* _firstName;
+	NSString* _lastName;
+}
+@property(nonatomic, copy) NSString* firstName; //!< "FirstName" or "firstName"
+@property(nonatomic, copy) NSString* lastName; //!< "LastName" or "lastName"
+-(id)initWithJson:(NSDictionary*)dict; //!< @return nil if dict is not an NSDictionary
+-(id)proxyForJson; //!< the JSON object, to send an instance as a parameter
+@end
+
+
+//! Result class decoding the "ServiceDef" JSON objects
+@interface DemoServiceDef : NSObject {
+	//! @privatesection
+	NSString* _objectName;
+	NSString* _serviceURL;
+	NSArray* _methods;
+}
+@property(nonatomic, copy) NSString* objectName; //!< "objectName"
+@property(nonatomic, copy) NSString* serviceURL; //!< "serviceURL"
+@property(nonatomic, retain) NSArray* methods; //!< "methods"
+-(id)initWithJson:(NSDictionary*)dict; //!< @return nil if dict is not an NSDictionary
+-(id)proxyForJson; //!< the JSON object, to send an instance as a parameter
+@end
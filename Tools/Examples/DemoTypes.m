@@ -0,0 +1,203 @@
+//
+//  DemoTypes.m
+//
+//  Generated by SMDGen from Jayrock.smd. Do not edit: edit the annotations and generate it again.
+//
+
+#import "DemoTypes.h"
+#import "JSONRPC.h"
+
+
+@implementation DemoCouple
+@synthesize husband = _husband;
+@synthesize wife = _wife;
+
+-(id)initWithJson:(NSDictionary*)dict {
+	if (![dict isKindOfClass:[NSDictionary class]]) {
+		[self release];
+		return nil;
+	}
+	self = [super init];
+	if (self != nil) {
+		id v;
+		v = [dict objectForKey:@"husband"];
+		_husband = [[DemoPerson alloc] initWithJson:v];
+		v = [dict objectForKey:@"wife"];
+		_wife = [[DemoPerson alloc] initWithJson:v];
+	}
+	return self;
+}
+
+-(id)proxyForJson {
+	NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:2];
+	if (_husband) [dict setObject:_husband forKey:@"husband"];
+	if (_wife) [dict setObject:_wife forKey:@"wife"];
+	return dict;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@>",NSStringFromClass([self class]),[self proxyForJson]];
+}
+
+-(void)dealloc {
+	[_husband release];
+	[_wife release];
+	[super dealloc];
+}
+@end
+
+
+@implementation DemoMethodDef
+@synthesize name = _name;
+@synthesize parameters = _parameters;
+
+-(id)initWithJson:(NSDictionary*)dict {
+	if (![dict isKindOfClass:[NSDictionary class]]) {
+		[self release];
+		return nil;
+	}
+	self = [super init];
+	if (self != nil) {
+		id v;
+		v = [dict objectForKey:@"name"];
+		_name = [v isKindOfClass:[NSString class]] ? [v copy] : nil;
+		v = [dict objectForKey:@"parameters"];
+		_parameters = [v isKindOfClass:[NSArray class]] ? [[NSArray alloc] initWithJson:v itemsClass:[DemoParamDef class]] : nil;
+	}
+	return self;
+}
+
+-(id)proxyForJson {
+	NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:2];
+	if (_name) [dict setObject:_name forKey:@"name"];
+	if (_parameters) [dict setObject:_parameters forKey:@"parameters"];
+	return dict;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@>",NSStringFromClass([self class]),[self proxyForJson]];
+}
+
+-(void)dealloc {
+	[_name release];
+	[_parameters release];
+	[super dealloc];
+}
+@end
+
+
+@implementation DemoParamDef
+@synthesize name = _name;
+
+-(id)initWithJson:(NSDictionary*)dict {
+	if (![dict isKindOfClass:[NSDictionary class]]) {
+		[self release];
+		return nil;
+	}
+	self = [super init];
+	if (self != nil) {
+		id v;
+		v = [dict objectForKey:@"name"];
+		_name = [v isKindOfClass:[NSString class]] ? [v copy] : nil;
+	}
+	return self;
+}
+
+-(id)proxyForJson {
+	NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:1];
+	if (_name) [dict setObject:_name forKey:@"name"];
+	return dict;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@>",NSStringFromClass([self class]),[self proxyForJson]];
+}
+
+-(void)dealloc {
+	[_name release];
+	[super dealloc];
+}
+@end
+
+
+@implementation DemoPerson
+@synthesize firstName = _firstName;
+@synthesize lastName = _lastName;
+
+-(id)initWithJson:(NSDictionary*)dict {
+	if (![dict isKindOfClass:[NSDictionary class]]) {
+		[self release];
+		return nil;
+	}
+	self = [super init];
+	if (self != nil) {
+		id v;
+		v = [dict objectForKey:@"FirstName"] ?: [dict objectForKey:@"firstName"];
+		_firstName = [v isKindOfClass:[NSString class]] ? [v copy] : nil;
+		v = [dict objectForKey:@"LastName"] ?: [dict objectForKey:@"lastName"];
+		_lastName = [v isKindOfClass:[NSString class]] ? [v copy] : nil;
+	}
+	return self;
+}
+
+-(id)proxyForJson {
+	NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:2];
+	if (_firstName) [dict setObject:_firstName forKey:@"FirstName"];
+	if (_lastName) [dict setObject:_lastName forKey:@"LastName"];
+	return dict;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@>",NSStringFromClass([self class]),[self proxyForJson]];
+}
+
+-(void)dealloc {
+	[_firstName release];
+	[_lastName release];
+	[super dealloc];
+}
+@end
+
+
+@implementation DemoServiceDef
+@synthesize objectName = _objectName;
+@synthesize serviceURL = _serviceURL;
+@synthesize methods = _methods;
+
+-(id)initWithJson:(NSDictionary*)dict {
+	if (![dict isKindOfClass:[NSDictionary class]]) {
+		[self release];
+		return nil;
+	}
+	self = [super init];
+	if (self != nil) {
+		id v;
+		v = [dict objectForKey:@"objectName"];
+		_objectName = [v isKindOfClass:[NSString class]] ? [v copy] : nil;
+		v = [dict objectForKey:@"serviceURL"];
+		_serviceURL = [v isKindOfClass:[NSString class]] ? [v copy] : nil;
+		v = [dict objectForKey:@"methods"];
+		_methods = [v isKindOfClass:[NSArray class]] ? [[NSArray alloc] initWithJson:v itemsClass:[DemoMethodDef class]] : nil;
+	}
+	return self;
+}
+
+-(id)proxyForJson {
+	NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:3];
+	if (_objectName) [dict setObject:_objectName forKey:@"objectName"];
+	if (_serviceURL) [dict setObject:_serviceURL forKey:@"serviceURL"];
+	if (_methods) [dict setObject:_methods forKey:@"methods"];
+	return dict;
+}
+
+-(NSString*)description {
+	return [NSString stringWithFormat:@"<%@ %@>",NSStringFromClass([self class]),[self proxyForJson]];
+}
+
+-(void)dealloc {
+	[_objectName release];
+	[_serviceURL release];
+	[_methods release];
+	[super dealloc];
+}
+@end
@@ -0,0 +1,570 @@
+//
+//  SMDGen.m
+//  AliJSONRPC Tools
+//
+//  Generates typed Objective-C client and result classes from the SMD (Service Mapping Description) of a JSON-RPC WebService.
+//
+//  Build with ./build.sh, then run:
+//    ./build/SMDGen service.smd [--types annotations.json] [--prefix Prefix] [--output dir]
+//
+//  The SMD can be in the Jayrock format (the result of "system.smd": objectName, serviceURL and a "methods" array)
+//  or in the SMD 2.0 format ("target" and a "services" dictionary). As SMDs rarely carry types, an optional annotations
+//  file describes the result classes and the types of the parameters and results:
+//
+//    {
+//      "prefix": "Demo",
+//      "version": "1.1",
+//      "types": {
+//        "Person": [ { "name": "firstName", "type": "string", "key": ["FirstName","firstName"] }, ... ],
+//        "Couple": { "husband": "Person", "wife": "Person" }
+//      },
+//      "methods": {
+//        "getCouple": { "result": "Couple" },
+//        "wadd": { "params": ["int","int"], "result": "int" },
+//        "total": { "params": { "values": "array<number>" }, "result": "number" }
+//      }
+//    }
+//
+//  Types are: string, int, number, bool, array, object, any, array<T> (or T[]) and the names of the types declared above.
+//  The fields of a type are given either as an array (to keep their order) or as a dictionary (sorted by name). The "key" of a
+//  field is its name in the JSON object (several keys can be tried in turn), and defaults to the name of the field.
+//
+//  For an SMD describing a service "Demo", the tool writes DemoClient.h/.m and DemoTypes.h/.m:
+//   - DemoClient has one method per JSON-RPC method, with typed parameters, returning the JSONRPCResponseHandler with the
+//     resultClass already set, and a variant with a typed completion block. The parameters are boxed directly into the
+//     params array: no dynamic proxy, no forwarding. The beginning of the request envelope of each method (version and
+//     method name) is a string constant: only the parameters and the id are encoded for each call.
+//   - Each result class decodes its fields from the JSON object with their known keys and types in -initWithJson:
+//     (no key-value coding nor reflection) and encodes them back in -proxyForJson, so it can be used as a parameter too.
+//
+
+#import <Foundation/Foundation.h>
+#import "JSON.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+	TypeString, TypeInt, TypeNumber, TypeBool, TypeArray, TypeObject, TypeAny, TypeList, TypeClass
+} TypeKind;
+
+//! A type of the annotations, and how it maps to Objective-C
+@interface TypeRef : NSObject {
+	TypeKind _kind;
+	NSString* _className; // TypeClass
+	TypeRef* _itemType;   // TypeList
+}
+@property(nonatomic, readonly) TypeKind kind;
+@property(nonatomic, readonly) NSString* className;
+@property(nonatomic, readonly) TypeRef* itemType;
++(TypeRef*)typeNamed:(NSString*)name prefix:(NSString*)prefix declaredTypes:(NSSet*)declaredTypes;
+-(BOOL)isObject;
+-(NSString*)declaration;       //!< the type of a variable, e.g. "NSString*" or "NSInteger"
+-(NSString*)objectDeclaration; //!< the type once boxed in an object, e.g. "NSNumber*" for NSInteger
+-(NSString*)propertyAttributes;
+-(NSString*)boxExpression:(NSString*)expr;  //!< expression of a JSON value (never nil) from a variable of this type
+-(NSString*)decodeExpression:(NSString*)v;  //!< expression of this type (retained if an object) from a JSON value, nil/0 if it has another type
+-(NSString*)resultClassExpression;          //!< the resultClass to convert the result of a JSON-RPC method returning this type
+@end
+
+@implementation TypeRef
+@synthesize kind = _kind, className = _className, itemType = _itemType;
+
++(TypeRef*)typeNamed:(NSString*)name prefix:(NSString*)prefix declaredTypes:(NSSet*)declaredTypes {
+	TypeRef* t = [[[TypeRef alloc] init] autorelease];
+	name = [name stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+	NSString* lower = [name lowercaseString];
+	NSString* itemName = nil;
+	if ([lower hasPrefix:@"array<"] && [lower hasSuffix:@">"]) itemName = [name substringWithRange:NSMakeRange(6, [name length]-7)];
+	else if ([name hasSuffix:@"[]"]) itemName = [name substringToIndex:[name length]-2];
+	
+	if (itemName) {
+		t->_kind = TypeList;
+		t->_itemType = [[TypeRef typeNamed:itemName prefix:prefix declaredTypes:declaredTypes] retain];
+	} else if ([declaredTypes containsObject:name]) {
+		t->_kind = TypeClass;
+		t->_className = [[prefix stringByAppendingString:name] retain];
+	} else if ([lower isEqualToString:@"string"] || [lower isEqualToString:@"str"]) t->_kind = TypeString;
+	else if ([lower isEqualToString:@"int"] || [lower isEqualToString:@"integer"] || [lower isEqualToString:@"long"]) t->_kind = TypeInt;
+	else if ([lower isEqualToString:@"number"] || [lower isEqualToString:@"double"] || [lower isEqualToString:@"float"]) t->_kind = TypeNumber;
+	else if ([lower isEqualToString:@"bool"] || [lower isEqualToString:@"boolean"]) t->_kind = TypeBool;
+	else if ([lower isEqualToString:@"array"] || [lower isEqualToString:@"list"]) t->_kind = TypeArray;
+	else if ([lower isEqualToString:@"object"] || [lower isEqualToString:@"dict"]) t->_kind = TypeObject;
+	else {
+		if ([name length] && ![lower isEqualToString:@"any"]) fprintf(stderr, "warning: unknown type \"%s\", using id\n", [name UTF8String]);
+		t->_kind = TypeAny;
+	}
+	return t;
+}
+
+-(BOOL)isObject {
+	return (_kind != TypeInt) && (_kind != TypeNumber) && (_kind != TypeBool);
+}
+
+-(NSString*)declaration {
+	switch (_kind) {
+		case TypeString: return @"NSString*";
+		case TypeInt:    return @"NSInteger";
+		case TypeNumber: return @"double";
+		case TypeBool:   return @"BOOL";
+		case TypeArray:
+		case TypeList:   return @"NSArray*";
+		case TypeObject: return @"NSDictionary*";
+		case TypeClass:  return [_className stringByAppendingString:@"*"];
+		default:         return @"id";
+	}
+}
+
+-(NSString*)objectDeclaration {
+	return [self isObject] ? [self declaration] : @"NSNumber*";
+}
+
+-(NSString*)propertyAttributes {
+	if (![self isObject]) return @"nonatomic, assign";
+	return (_kind == TypeString) ? @"nonatomic, copy" : @"nonatomic, retain";
+}
+
+-(NSString*)boxExpression:(NSString*)expr {
+	switch (_kind) {
+		case TypeInt:    return [NSString stringWithFormat:@"[NSNumber numberWithInteger:%@]",expr];
+		case TypeNumber: return [NSString stringWithFormat:@"[NSNumber numberWithDouble:%@]",expr];
+		case TypeBool:   return [NSString stringWithFormat:@"[NSNumber numberWithBool:%@]",expr];
+		default:         return [NSString stringWithFormat:@"(%@ ?: (id)[NSNull null])",expr];
+	}
+}
+
+-(NSString*)decodeExpression:(NSString*)v {
+	switch (_kind) {
+		case TypeString: return [NSString stringWithFormat:@"[%@ isKindOfClass:[NSString class]] ? [%@ copy] : nil",v,v];
+		case TypeInt:    return [NSString stringWithFormat:@"[%@ isKindOfClass:[NSNumber class]] ? [%@ integerValue] : 0",v,v];
+		case TypeNumber: return [NSString stringWithFormat:@"[%@ isKindOfClass:[NSNumber class]] ? [%@ doubleValue] : 0",v,v];
+		case TypeBool:   return [NSString stringWithFormat:@"[%@ isKindOfClass:[NSNumber class]] ? [%@ boolValue] : NO",v,v];
+		case TypeArray:  return [NSString stringWithFormat:@"[%@ isKindOfClass:[NSArray class]] ? [%@ retain] : nil",v,v];
+		case TypeObject: return [NSString stringWithFormat:@"[%@ isKindOfClass:[NSDictionary class]] ? [%@ retain] : nil",v,v];
+		case TypeClass:  return [NSString stringWithFormat:@"[[%@ alloc] initWithJson:%@]",_className,v];
+		case TypeList:
+			if (_itemType.kind == TypeClass) {
+				return [NSString stringWithFormat:@"[%@ isKindOfClass:[NSArray class]] ? [[NSArray alloc] initWithJson:%@ itemsClass:[%@ class]] : nil",
+						v,v,_itemType.className];
+			}
+			return [NSString stringWithFormat:@"[%@ isKindOfClass:[NSArray class]] ? [%@ retain] : nil",v,v];
+		default:         return [NSString stringWithFormat:@"(%@ == [NSNull null]) ? nil : [%@ retain]",v,v];
+	}
+}
+
+-(NSString*)resultClassExpression {
+	if (_kind == TypeClass) return [NSString stringWithFormat:@"[%@ class]",_className];
+	if (_kind == TypeList && _itemType.kind == TypeClass) return [NSString stringWithFormat:@"[%@ class]",_itemType.className];
+	return nil;
+}
+
+-(void)dealloc {
+	[_className release];
+	[_itemType release];
+	[super dealloc];
+}
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Names
+/////////////////////////////////////////////////////////////////////////////
+
+// A valid Objective-C identifier from a JSON-RPC name: "system.smd" -> "systemSmd"
+static NSString* identifier(NSString* name, BOOL capitalized) {
+	NSMutableString* ident = [NSMutableString string];
+	BOOL upperNext = capitalized;
+	for(NSUInteger i=0; i<[name length]; ++i) {
+		unichar c = [name characterAtIndex:i];
+		BOOL alnum = (c < 128) && (isalnum(c) || c == '_');
+		if (!alnum) {
+			upperNext = ([ident length] > 0) || capitalized;
+			continue;
+		}
+		if ([ident length] == 0 && isdigit(c)) [ident appendString:@"_"];
+		NSString* ch = [NSString stringWithCharacters:&c length:1];
+		if (upperNext) ch = [ch uppercaseString];
+		else if (![ident length]) ch = [ch lowercaseString];
+		[ident appendString:ch];
+		upperNext = NO;
+	}
+	if (![ident length]) [ident appendString:capitalized ? @"Value" : @"value"];
+	static NSSet* reserved = nil;
+	if (!reserved) reserved = [[NSSet alloc] initWithObjects:@"id",@"self",@"super",@"class",@"int",@"char",@"float",@"double",@"long",
+							   @"short",@"void",@"in",@"out",@"for",@"if",@"else",@"do",@"while",@"switch",@"case",@"default",@"return",
+							   @"break",@"continue",@"const",@"static",@"struct",@"union",@"enum",@"signed",@"unsigned",@"auto",
+							   @"register",@"volatile",@"extern",@"inline",@"restrict",@"goto",@"sizeof",@"typedef",@"bool",@"BOOL",
+							   @"description",@"hash",@"retain",@"release",@"autorelease",@"copy",@"init",@"dealloc",@"service",nil];
+	if (!capitalized && [reserved containsObject:ident]) [ident appendString:@"Value"];
+	return ident;
+}
+
+static NSString* cString(NSString* s) {
+	NSString* escaped = [[s stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"] stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+	return [NSString stringWithFormat:@"\"%@\"",escaped];
+}
+
+static NSString* objcString(NSString* s) {
+	return [@"@" stringByAppendingString:cString(s)];
+}
+
+// A JSON string, escaped by hand: SBJsonWriter's stringWithObject: only writes arrays and objects
+static NSString* jsonString(NSString* s) {
+	NSMutableString* json = [NSMutableString stringWithString:@"\""];
+	for(NSUInteger i=0; i<[s length]; ++i) {
+		unichar c = [s characterAtIndex:i];
+		if (c == '"' || c == '\\') [json appendFormat:@"\\%C",c];
+		else if (c < 0x20) [json appendFormat:@"\\u%04x",(unsigned)c];
+		else [json appendFormat:@"%C",c];
+	}
+	[json appendString:@"\""];
+	return json;
+}
+
+// The request envelope of a method up to its parameters, as a C string literal: {"jsonrpc":"2.0","method":"echo","params":
+static NSString* envelopeLiteral(NSString* methodName, NSString* version) {
+	NSString* versionMember = @"";
+	if ([version isEqualToString:@"JSONRPCVersion_2_0"]) versionMember = @"\"jsonrpc\":\"2.0\",";
+	else if ([version isEqualToString:@"JSONRPCVersion_1_1"]) versionMember = @"\"version\":\"1.1\",";
+	return cString([NSString stringWithFormat:@"{%@\"method\":%@,\"params\":",versionMember,jsonString(methodName)]);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Model
+/////////////////////////////////////////////////////////////////////////////
+
+//! A field of a result class, or a parameter of a method
+@interface Field : NSObject {
+	NSString* _name;
+	NSArray* _keys;
+	TypeRef* _type;
+}
+@property(nonatomic, copy) NSString* name;   //!< the Objective-C name
+@property(nonatomic, copy) NSArray* keys;    //!< the JSON keys to try, in turn
+@property(nonatomic, retain) TypeRef* type;
+@end
+@implementation Field
+@synthesize name = _name, keys = _keys, type = _type;
+-(void)dealloc { [_name release]; [_keys release]; [_type release]; [super dealloc]; }
+@end
+
+//! A JSON-RPC method
+@interface Method : NSObject {
+	NSString* _name;
+	NSArray* _params;
+	TypeRef* _result;
+}
+@property(nonatomic, copy) NSString* name;     //!< the JSON-RPC name
+@property(nonatomic, copy) NSArray* params;    //!< Field objects
+@property(nonatomic, retain) TypeRef* result;
+-(NSString*)selectorDeclarationWithCompletion:(NSString*)completionType; //!< nil for the variant without completion
+@end
+@implementation Method
+@synthesize name = _name, params = _params, result = _result;
+-(NSString*)selectorDeclarationWithCompletion:(NSString*)completionType {
+	NSMutableString* sel = [NSMutableString stringWithString:identifier(_name, NO)];
+	for(NSUInteger i=0; i<[_params count]; ++i) {
+		Field* p = [_params objectAtIndex:i];
+		if (i == 0) [sel appendFormat:@"With%@:(%@)%@",identifier(p.name, YES),[p.type declaration],p.name];
+		else [sel appendFormat:@" %@:(%@)%@",p.name,[p.type declaration],p.name];
+	}
+	if (completionType) {
+		[sel appendFormat:@"%@:(%@)completion",[_params count] ? @" completion" : @"WithCompletion",completionType];
+	}
+	return sel;
+}
+-(void)dealloc { [_name release]; [_params release]; [_result release]; [super dealloc]; }
+@end
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Generation
+/////////////////////////////////////////////////////////////////////////////
+
+static NSString* fileHeader(NSString* fileName, NSString* smdName) {
+	return [NSString stringWithFormat:@"//\n//  %@\n//\n//  Generated by SMDGen from %@. Do not edit: edit the annotations and generate it again.\n//\n\n",
+			fileName,smdName];
+}
+
+static NSString* typesHeader(NSString* prefix, NSArray* typeNames, NSDictionary* types, NSString* smdName) {
+	NSMutableString* h = [NSMutableString stringWithString:fileHeader([prefix stringByAppendingString:@"Types.h"], smdName)];
+	[h appendString:@"#import <Foundation/Foundation.h>\n\n"];
+	for(NSString* typeName in typeNames) [h appendFormat:@"@class %@%@;\n",prefix,typeName];
+	for(NSString* typeName in typeNames) {
+		[h appendFormat:@"\n\n//! Result class decoding the \"%@\" JSON objects\n@interface %@%@ : NSObject {\n\t//! @privatesection\n",typeName,prefix,typeName];
+		for(Field* f in [types objectForKey:typeName]) [h appendFormat:@"\t%@ _%@;\n",[f.type declaration],f.name];
+		[h appendString:@"}\n"];
+		for(Field* f in [types objectForKey:typeName]) {
+			[h appendFormat:@"@property(%@) %@ %@; //!< \"%@\"\n",[f.type propertyAttributes],[f.type declaration],f.name,
+			 [f.keys componentsJoinedByString:@"\" or \""]];
+		}
+		[h appendString:@"-(id)initWithJson:(NSDictionary*)dict; //!< @return nil if dict is not an NSDictionary\n"];
+		[h appendString:@"-(id)proxyForJson; //!< the JSON object, to send an instance as a parameter\n@end\n"];
+	}
+	return h;
+}
+
+static NSString* typesImplementation(NSString* prefix, NSArray* typeNames, NSDictionary* types, NSString* smdName) {
+	NSMutableString* m = [NSMutableString stringWithString:fileHeader([prefix stringByAppendingString:@"Types.m"], smdName)];
+	[m appendFormat:@"#import \"%@Types.h\"\n#import \"JSONRPC.h\"\n",prefix];
+	for(NSString* typeName in typeNames) {
+		NSArray* fields = [types objectForKey:typeName];
+		[m appendFormat:@"\n\n@implementation %@%@\n",prefix,typeName];
+		for(Field* f in fields) [m appendFormat:@"@synthesize %@ = _%@;\n",f.name,f.name];
+		
+		[m appendString:@"\n-(id)initWithJson:(NSDictionary*)dict {\n"
+		 "\tif (![dict isKindOfClass:[NSDictionary class]]) {\n\t\t[self release];\n\t\treturn nil;\n\t}\n"
+		 "\tself = [super init];\n\tif (self != nil) {\n"];
+		if ([fields count]) [m appendString:@"\t\tid v;\n"];
+		for(Field* f in fields) {
+			NSMutableArray* lookups = [NSMutableArray array];
+			for(NSString* key in f.keys) [lookups addObject:[NSString stringWithFormat:@"[dict objectForKey:%@]",objcString(key)]];
+			[m appendFormat:@"\t\tv = %@;\n\t\t_%@ = %@;\n",[lookups componentsJoinedByString:@" ?: "],f.name,[f.type decodeExpression:@"v"]];
+		}
+		[m appendString:@"\t}\n\treturn self;\n}\n"];
+		
+		[m appendFormat:@"\n-(id)proxyForJson {\n\tNSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:%lu];\n",(unsigned long)[fields count]];
+		for(Field* f in fields) {
+			NSString* key = objcString([f.keys objectAtIndex:0]);
+			if ([f.type isObject]) [m appendFormat:@"\tif (_%@) [dict setObject:_%@ forKey:%@];\n",f.name,f.name,key];
+			else [m appendFormat:@"\t[dict setObject:%@ forKey:%@];\n",[f.type boxExpression:[@"_" stringByAppendingString:f.name]],key];
+		}
+		[m appendString:@"\treturn dict;\n}\n"];
+		
+		[m appendFormat:@"\n-(NSString*)description {\n\treturn [NSString stringWithFormat:@\"<%%@ %%@>\",NSStringFromClass([self class]),[self proxyForJson]];\n}\n"];
+		[m appendString:@"\n-(void)dealloc {\n"];
+		for(Field* f in fields) if ([f.type isObject]) [m appendFormat:@"\t[_%@ release];\n",f.name];
+		[m appendString:@"\t[super dealloc];\n}\n@end\n"];
+	}
+	return m;
+}
+
+static NSString* clientHeader(NSString* prefix, NSArray* methods, NSString* serviceURL, NSString* smdName) {
+	NSString* className = [prefix stringByAppendingString:@"Client"];
+	NSMutableString* h = [NSMutableString stringWithString:fileHeader([className stringByAppendingString:@".h"], smdName)];
+	[h appendFormat:@"#import <Foundation/Foundation.h>\n#import \"JSONRPC.h\"\n#import \"%@Types.h\"\n\n",prefix];
+	[h appendFormat:@"//! Typed client of the %@ JSON-RPC WebService\n@interface %@ : NSObject {\n\t//! @privatesection\n\tJSONRPCService* _service;\n}\n",prefix,className];
+	[h appendString:@"@property(nonatomic, readonly) JSONRPCService* service; //!< the service the method calls are sent to\n"];
+	if (serviceURL) [h appendString:@"+(id)client; //!< Commodity constructor, for the URL of the SMD\n"];
+	[h appendString:@"+(id)clientWithService:(JSONRPCService*)service; //!< Commodity constructor\n"];
+	[h appendString:@"-(id)initWithService:(JSONRPCService*)service; //!< Designed initializer\n"];
+	for(Method* meth in methods) {
+		NSMutableArray* paramDescs = [NSMutableArray array];
+		for(Field* p in meth.params) [paramDescs addObject:p.name];
+		[h appendFormat:@"\n//! %@(%@) -> %@\n",meth.name,[paramDescs componentsJoinedByString:@", "],[meth.result declaration]];
+		[h appendFormat:@"-(JSONRPCResponseHandler*)%@;\n",[meth selectorDeclarationWithCompletion:nil]];
+		[h appendFormat:@"#if NS_BLOCKS_AVAILABLE\n-(JSONRPCResponseHandler*)%@;\n#endif\n",
+		 [meth selectorDeclarationWithCompletion:[NSString stringWithFormat:@"void(^)(%@ result, NSError* error)",[meth.result objectDeclaration]]]];
+	}
+	[h appendString:@"@end\n"];
+	return h;
+}
+
+static NSString* clientImplementation(NSString* prefix, NSArray* methods, NSString* serviceURL, NSString* version, NSString* smdName) {
+	NSString* className = [prefix stringByAppendingString:@"Client"];
+	NSMutableString* m = [NSMutableString stringWithString:fileHeader([className stringByAppendingString:@".m"], smdName)];
+	NSString* callClassName = [prefix stringByAppendingString:@"MethodCall"];
+	[m appendFormat:@"#import \"%@.h\"\n#import \"JSON.h\"\n\n",className];
+	for(Method* meth in methods) {
+		[m appendFormat:@"static NSString* const k%@MethodName = %@;\n",identifier(meth.name, YES),objcString(meth.name)];
+	}
+	[m appendString:@"\n// The request envelopes, up to the parameters\n"];
+	for(Method* meth in methods) {
+		[m appendFormat:@"static const char k%@Envelope[] = %@;\n",identifier(meth.name, YES),envelopeLiteral(meth.name, version)];
+	}
+	
+	// Method calls encoded from the envelopes above
+	[m appendFormat:@"\n\n//! Method call encoded from an envelope built beforehand: only the parameters and the id are encoded for each call\n"
+	 "@interface %@ : JSONRPCMethodCall {\n\tconst char* _envelope;\n}\n"
+	 "-(id)initWithEnvelope:(const char*)envelope methodName:(NSString*)methodName parameters:(NSArray*)params;\n@end\n\n",callClassName];
+	[m appendFormat:@"@implementation %@\n"
+	 "-(id)initWithEnvelope:(const char*)envelope methodName:(NSString*)methodName parameters:(NSArray*)params {\n"
+	 "\tself = [super initWithMethodName:methodName parameters:params];\n\tif (self != nil) {\n\t\t_envelope = envelope;\n\t}\n\treturn self;\n}\n\n",callClassName];
+	[m appendFormat:@"-(NSData*)JSONData {\n"
+	 "\tNSString* params = self.parameters ? [self.parameters JSONRepresentation] : @\"null\";\n"
+	 "\tif (self.service.version != %@ || !params) return [super JSONData]; // the envelopes are for %@ only\n"
+	 "\tNSMutableData* data = [NSMutableData dataWithBytes:_envelope length:strlen(_envelope)];\n"
+	 "\t[data appendData:[params dataUsingEncoding:NSUTF8StringEncoding]];\n"
+	 "\t[data appendData:[[NSString stringWithFormat:@\",\\\"id\\\":\\\"%%@\\\"}\",self.uuid] dataUsingEncoding:NSUTF8StringEncoding]];\n"
+	 "\treturn data;\n}\n@end\n",version,version];
+	
+	[m appendFormat:@"\n\n@implementation %@\n@synthesize service = _service;\n\n",className];
+	if (serviceURL) {
+		[m appendFormat:@"+(id)client {\n\treturn [self clientWithService:[JSONRPCService serviceWithURL:[NSURL URLWithString:%@] version:%@]];\n}\n\n",
+		 objcString(serviceURL),version];
+	}
+	[m appendString:@"+(id)clientWithService:(JSONRPCService*)service {\n\treturn [[[self alloc] initWithService:service] autorelease];\n}\n\n"];
+	[m appendString:@"-(id)initWithService:(JSONRPCService*)service {\n\tself = [super init];\n\tif (self != nil) {\n\t\t_service = [service retain];\n\t}\n\treturn self;\n}\n"];
+	
+	for(Method* meth in methods) {
+		[m appendFormat:@"\n-(JSONRPCResponseHandler*)%@ {\n",[meth selectorDeclarationWithCompletion:nil]];
+		NSString* params = @"nil";
+		if ([meth.params count]) {
+			NSMutableArray* boxed = [NSMutableArray array];
+			for(Field* p in meth.params) [boxed addObject:[p.type boxExpression:p.name]];
+			[m appendFormat:@"\tNSArray* params = [NSArray arrayWithObjects:%@,nil];\n",[boxed componentsJoinedByString:@","]];
+			params = @"params";
+		}
+		NSString* methodIdent = identifier(meth.name, YES);
+		[m appendFormat:@"\t%@* methodCall = [[%@ alloc] initWithEnvelope:k%@Envelope methodName:k%@MethodName parameters:%@];\n",
+		 callClassName,callClassName,methodIdent,methodIdent,params];
+		[m appendString:@"\tJSONRPCResponseHandler* handler = [_service callMethod:methodCall];\n\t[methodCall release];\n"];
+		NSString* resultClass = [meth.result resultClassExpression];
+		if (resultClass) [m appendFormat:@"\thandler.resultClass = %@;\n",resultClass];
+		[m appendString:@"\treturn handler;\n}\n"];
+		
+		NSMutableArray* args = [NSMutableArray array];
+		for(NSUInteger i=0; i<[meth.params count]; ++i) {
+			NSString* name = [[meth.params objectAtIndex:i] name];
+			[args addObject:(i == 0) ? [NSString stringWithFormat:@"With%@:%@",identifier(name, YES),name] : [NSString stringWithFormat:@" %@:%@",name,name]];
+		}
+		NSString* completionType = [NSString stringWithFormat:@"void(^)(%@ result, NSError* error)",[meth.result objectDeclaration]];
+		[m appendFormat:@"#if NS_BLOCKS_AVAILABLE\n-(JSONRPCResponseHandler*)%@ {\n",[meth selectorDeclarationWithCompletion:completionType]];
+		[m appendFormat:@"\tJSONRPCResponseHandler* handler = [self %@%@];\n",identifier(meth.name, NO),[args componentsJoinedByString:@""]];
+		[m appendString:@"\t[handler completion:^(JSONRPCMethodCall* methodCall, id result, NSError* error) {\n"
+		 "\t\tcompletion((result == [NSNull null]) ? nil : result, error);\n\t}];\n\treturn handler;\n}\n#endif\n"];
+	}
+	[m appendString:@"\n-(void)dealloc {\n\t[_service release];\n\t[super dealloc];\n}\n@end\n"];
+	return m;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Main
+/////////////////////////////////////////////////////////////////////////////
+
+static id readJSONFile(NSString* path) {
+	NSString* json = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+	id obj = json ? [[[[SBJsonParser alloc] init] autorelease] objectWithString:json] : nil;
+	if (![obj isKindOfClass:[NSDictionary class]]) {
+		fprintf(stderr, "error: %s is not a JSON object\n", [path UTF8String]);
+		exit(1);
+	}
+	return obj;
+}
+
+// Fields from an array of {name,type,key} or from a dictionary of name -> type or {type,key}
+static NSArray* parseFields(id desc, NSString* prefix, NSSet* declaredTypes) {
+	NSMutableArray* specs = [NSMutableArray array];
+	if ([desc isKindOfClass:[NSDictionary class]]) {
+		for(NSString* name in [[desc allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+			id spec = [desc objectForKey:name];
+			NSMutableDictionary* d = [NSMutableDictionary dictionaryWithObject:name forKey:@"name"];
+			if ([spec isKindOfClass:[NSDictionary class]]) [d addEntriesFromDictionary:spec];
+			else [d setObject:spec forKey:@"type"];
+			[specs addObject:d];
+		}
+	} else if ([desc isKindOfClass:[NSArray class]]) {
+		for(id spec in desc) {
+			if ([spec isKindOfClass:[NSDictionary class]]) [specs addObject:spec];
+			else [specs addObject:[NSDictionary dictionaryWithObjectsAndKeys:[NSString stringWithFormat:@"p%lu",(unsigned long)[specs count]+1],@"name",spec,@"type",nil]];
+		}
+	}
+	NSMutableArray* fields = [NSMutableArray array];
+	for(NSDictionary* spec in specs) {
+		Field* f = [[[Field alloc] init] autorelease];
+		NSString* jsonName = [[spec objectForKey:@"name"] description];
+		f.name = identifier(jsonName, NO);
+		id key = [spec objectForKey:@"key"];
+		f.keys = [key isKindOfClass:[NSArray class]] ? key : [NSArray arrayWithObject:(key ?: jsonName)];
+		id type = [spec objectForKey:@"type"];
+		f.type = [TypeRef typeNamed:([type isKindOfClass:[NSString class]] ? type : @"any") prefix:prefix declaredTypes:declaredTypes];
+		[fields addObject:f];
+	}
+	return fields;
+}
+
+int main(int argc, char *argv[]) {
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	
+	NSString *smdPath = nil, *typesPath = nil, *prefix = nil, *outputDir = @".";
+	for(int i=1; i<argc; ++i) {
+		BOOL hasValue = (i+1<argc);
+		if (!strcmp(argv[i], "--types") && hasValue) typesPath = [NSString stringWithUTF8String:argv[++i]];
+		else if (!strcmp(argv[i], "--prefix") && hasValue) prefix = [NSString stringWithUTF8String:argv[++i]];
+		else if (!strcmp(argv[i], "--output") && hasValue) outputDir = [NSString stringWithUTF8String:argv[++i]];
+		else if (argv[i][0] != '-' && !smdPath) smdPath = [NSString stringWithUTF8String:argv[i]];
+		else { smdPath = nil; break; }
+	}
+	if (!smdPath) {
+		fprintf(stderr, "usage: %s service.smd [--types annotations.json] [--prefix Prefix] [--output dir]\n", argv[0]);
+		return 1;
+	}
+	
+	NSDictionary* smd = readJSONFile(smdPath);
+	NSDictionary* annotations = typesPath ? readJSONFile(typesPath) : [NSDictionary dictionary];
+	NSString* smdName = [smdPath lastPathComponent];
+	prefix = prefix ?: [annotations objectForKey:@"prefix"] ?: identifier([smd objectForKey:@"objectName"] ?: [smdName stringByDeletingPathExtension], YES);
+	NSString* serviceURL = [smd objectForKey:@"serviceURL"] ?: [smd objectForKey:@"target"];
+	if (![serviceURL isKindOfClass:[NSString class]] || ![serviceURL hasPrefix:@"http"]) serviceURL = nil;
+	NSString* versionName = [[annotations objectForKey:@"version"] description] ?: [[smd objectForKey:@"version"] description] ?: @"1.1";
+	NSString* version = [versionName hasPrefix:@"2"] ? @"JSONRPCVersion_2_0" : ([versionName isEqualToString:@"1.0"] ? @"JSONRPCVersion_1_0" : @"JSONRPCVersion_1_1");
+	
+	// Result classes
+	NSDictionary* typeDescs = [annotations objectForKey:@"types"];
+	NSSet* declaredTypes = [NSSet setWithArray:[typeDescs allKeys]];
+	NSArray* typeNames = [[typeDescs allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	NSMutableDictionary* types = [NSMutableDictionary dictionary];
+	for(NSString* typeName in typeNames) {
+		[types setObject:parseFields([typeDescs objectForKey:typeName], prefix, declaredTypes) forKey:typeName];
+	}
+	
+	// Methods: from the SMD, typed with the annotations
+	NSMutableArray* methodDescs = [NSMutableArray array];
+	if ([[smd objectForKey:@"methods"] isKindOfClass:[NSArray class]]) {
+		[methodDescs addObjectsFromArray:[smd objectForKey:@"methods"]];
+	} else if ([[smd objectForKey:@"services"] isKindOfClass:[NSDictionary class]]) {
+		NSDictionary* services = [smd objectForKey:@"services"];
+		for(NSString* name in [[services allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+			NSMutableDictionary* d = [NSMutableDictionary dictionaryWithDictionary:[services objectForKey:name]];
+			[d setObject:name forKey:@"name"];
+			[methodDescs addObject:d];
+		}
+	}
+	NSDictionary* methodAnnotations = [annotations objectForKey:@"methods"];
+	NSMutableArray* methods = [NSMutableArray array];
+	for(NSDictionary* desc in methodDescs) {
+		Method* meth = [[[Method alloc] init] autorelease];
+		meth.name = [desc objectForKey:@"name"];
+		NSDictionary* annotation = [methodAnnotations objectForKey:meth.name];
+		NSArray* params = parseFields([desc objectForKey:@"parameters"] ?: [desc objectForKey:@"params"], prefix, declaredTypes);
+		id paramTypes = [annotation objectForKey:@"params"];
+		if ([paramTypes isKindOfClass:[NSArray class]]) {
+			// types of the parameters of the SMD, in order
+			NSArray* typed = parseFields(paramTypes, prefix, declaredTypes);
+			for(NSUInteger i=0; i<[typed count] && i<[params count]; ++i) {
+				[[params objectAtIndex:i] setType:[[typed objectAtIndex:i] type]];
+			}
+			if ([typed count] > [params count]) params = typed;
+		} else if (paramTypes) {
+			params = parseFields(paramTypes, prefix, declaredTypes);
+		}
+		meth.params = params;
+		id returns = [desc objectForKey:@"returns"];
+		id result = [annotation objectForKey:@"result"] ?: ([returns isKindOfClass:[NSDictionary class]] ? [returns objectForKey:@"type"] : returns);
+		meth.result = [TypeRef typeNamed:([result isKindOfClass:[NSString class]] ? result : @"any") prefix:prefix declaredTypes:declaredTypes];
+		[methods addObject:meth];
+	}
+	
+	NSDictionary* files = [NSDictionary dictionaryWithObjectsAndKeys:
+						   typesHeader(prefix, typeNames, types, smdName),[prefix stringByAppendingString:@"Types.h"],
+						   typesImplementation(prefix, typeNames, types, smdName),[prefix stringByAppendingString:@"Types.m"],
+						   clientHeader(prefix, methods, serviceURL, smdName),[prefix stringByAppendingString:@"Client.h"],
+						   clientImplementation(prefix, methods, serviceURL, version, smdName),[prefix stringByAppendingString:@"Client.m"],
+						   nil];
+	for(NSString* fileName in files) {
+		NSString* path = [outputDir stringByAppendingPathComponent:fileName];
+		NSError* error = nil;
+		if (![[files objectForKey:fileName] writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:&error]) {
+			fprintf(stderr, "error: cannot write %s: %s\n", [path UTF8String], [[error localizedDescription] UTF8String]);
+			return 1;
+		}
+		printf("%s\n", [path UTF8String]);
+	}
+	
+	[pool release];
+	return 0;
+}
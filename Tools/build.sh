@@ -0,0 +1,24 @@
+#!/bin/sh
+# Build the tools of AliJSONRPC (Mac OS X command line tools, MRC) into ./build
+set -e
+cd "$(dirname "$0")"
+FW="../AliJSONRPC Framework"
+CFLAGS="-O2 -fno-objc-arc -I$FW/JSON -I$FW/JSONRPC"
+mkdir -p build
+
+clang $CFLAGS -framework Foundation -o build/SMDGen \
+	SMDGen.m "$FW"/JSON/*.m
+
+# The checked-in output of SMDGen must be what the tool generates, and must compile against the framework.
+# After changing the generator, regenerate it with:
+#   build/SMDGen Examples/Jayrock.smd --types Examples/Jayrock.types.json --output Examples
+mkdir -p build/Examples
+build/SMDGen Examples/Jayrock.smd --types Examples/Jayrock.types.json --output build/Examples > /dev/null
+for f in DemoClient.h DemoClient.m DemoTypes.h DemoTypes.m; do
+	if ! cmp -s "build/Examples/$f" "Examples/$f"; then
+		echo "error: Examples/$f is not what SMDGen generates, regenerate it" >&2
+		diff -u "Examples/$f" "build/Examples/$f" >&2
+		exit 1
+	fi
+done
+clang $CFLAGS -fblocks -fsyntax-only -IExamples Examples/DemoTypes.m Examples/DemoClient.m